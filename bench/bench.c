@@ -0,0 +1,243 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <mysql.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+/*
+  The rows are generated from a list of columns, like int,varchar:32,text:1024,
+  and every character of a string has escape_density chances of being one
+  that mysql_real_escape_string has to escape. The same seed gives the same
+  rows, so two builds can be compared. Each benchmark runs its function
+  until bench_seconds have passed and reports rows and MB, of the bytes that
+  the function returns, per second.
+*/
+
+#ifndef MYSQL_TYPE_JSON
+#define MYSQL_TYPE_JSON 245
+#endif
+
+gchar *bench_columns=NULL;
+gint bench_num_rows=10000;
+gdouble bench_escape_density=0.02;
+gdouble bench_seconds=1;
+
+GOptionEntry bench_entries[] = {
+    {"columns", 0, 0, G_OPTION_ARG_STRING, &bench_columns,
+     "Comma separated columns of the rows: int, bigint, decimal, null, varchar:<width>, text:<width> or json:<width>. "
+     "Default int,bigint,varchar:32,varchar:255,text:1024,decimal,null", NULL},
+    {"bench-rows", 0, 0, G_OPTION_ARG_INT, &bench_num_rows,
+     "Rows to generate, default 10000", NULL},
+    {"escape-density", 0, 0, G_OPTION_ARG_DOUBLE, &bench_escape_density,
+     "Ratio of the characters of the strings that need to be escaped, default 0.02", NULL},
+    {"seconds", 0, 0, G_OPTION_ARG_DOUBLE, &bench_seconds,
+     "Minimum seconds to run each benchmark, default 1", NULL},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
+
+// The extra entries are the ones of each program, they can be NULL
+void bench_parse_options(int argc, char *argv[], const gchar *program, GOptionEntry *entries){
+  GError *error=NULL;
+  GOptionContext *context=g_option_context_new(program);
+  g_option_context_add_main_entries(context, bench_entries, NULL);
+  if (entries != NULL)
+    g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error)){
+    g_print("option parsing failed: %s, try --help\n", error->message);
+    exit(EXIT_FAILURE);
+  }
+  g_option_context_free(context);
+  if (bench_columns == NULL)
+    bench_columns=g_strdup("int,bigint,varchar:32,varchar:255,text:1024,decimal,null");
+  if (bench_num_rows <= 0 || bench_seconds <= 0){
+    g_print("--bench-rows and --seconds must be bigger than 0\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+static const gchar escaped_characters[]={'\'', '"', '\\', '\n', '\r', '\0', '\032'};
+
+static gchar *random_string(GRand *generator, guint width, gdouble escape_density, gulong *length){
+  gchar *value=g_new(gchar, width + 1);
+  guint i;
+  for (i=0; i < width; i++){
+    if (g_rand_double(generator) < escape_density)
+      value[i]=escaped_characters[g_rand_int_range(generator, 0, G_N_ELEMENTS(escaped_characters))];
+    else
+      value[i]='a' + g_rand_int_range(generator, 0, 26);
+  }
+  value[width]='\0';
+  *length=width;
+  return value;
+}
+
+static void parse_column(const gchar *column, MYSQL_FIELD *field, guint *width){
+  gchar **type_width=g_strsplit(column, ":", 2);
+  *width=type_width[1] != NULL ? (guint)atoi(type_width[1]) : 0;
+  if (g_strcmp0(type_width[0], "int") == 0){
+    field->type=MYSQL_TYPE_LONG;
+    field->flags=NUM_FLAG;
+  }else if (g_strcmp0(type_width[0], "bigint") == 0){
+    field->type=MYSQL_TYPE_LONGLONG;
+    field->flags=NUM_FLAG;
+  }else if (g_strcmp0(type_width[0], "decimal") == 0){
+    field->type=MYSQL_TYPE_NEWDECIMAL;
+    field->flags=NUM_FLAG;
+  }else if (g_strcmp0(type_width[0], "null") == 0){
+    field->type=MYSQL_TYPE_NULL;
+  }else if (g_strcmp0(type_width[0], "varchar") == 0){
+    field->type=MYSQL_TYPE_VAR_STRING;
+  }else if (g_strcmp0(type_width[0], "text") == 0){
+    field->type=MYSQL_TYPE_BLOB;
+  }else if (g_strcmp0(type_width[0], "json") == 0){
+    field->type=MYSQL_TYPE_JSON;
+  }else{
+    g_print("Unknown column type %s\n", type_width[0]);
+    exit(EXIT_FAILURE);
+  }
+  if (*width == 0)
+    *width=16;
+  g_strfreev(type_width);
+}
+
+struct bench_rows *bench_rows_new(const gchar *columns, guint num_rows, gdouble escape_density, guint32 seed){
+  struct bench_rows *br=g_new0(struct bench_rows, 1);
+  gchar **column=g_strsplit(columns, ",", 0);
+  guint *widths=NULL;
+  GRand *generator=g_rand_new_with_seed(seed);
+  guint r, f;
+  br->num_rows=num_rows;
+  br->num_fields=g_strv_length(column);
+  br->fields=g_new0(MYSQL_FIELD, br->num_fields);
+  widths=g_new(guint, br->num_fields);
+  for (f=0; f < br->num_fields; f++)
+    parse_column(column[f], &(br->fields[f]), &(widths[f]));
+  br->values=g_new(MYSQL_ROW, num_rows);
+  br->lengths=g_new(gulong *, num_rows);
+  for (r=0; r < num_rows; r++){
+    br->values[r]=g_new(gchar *, br->num_fields);
+    br->lengths[r]=g_new0(gulong, br->num_fields);
+    for (f=0; f < br->num_fields; f++){
+      switch (br->fields[f].type){
+        case MYSQL_TYPE_NULL:
+          br->values[r][f]=NULL;
+          break;
+        case MYSQL_TYPE_LONG:
+          br->values[r][f]=g_strdup_printf("%d", g_rand_int_range(generator, -2147483647, 2147483647));
+          break;
+        case MYSQL_TYPE_LONGLONG:
+          br->values[r][f]=g_strdup_printf("%" G_GUINT64_FORMAT, ((guint64)g_rand_int(generator) << 32) | g_rand_int(generator));
+          break;
+        case MYSQL_TYPE_NEWDECIMAL:
+          br->values[r][f]=g_strdup_printf("%u.%02u", g_rand_int(generator) % 1000000, g_rand_int(generator) % 100);
+          break;
+        default:
+          br->values[r][f]=random_string(generator, widths[f], escape_density, &(br->lengths[r][f]));
+      }
+      if (br->values[r][f] != NULL && br->lengths[r][f] == 0)
+        br->lengths[r][f]=strlen(br->values[r][f]);
+      br->bytes+=br->lengths[r][f];
+    }
+  }
+  g_rand_free(generator);
+  g_free(widths);
+  g_strfreev(column);
+  return br;
+}
+
+void bench_rows_free(struct bench_rows *br){
+  guint r, f;
+  for (r=0; r < br->num_rows; r++){
+    for (f=0; f < br->num_fields; f++)
+      g_free(br->values[r][f]);
+    g_free(br->values[r]);
+    g_free(br->lengths[r]);
+  }
+  g_free(br->values);
+  g_free(br->lengths);
+  g_free(br->fields);
+  g_free(br);
+}
+
+static void append_escaped(GString *statement, const gchar *value, gulong length){
+  gulong i;
+  g_string_append_c(statement, '"');
+  for (i=0; i < length; i++){
+    switch (value[i]){
+      case '\0': g_string_append(statement, "\\0"); break;
+      case '\n': g_string_append(statement, "\\n"); break;
+      case '\r': g_string_append(statement, "\\r"); break;
+      case '\032': g_string_append(statement, "\\Z"); break;
+      case '\'': case '"': case '\\':
+        g_string_append_c(statement, '\\');
+        g_string_append_c(statement, value[i]);
+        break;
+      default:
+        g_string_append_c(statement, value[i]);
+    }
+  }
+  g_string_append_c(statement, '"');
+}
+
+// The INSERT statements as mydumper writes them in a data file, one row
+// per line
+GString *bench_insert_statements(struct bench_rows *br, guint rows_per_statement){
+  GString *statements=g_string_sized_new(br->bytes * 2);
+  guint r, f;
+  for (r=0; r < br->num_rows; r++){
+    if (r % rows_per_statement == 0)
+      g_string_append(statements, "INSERT INTO `bench` VALUES");
+    g_string_append_c(statements, '(');
+    for (f=0; f < br->num_fields; f++){
+      if (f > 0)
+        g_string_append_c(statements, ',');
+      if (br->values[r][f] == NULL)
+        g_string_append(statements, "NULL");
+      else if (br->fields[f].flags & NUM_FLAG)
+        g_string_append_len(statements, br->values[r][f], br->lengths[r][f]);
+      else
+        append_escaped(statements, br->values[r][f], br->lengths[r][f]);
+    }
+    g_string_append(statements, (r + 1) % rows_per_statement == 0 || r + 1 == br->num_rows ? ");\n" : "),\n");
+  }
+  return statements;
+}
+
+gchar *bench_tmp_dir(){
+  gchar *dir=g_build_filename(g_get_tmp_dir(), "mydumper-bench-XXXXXX", NULL);
+  if (mkdtemp(dir) == NULL){
+    g_print("Could not create a temporary directory in %s\n", g_get_tmp_dir());
+    exit(EXIT_FAILURE);
+  }
+  return dir;
+}
+
+void bench_run(const gchar *name, bench_function function, gpointer data, guint64 rows_per_pass){
+  GTimer *timer=g_timer_new();
+  guint64 bytes=0, passes=0;
+  gdouble seconds;
+  do {
+    bytes+=function(data);
+    passes++;
+  } while ((seconds=g_timer_elapsed(timer, NULL)) < bench_seconds);
+  g_timer_destroy(timer);
+  g_print("%-40s %14.0f rows/s %10.1f MB/s %8" G_GUINT64_FORMAT " passes\n", name,
+          rows_per_pass * passes / seconds, bytes / seconds / 1024 / 1024, passes);
+}
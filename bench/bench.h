@@ -0,0 +1,47 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#ifndef _bench_bench_h
+#define _bench_bench_h
+#include <mysql.h>
+#include <glib.h>
+
+// Rows as mysql_fetch_row, mysql_fetch_lengths and mysql_fetch_fields
+// return them, without a server
+struct bench_rows {
+  guint num_rows;
+  guint num_fields;
+  MYSQL_FIELD *fields;
+  MYSQL_ROW *values;
+  gulong **lengths;
+  guint64 bytes;
+};
+
+typedef guint64 (*bench_function)(gpointer data);
+
+extern gchar *bench_columns;
+extern gint bench_num_rows;
+extern gdouble bench_escape_density;
+extern gdouble bench_seconds;
+extern GOptionEntry bench_entries[];
+
+void bench_parse_options(int argc, char *argv[], const gchar *program, GOptionEntry *entries);
+struct bench_rows *bench_rows_new(const gchar *columns, guint num_rows, gdouble escape_density, guint32 seed);
+void bench_rows_free(struct bench_rows *br);
+GString *bench_insert_statements(struct bench_rows *br, guint rows_per_statement);
+gchar *bench_tmp_dir();
+void bench_run(const gchar *name, bench_function function, gpointer data, guint64 rows_per_pass);
+#endif
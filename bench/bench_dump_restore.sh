@@ -0,0 +1,251 @@
+#!/bin/bash
+# Dump and restore throughput benchmark.
+#
+# It starts a throwaway mysqld, fills the bench database with tables of
+# different shapes, and runs mydumper and myloader over the matrix of
+# options below. The wall time, rows per second, peak RSS and CPU time of
+# each run are written to a JSON file, so the results of two releases can
+# be compared when they are taken on the same machine.
+#
+# Usage: bench/bench_dump_restore.sh [results.json]
+#
+# Every setting can be overridden from the environment, like:
+#   SCALE=10 THREADS="4 16" STREAM="0" bench/bench_dump_restore.sh
+
+results=${1:-bench_dump_restore.json}
+mydumper_base=${MYDUMPER_BASE:-.}
+mydumper="${mydumper_base}/mydumper"
+myloader="${mydumper_base}/myloader"
+mysqld=${MYSQLD:-mysqld}
+mysql_client=${MYSQL:-mysql}
+bench_dir=${BENCH_DIR:-/tmp/bench_dump_restore}
+port=${PORT:-13306}
+socket="${bench_dir}/mysqld.sock"
+datadir="${bench_dir}/datadir"
+dump_dir="${bench_dir}/dump"
+mydumper_log="${bench_dir}/mydumper.log"
+myloader_log="${bench_dir}/myloader.log"
+empty="${bench_dir}/empty.cnf"
+database=bench
+restore_database=bench_restore
+# Written in bench_dir when it is created, it is the only kind of directory
+# that is removed
+marker="${bench_dir}/.bench_dump_restore"
+
+# Size of the data set, the row counts below are multiplied by it
+SCALE=${SCALE:-1}
+SMALL_TABLES=${SMALL_TABLES:-500}
+SMALL_TABLE_ROWS=${SMALL_TABLE_ROWS:-100}
+HUGE_TABLE_ROWS=$(( ${HUGE_TABLE_ROWS:-1000000} * SCALE ))
+TEXT_TABLE_ROWS=$(( ${TEXT_TABLE_ROWS:-50000} * SCALE ))
+BLOB_TABLE_ROWS=$(( ${BLOB_TABLE_ROWS:-20000} * SCALE ))
+CHAR_PK_TABLE_ROWS=$(( ${CHAR_PK_TABLE_ROWS:-200000} * SCALE ))
+PARTITIONED_TABLE_ROWS=$(( ${PARTITIONED_TABLE_ROWS:-500000} * SCALE ))
+
+# The matrix, 0 and 1 turn the option off and on, a --rows of 0 is not set
+THREADS=${THREADS:-"4 8"}
+ROWS=${ROWS:-"0 100000"}
+COMPRESS=${COMPRESS:-"0 1"}
+LOAD_DATA=${LOAD_DATA:-"0 1"}
+STREAM=${STREAM:-"0 1"}
+
+total_rows=0
+first_result=1
+
+sql (){
+  $mysql_client --no-defaults -S $socket -u root "$@"
+}
+
+fail (){
+  echo "$*" >&2
+  exit 1
+}
+
+start_mysqld (){
+  if [ -e "${bench_dir}" ]
+  then
+    [ -f "${marker}" ] || fail "${bench_dir} exists and was not created by this script, set BENCH_DIR to another directory"
+    rm -rf "${bench_dir}"
+  fi
+  mkdir -p ${datadir} ${dump_dir}
+  touch "${marker}"
+  echo "[mydumper]" > $empty
+  echo "[myloader]" >> $empty
+  echo "Initializing mysqld in ${datadir}"
+  $mysqld --no-defaults --initialize-insecure --datadir=${datadir} > ${bench_dir}/mysqld_init.log 2>&1 \
+    || fail "Error initializing mysqld, see ${bench_dir}/mysqld_init.log"
+  $mysqld --no-defaults --datadir=${datadir} --socket=${socket} --port=${port} --pid-file=${bench_dir}/mysqld.pid \
+    --log-error=${bench_dir}/mysqld.err --skip-log-bin --local-infile=1 --innodb-buffer-pool-size=1G \
+    --max-allowed-packet=1G > /dev/null 2>&1 &
+  mysqld_pid=$!
+  trap stop_mysqld EXIT
+  for i in $(seq 1 60)
+  do
+    sql -e "SELECT 1" > /dev/null 2>&1 && return
+    sleep 1
+  done
+  fail "mysqld did not start, see ${bench_dir}/mysqld.err"
+}
+
+stop_mysqld (){
+  if [ -n "${mysqld_pid}" ]
+  then
+    kill ${mysqld_pid}
+    wait ${mysqld_pid}
+    mysqld_pid=
+  fi
+}
+
+# Returns a SELECT of the numbers from 1 to $1, with a cross join of as
+# many digits tables as the number has digits
+numbers (){
+  expression="0" tables="" factor=1
+  for (( d=0; factor < $1; d++ ))
+  do
+    expression+=" + ${factor}*d${d}.i"
+    tables+="${tables:+, }bench_gen.digits d${d}"
+    factor=$(( factor * 10 ))
+  done
+  echo "SELECT ${expression} + 1 AS n FROM ${tables} WHERE ${expression} < $1"
+}
+
+generate_data (){
+  echo "Generating the ${database} database, scale ${SCALE}"
+  sql -e "DROP DATABASE IF EXISTS ${database}; CREATE DATABASE ${database};
+          DROP DATABASE IF EXISTS bench_gen; CREATE DATABASE bench_gen;
+          CREATE TABLE bench_gen.digits (i TINYINT PRIMARY KEY);
+          INSERT INTO bench_gen.digits VALUES (0),(1),(2),(3),(4),(5),(6),(7),(8),(9);"
+
+  # Many small tables
+  for i in $(seq 1 ${SMALL_TABLES})
+  do
+    echo "CREATE TABLE ${database}.small_${i} (id INT PRIMARY KEY, a INT, b VARCHAR(64), c DATETIME);
+          INSERT INTO ${database}.small_${i} SELECT n, n*7, MD5(n), '2020-01-01' + INTERVAL n MINUTE FROM ($(numbers ${SMALL_TABLE_ROWS})) t;"
+  done | sql || fail "Error creating the small tables"
+  total_rows=$(( total_rows + SMALL_TABLES * SMALL_TABLE_ROWS ))
+
+  # One huge table
+  sql -e "CREATE TABLE ${database}.huge (id BIGINT AUTO_INCREMENT PRIMARY KEY, a INT, b BIGINT, c DECIMAL(12,2),
+            d VARCHAR(32), e DATETIME, KEY(a));
+          INSERT INTO ${database}.huge SELECT n, n % 1000, n*n, n/100, MD5(n), '2020-01-01' + INTERVAL n SECOND
+            FROM ($(numbers ${HUGE_TABLE_ROWS})) t;" || fail "Error creating the huge table"
+  total_rows=$(( total_rows + HUGE_TABLE_ROWS ))
+
+  # Wide text, with characters that have to be escaped
+  sql -e "CREATE TABLE ${database}.wide_text (id INT PRIMARY KEY, a TEXT, b TEXT, c MEDIUMTEXT);
+          INSERT INTO ${database}.wide_text SELECT n, REPEAT(CONCAT(MD5(n), '\\'s \"quoted\"\\n'), 8),
+            REPEAT(SHA1(n), 20), REPEAT(CONCAT(MD5(n), '\\t'), 100) FROM ($(numbers ${TEXT_TABLE_ROWS})) t;" \
+    || fail "Error creating the wide_text table"
+  total_rows=$(( total_rows + TEXT_TABLE_ROWS ))
+
+  # Blobs
+  sql -e "CREATE TABLE ${database}.blobs (id INT PRIMARY KEY, a BLOB, b LONGBLOB);
+          INSERT INTO ${database}.blobs SELECT n, UNHEX(REPEAT(MD5(n), 16)), UNHEX(REPEAT(SHA1(n), 400))
+            FROM ($(numbers ${BLOB_TABLE_ROWS})) t;" || fail "Error creating the blobs table"
+  total_rows=$(( total_rows + BLOB_TABLE_ROWS ))
+
+  # A primary key that is not an integer, it can not be chunked by ranges
+  sql -e "CREATE TABLE ${database}.char_pk (id CHAR(32) PRIMARY KEY, a INT, b VARCHAR(255));
+          INSERT INTO ${database}.char_pk SELECT MD5(n), n, REPEAT(SHA1(n), 5)
+            FROM ($(numbers ${CHAR_PK_TABLE_ROWS})) t;" || fail "Error creating the char_pk table"
+  total_rows=$(( total_rows + CHAR_PK_TABLE_ROWS ))
+
+  # Partitioned
+  sql -e "CREATE TABLE ${database}.partitioned (id INT PRIMARY KEY, a INT, b VARCHAR(64))
+            PARTITION BY HASH(id) PARTITIONS 16;
+          INSERT INTO ${database}.partitioned SELECT n, n % 100, MD5(n)
+            FROM ($(numbers ${PARTITIONED_TABLE_ROWS})) t;" || fail "Error creating the partitioned table"
+  total_rows=$(( total_rows + PARTITIONED_TABLE_ROWS ))
+
+  sql -e "DROP DATABASE bench_gen"
+  echo "Generated ${total_rows} rows"
+}
+
+# GNU time writes: wall seconds, peak RSS in KB, user and system seconds
+time_format='%e %M %U %S'
+
+# Prints the JSON of the resources of a command, from the output of time
+measurement_json (){
+  read wall rss user system < $1
+  rows_per_second=$(awk -v r=${total_rows} -v w=${wall} 'BEGIN { printf "%.0f", w > 0 ? r / w : 0 }')
+  printf '{"wall_seconds": %s, "rows_per_second": %s, "peak_rss_kb": %s, "user_seconds": %s, "system_seconds": %s}' \
+    ${wall} ${rows_per_second} ${rss} ${user} ${system}
+}
+
+run_case (){
+  threads=$1 rows=$2 compress=$3 load_data=$4 stream=$5
+  mydumper_parameters="-S ${socket} -u root -B ${database} -t ${threads}"
+  # The restore goes to another database, as in stream mode mydumper is
+  # still reading the tables while myloader restores them
+  myloader_parameters="-S ${socket} -u root -B ${restore_database} -s ${database} -t ${threads} -o"
+  (( rows > 0 )) && mydumper_parameters+=" -r ${rows}"
+  (( compress == 1 )) && mydumper_parameters+=" -c"
+  (( load_data == 1 )) && mydumper_parameters+=" --load-data"
+  rm -rf ${dump_dir}
+  mkdir -p ${dump_dir}
+  sql -e "DROP DATABASE IF EXISTS ${restore_database}" || fail "Error dropping ${restore_database}"
+  echo "threads=${threads} rows=${rows} compress=${compress} load_data=${load_data} stream=${stream}"
+  if (( stream == 1 ))
+  then
+    /usr/bin/time -f "${time_format}" -o ${bench_dir}/mydumper.time \
+      $mydumper --defaults-file=$empty ${mydumper_parameters} -o ${dump_dir} --stream -L $mydumper_log \
+    | /usr/bin/time -f "${time_format}" -o ${bench_dir}/myloader.time \
+      $myloader --defaults-file=$empty ${myloader_parameters} -d ${dump_dir} --stream -L $myloader_log
+    (( ${PIPESTATUS[0]} + ${PIPESTATUS[1]} > 0 )) && fail "Error running the stream, see $mydumper_log and $myloader_log"
+    dump_bytes=0
+  else
+    /usr/bin/time -f "${time_format}" -o ${bench_dir}/mydumper.time \
+      $mydumper --defaults-file=$empty ${mydumper_parameters} -o ${dump_dir} -L $mydumper_log \
+      || fail "Error running mydumper, see $mydumper_log"
+    dump_bytes=$(du -sb ${dump_dir} | cut -f1)
+    /usr/bin/time -f "${time_format}" -o ${bench_dir}/myloader.time \
+      $myloader --defaults-file=$empty ${myloader_parameters} -d ${dump_dir} -L $myloader_log \
+      || fail "Error running myloader, see $myloader_log"
+  fi
+  (( first_result == 1 )) || echo "," >> $results
+  first_result=0
+  printf '    {"threads": %s, "rows": %s, "compress": %s, "load_data": %s, "stream": %s, "dump_bytes": %s,\n' \
+    ${threads} ${rows} ${compress} ${load_data} ${stream} ${dump_bytes} >> $results
+  printf '     "mydumper": %s,\n' "$(measurement_json ${bench_dir}/mydumper.time)" >> $results
+  printf '     "myloader": %s}' "$(measurement_json ${bench_dir}/myloader.time)" >> $results
+}
+
+[ -x /usr/bin/time ] || fail "GNU time is needed in /usr/bin/time"
+[ -x $mydumper ] && [ -x $myloader ] || fail "mydumper and myloader not found in ${mydumper_base}, set MYDUMPER_BASE"
+
+start_mysqld
+generate_data
+
+cat > $results <<EOF
+{
+  "date": "$(date -u +%Y-%m-%dT%H:%M:%SZ)",
+  "mydumper_version": "$($mydumper --version 2>&1 | head -1)",
+  "myloader_version": "$($myloader --version 2>&1 | head -1)",
+  "mysqld_version": "$(sql -N -e 'SELECT VERSION()')",
+  "host": "$(uname -n)",
+  "kernel": "$(uname -sr)",
+  "cpus": $(nproc),
+  "scale": ${SCALE},
+  "total_rows": ${total_rows},
+  "results": [
+EOF
+
+for threads in ${THREADS}
+do
+  for rows in ${ROWS}
+  do
+    for compress in ${COMPRESS}
+    do
+      for load_data in ${LOAD_DATA}
+      do
+        for stream in ${STREAM}
+        do
+          run_case ${threads} ${rows} ${compress} ${load_data} ${stream}
+        done
+      done
+    done
+  done
+done
+
+printf '\n  ]\n}\n' >> $results
+echo "Results written to ${results}"
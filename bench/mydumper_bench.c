@@ -0,0 +1,262 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+// mydumper.c is compiled here, without its main, so the benchmarks link
+// with the same globals and functions that mydumper uses
+#define main mydumper_main
+#include "../src/mydumper.c"
+#undef main
+
+#ifdef ZWRAP_USE_ZSTD
+#include "../zstd/zstd_zlibwrapper.h"
+#else
+#include <zlib.h>
+#endif
+#include "mydumper_masquerade.h"
+#include "bench.h"
+
+extern gboolean load_data;
+extern gchar *fields_enclosed_by;
+extern gchar *fields_terminated_by;
+extern gchar *lines_starting_by;
+extern gchar *lines_terminated_by;
+extern guint statement_size;
+
+void write_column_into_string(MYSQL *conn, gchar *column, MYSQL_FIELD field, gulong length, GString *escaped, GString *statement_row);
+void write_row_into_string(MYSQL *conn, struct db_table *dbt, MYSQL_ROW row, MYSQL_FIELD *fields, gulong *lengths, guint num_fields, GString *escaped, GString *statement_row);
+
+struct format_bench {
+  MYSQL *conn;
+  struct bench_rows *br;
+  struct db_table *dbt;
+  GString *escaped;
+  GString *statement_row;
+};
+
+struct mask_bench {
+  struct masking_pipeline *mp;
+  gchar **values;
+  gulong *lengths;
+  guint count;
+  guint64 bytes;
+};
+
+struct write_bench {
+  gchar *filename;
+  GString *statement;
+  guint statements;
+  gboolean compressed;
+};
+
+// The same values that initialize_working_thread sets without options
+static gchar comma[]=",", tab[]="\t", empty[]="", open_parenthesis[]="(", close_parenthesis[]=")\n", newline[]="\n";
+
+static void set_sql_mode(){
+  load_data=FALSE;
+  fields_terminated_by=comma;
+  lines_starting_by=open_parenthesis;
+  lines_terminated_by=close_parenthesis;
+}
+
+static void set_load_data_mode(){
+  load_data=TRUE;
+  fields_enclosed_by=empty;
+  fields_terminated_by=tab;
+  lines_starting_by=empty;
+  lines_terminated_by=newline;
+}
+
+static guint64 bench_escape(gpointer data){
+  struct format_bench *fb=data;
+  struct bench_rows *br=fb->br;
+  guint r, f;
+  for (r=0; r < br->num_rows; r++)
+    for (f=0; f < br->num_fields; f++)
+      if (br->values[r][f] != NULL && !(br->fields[f].flags & NUM_FLAG)){
+        g_string_set_size(fb->escaped, br->lengths[r][f] * 2 + 1);
+        mysql_real_escape_string(fb->conn, fb->escaped->str, br->values[r][f], br->lengths[r][f]);
+      }
+  return br->bytes;
+}
+
+static guint64 bench_write_column(gpointer data){
+  struct format_bench *fb=data;
+  struct bench_rows *br=fb->br;
+  guint r, f;
+  for (r=0; r < br->num_rows; r++){
+    g_string_set_size(fb->statement_row, 0);
+    for (f=0; f < br->num_fields; f++)
+      write_column_into_string(fb->conn, br->values[r][f], br->fields[f], br->lengths[r][f], fb->escaped, fb->statement_row);
+  }
+  return br->bytes;
+}
+
+static guint64 bench_write_row(gpointer data){
+  struct format_bench *fb=data;
+  struct bench_rows *br=fb->br;
+  guint r;
+  for (r=0; r < br->num_rows; r++){
+    g_string_set_size(fb->statement_row, 0);
+    write_row_into_string(fb->conn, fb->dbt, br->values[r], br->fields, br->lengths[r], br->num_fields, fb->escaped, fb->statement_row);
+  }
+  return br->bytes;
+}
+
+static guint64 bench_mask(gpointer data){
+  struct mask_bench *mb=data;
+  gulong length;
+  guint i;
+  for (i=0; i < mb->count; i++){
+    length=mb->lengths[i];
+    mask_value(mb->mp, mb->values[i], &length);
+  }
+  return mb->bytes;
+}
+
+// Values in the format that each masking function expects
+static void run_mask_bench(const gchar *functions, const gchar *format, guint count){
+  struct mask_bench mb;
+  GRand *generator=g_rand_new_with_seed(1);
+  gchar *name=g_strdup_printf("mask %s", functions), *pipeline=g_strdup(functions);
+  guint i, a, b, c;
+  mb.mp=get_masking_pipeline_for(pipeline);
+  mb.values=g_new(gchar *, count);
+  mb.lengths=g_new(gulong, count);
+  mb.count=count;
+  mb.bytes=0;
+  for (i=0; i < count; i++){
+    a=g_rand_int_range(generator, 1, 10000);
+    b=g_rand_int_range(generator, 1, 13);
+    c=g_rand_int_range(generator, 1, 29);
+    if (g_strcmp0(format, "email") == 0)
+      mb.values[i]=g_strdup_printf("User.Name%u@Example%u.com", a, b);
+    else if (g_strcmp0(format, "phone") == 0)
+      mb.values[i]=g_strdup_printf("+1 (%03u) 555-%04u", b * 70, a);
+    else if (g_strcmp0(format, "date") == 0)
+      mb.values[i]=g_strdup_printf("%04u-%02u-%02u 12:34:56", 1970 + a % 60, b, c);
+    else
+      mb.values[i]=g_strdup_printf("%u", g_rand_int(generator));
+    mb.lengths[i]=strlen(mb.values[i]);
+    mb.bytes+=mb.lengths[i];
+  }
+  bench_run(name, bench_mask, &mb, count);
+  for (i=0; i < count; i++)
+    g_free(mb.values[i]);
+  g_free(mb.values);
+  g_free(mb.lengths);
+  g_free(mb.mp);
+  g_free(pipeline);
+  g_free(name);
+  g_rand_free(generator);
+}
+
+static guint64 bench_write_data(gpointer data){
+  struct write_bench *wb=data;
+  FILE *file=wb->compressed ? (void *)gzopen(wb->filename, "w") : g_fopen(wb->filename, "w");
+  guint i;
+  if (file == NULL){
+    g_print("Could not open %s\n", wb->filename);
+    exit(EXIT_FAILURE);
+  }
+  m_write=wb->compressed ? (void *)&gzwrite : (void *)&write_file;
+  for (i=0; i < wb->statements; i++)
+    write_data(file, wb->statement);
+  if (wb->compressed)
+    gzclose((gzFile)file);
+  else
+    fclose(file);
+  return (guint64)wb->statement->len * wb->statements;
+}
+
+// One statement_size statement, made of the rows formatted in SQL mode
+static GString *build_statement(struct format_bench *fb){
+  GString *statement=g_string_sized_new(statement_size + 1024);
+  struct bench_rows *br=fb->br;
+  guint r=0;
+  set_sql_mode();
+  g_string_append(statement, "INSERT INTO `bench` VALUES");
+  while (statement->len < statement_size){
+    g_string_set_size(fb->statement_row, 0);
+    write_row_into_string(fb->conn, fb->dbt, br->values[r], br->fields, br->lengths[r], br->num_fields, fb->escaped, fb->statement_row);
+    g_string_append(statement, fb->statement_row->str);
+    r=(r + 1) % br->num_rows;
+  }
+  return statement;
+}
+
+int main(int argc, char *argv[]){
+  struct format_bench fb;
+  struct write_bench wb;
+  gchar *dir=NULL;
+  guint64 rows_per_statement;
+  bench_parse_options(argc, argv, "- mydumper microbenchmarks", NULL);
+  // mysql_real_escape_string only needs the character set of the handle
+  fb.conn=mysql_init(NULL);
+  fb.br=bench_rows_new(bench_columns, bench_num_rows, bench_escape_density, 1);
+  fb.dbt=g_new0(struct db_table, 1);
+  fb.escaped=g_string_sized_new(3000);
+  fb.statement_row=g_string_sized_new(0);
+  g_print("%u rows of %s, %.1f MB, escape density %.3f\n", fb.br->num_rows, bench_columns,
+          (gdouble)fb.br->bytes / 1024 / 1024, bench_escape_density);
+
+  bench_run("escape", bench_escape, &fb, fb.br->num_rows);
+  set_sql_mode();
+  bench_run("write_column_into_string sql", bench_write_column, &fb, fb.br->num_rows);
+  bench_run("write_row_into_string sql", bench_write_row, &fb, fb.br->num_rows);
+  set_load_data_mode();
+  bench_run("write_column_into_string load data", bench_write_column, &fb, fb.br->num_rows);
+  bench_run("write_row_into_string load data", bench_write_row, &fb, fb.br->num_rows);
+
+  initialize_masquerade("bench");
+  run_mask_bench("hash", "number", fb.br->num_rows);
+  run_mask_bench("number", "number", fb.br->num_rows);
+  run_mask_bench("string", "email", fb.br->num_rows);
+  run_mask_bench("trim,lower,email", "email", fb.br->num_rows);
+  run_mask_bench("phone", "phone", fb.br->num_rows);
+  run_mask_bench("date", "date", fb.br->num_rows);
+
+  dir=bench_tmp_dir();
+  wb.statement=build_statement(&fb);
+  wb.statements=MAX(1, (guint)(fb.br->bytes / wb.statement->len));
+  rows_per_statement=fb.br->num_rows * wb.statement->len / MAX(fb.br->bytes, 1);
+  wb.filename=g_build_filename(dir, "bench.sql", NULL);
+  wb.compressed=FALSE;
+  bench_run("write_data", bench_write_data, &wb, rows_per_statement * wb.statements);
+  g_remove(wb.filename);
+  g_free(wb.filename);
+#ifdef ZWRAP_USE_ZSTD
+  wb.filename=g_build_filename(dir, "bench.sql.zst", NULL);
+  wb.compressed=TRUE;
+  bench_run("write_data zstd", bench_write_data, &wb, rows_per_statement * wb.statements);
+#else
+  wb.filename=g_build_filename(dir, "bench.sql.gz", NULL);
+  wb.compressed=TRUE;
+  bench_run("write_data gzip", bench_write_data, &wb, rows_per_statement * wb.statements);
+#endif
+  g_remove(wb.filename);
+  g_free(wb.filename);
+  g_rmdir(dir);
+  g_free(dir);
+
+  g_string_free(wb.statement, TRUE);
+  g_string_free(fb.escaped, TRUE);
+  g_string_free(fb.statement_row, TRUE);
+  g_free(fb.dbt);
+  bench_rows_free(fb.br);
+  mysql_close(fb.conn);
+  return EXIT_SUCCESS;
+}
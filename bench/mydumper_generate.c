@@ -0,0 +1,340 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+// mydumper.c is compiled here, without its main, so the files are named,
+// formatted, compressed and added to the manifest by the same functions
+// that mydumper uses
+#define main mydumper_main
+#include "../src/mydumper.c"
+#undef main
+
+#include <errno.h>
+#ifdef ZWRAP_USE_ZSTD
+#include "../zstd/zstd_zlibwrapper.h"
+#else
+#include <zlib.h>
+#endif
+#include "server_detect.h"
+#include "mydumper_common.h"
+#include "mydumper_database.h"
+#include "mydumper_manifest.h"
+#include "mydumper_working_thread.h"
+#include "bench.h"
+
+/*
+  Writes a backup directory that myloader restores as if mydumper had
+  written it, without a server. Each table has an id primary key and the
+  columns of --columns, and its rows are the --bench-rows rows generated
+  for the table repeated as many times as needed. The data files are split
+  every --rows-per-file rows, like --rows does, and the statements every
+  --statement-size bytes.
+*/
+
+extern FILE * (*m_open)(const char *filename, const char *);
+extern int compress_output;
+extern gchar *set_names_str;
+extern gchar *statement_terminated_by;
+extern guint statement_size;
+
+void initialize_sql_statement(GString *statement);
+void append_insert(gboolean condition, GString *statement, char *table, MYSQL_FIELD *fields, guint num_fields);
+void write_row_into_string(MYSQL *conn, struct db_table *dbt, MYSQL_ROW row, MYSQL_FIELD *fields, gulong *lengths, guint num_fields, GString *escaped, GString *statement_row);
+
+static gchar *generate_database=NULL;
+static gint generate_tables=10;
+static gint64 generate_table_rows=100000;
+static gint64 generate_rows_per_file=0;
+
+static GOptionEntry generate_entries[] = {
+    {"outputdir", 'o', 0, G_OPTION_ARG_FILENAME, &output_directory_param,
+     "Directory to write the backup to, it must not exist", NULL},
+    {"database", 'B', 0, G_OPTION_ARG_STRING, &generate_database,
+     "Database to generate, default bench", NULL},
+    {"tables", 0, 0, G_OPTION_ARG_INT, &generate_tables,
+     "Number of tables, default 10", NULL},
+    {"table-rows", 0, 0, G_OPTION_ARG_INT64, &generate_table_rows,
+     "Rows of each table, default 100000", NULL},
+    {"rows-per-file", 'r', 0, G_OPTION_ARG_INT64, &generate_rows_per_file,
+     "Split the data of a table in files of this many rows, default 0 is one file per table", NULL},
+    {"statement-size", 's', 0, G_OPTION_ARG_INT, &statement_size,
+     "Attempted size of INSERT statement in bytes, default 1000000", NULL},
+    {"compress", 'c', 0, G_OPTION_ARG_NONE, &compress_output,
+     "Compress output files", NULL},
+    {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
+
+struct generated_table {
+  struct db_table dbt;
+  struct bench_rows *br;
+  MYSQL_FIELD *fields;
+  guint num_fields;
+  MYSQL_ROW row;
+  gulong *lengths;
+  gchar id[24];
+};
+
+static void write_small_file(const gchar *filename, GString *content){
+  FILE *file=m_open(filename, "w");
+  if (file == NULL){
+    g_critical("Could not create output file %s (%d)", filename, errno);
+    exit(EXIT_FAILURE);
+  }
+  if (!write_data(file, content)){
+    g_critical("Could not write %s", filename);
+    exit(EXIT_FAILURE);
+  }
+  m_close(file);
+}
+
+static const gchar *column_definition(MYSQL_FIELD *field, gulong width){
+  static gchar definition[64];
+  switch (field->type){
+    case MYSQL_TYPE_LONG:
+      return "int DEFAULT NULL";
+    case MYSQL_TYPE_LONGLONG:
+      return "bigint unsigned DEFAULT NULL";
+    case MYSQL_TYPE_NEWDECIMAL:
+      return "decimal(10,2) DEFAULT NULL";
+    case MYSQL_TYPE_NULL:
+      return "varchar(16) DEFAULT NULL";
+    case MYSQL_TYPE_VAR_STRING:
+      g_snprintf(definition, sizeof(definition), "varchar(%lu) DEFAULT NULL", width);
+      return definition;
+    default:
+      return width < 65536 ? "text" : "mediumtext";
+  }
+}
+
+static void write_schema_create(const gchar *database){
+  gchar *filename=build_schema_filename(database, "schema-create");
+  GString *statement=g_string_new(NULL);
+  g_string_printf(statement, "CREATE DATABASE /*!32312 IF NOT EXISTS*/ `%s` /*!40100 DEFAULT CHARACTER SET utf8mb4 */;\n", database);
+  write_small_file(filename, statement);
+  manifest_append_file(filename, "schema-create");
+  g_string_free(statement, TRUE);
+  g_free(filename);
+}
+
+static void write_table_schema(struct generated_table *gt){
+  gchar *filename=build_schema_table_filename(gt->dbt.database->filename, gt->dbt.table_filename, "schema");
+  GString *statement=g_string_new(NULL);
+  guint f;
+  initialize_sql_statement(statement);
+  g_string_append_printf(statement, "CREATE TABLE `%s` (\n  `id` bigint NOT NULL,\n", gt->dbt.table);
+  for (f=1; f < gt->num_fields; f++)
+    g_string_append_printf(statement, "  `%s` %s,\n", gt->fields[f].name,
+                           column_definition(&(gt->fields[f]), gt->br->num_rows > 0 ? gt->br->lengths[0][f - 1] : 0));
+  g_string_append(statement, "  PRIMARY KEY (`id`)\n) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4;\n");
+  write_small_file(filename, statement);
+  manifest_append_file(filename, "schema");
+  g_string_free(statement, TRUE);
+  g_free(filename);
+}
+
+static void write_table_metadata(struct generated_table *gt){
+  gchar *filename=build_meta_filename(gt->dbt.database->filename, gt->dbt.table_filename, "metadata");
+  FILE *table_meta=g_fopen(filename, "w");
+  if (!table_meta){
+    g_critical("Couldn't write table metadata file %s (%d)", filename, errno);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(table_meta, "%" G_GINT64_FORMAT, generate_table_rows);
+  fclose(table_meta);
+  manifest_append(filename, "metadata", gt->dbt.database->filename, gt->dbt.table_filename, 0, 0, generate_table_rows, manifest_file_checksum(filename), NULL);
+  g_free(filename);
+}
+
+// The row number goes to the id, the rest of the columns are the ones of
+// the generated rows
+static void next_row(struct generated_table *gt, guint64 n){
+  guint r=n % gt->br->num_rows, f;
+  gt->lengths[0]=g_snprintf(gt->id, sizeof(gt->id), "%" G_GUINT64_FORMAT, n + 1);
+  gt->row[0]=gt->id;
+  for (f=1; f < gt->num_fields; f++){
+    gt->row[f]=gt->br->values[r][f - 1];
+    gt->lengths[f]=gt->br->lengths[r][f - 1];
+  }
+}
+
+// The same layout that write_table_data_into_file writes: the header, then
+// statements of up to statement_size bytes
+static void write_data_file(MYSQL *conn, struct generated_table *gt, guint part, guint64 first_row, guint64 rows,
+                            GString *statement, GString *statement_row, GString *escaped){
+  gchar *filename=build_data_filename(gt->dbt.database->filename, gt->dbt.table_filename, part, 0);
+  FILE *file=m_open(filename, "w");
+  uLong crc=crc32(0L, Z_NULL, 0);
+  guint64 n, rows_in_statement=0;
+  if (file == NULL){
+    g_critical("Could not create output file %s (%d)", filename, errno);
+    exit(EXIT_FAILURE);
+  }
+  g_string_set_size(statement, 0);
+  initialize_sql_statement(statement);
+  for (n=first_row; n < first_row + rows; n++){
+    if (rows_in_statement == 0){
+      g_string_set_size(statement_row, 0);
+      append_insert(FALSE, statement_row, gt->dbt.table, gt->fields, gt->num_fields);
+      g_string_append(statement, statement_row->str);
+    }
+    next_row(gt, n);
+    g_string_set_size(statement_row, 0);
+    write_row_into_string(conn, &(gt->dbt), gt->row, gt->fields, gt->lengths, gt->num_fields, escaped, statement_row);
+    if (rows_in_statement > 0)
+      g_string_append_c(statement, ',');
+    g_string_append_len(statement, statement_row->str, statement_row->len);
+    rows_in_statement++;
+    if (statement->len + statement_row->len + 1 > statement_size || n + 1 == first_row + rows){
+      g_string_append(statement, statement_terminated_by);
+      if (!write_data(file, statement)){
+        g_critical("Could not write %s", filename);
+        exit(EXIT_FAILURE);
+      }
+      crc=crc32(crc, (const Bytef *)statement->str, statement->len);
+      g_string_set_size(statement, 0);
+      rows_in_statement=0;
+    }
+  }
+  m_close(file);
+  manifest_append(filename, "data", gt->dbt.database->filename, gt->dbt.table_filename, part, 0, rows, crc, NULL);
+  g_free(filename);
+}
+
+static struct generated_table *new_generated_table(struct database *database, guint t){
+  struct generated_table *gt=g_new0(struct generated_table, 1);
+  guint f;
+  gt->dbt.database=database;
+  gt->dbt.table=g_strdup_printf("%s_%05u", database->name, t);
+  gt->dbt.table_filename=gt->dbt.table;
+  gt->dbt.escaped_table=gt->dbt.table;
+  gt->br=bench_rows_new(bench_columns, bench_num_rows, bench_escape_density, t + 1);
+  gt->num_fields=gt->br->num_fields + 1;
+  gt->fields=g_new0(MYSQL_FIELD, gt->num_fields);
+  gt->fields[0].name=g_strdup("id");
+  gt->fields[0].type=MYSQL_TYPE_LONGLONG;
+  gt->fields[0].flags=NUM_FLAG;
+  for (f=1; f < gt->num_fields; f++){
+    gt->fields[f]=gt->br->fields[f - 1];
+    gt->fields[f].name=g_strdup_printf("c%u", f);
+  }
+  gt->row=g_new0(gchar *, gt->num_fields);
+  gt->lengths=g_new0(gulong, gt->num_fields);
+  return gt;
+}
+
+static void free_generated_table(struct generated_table *gt){
+  guint f;
+  for (f=0; f < gt->num_fields; f++)
+    g_free(gt->fields[f].name);
+  g_free(gt->fields);
+  g_free(gt->row);
+  g_free(gt->lengths);
+  g_free(gt->dbt.table);
+  bench_rows_free(gt->br);
+  g_free(gt);
+}
+
+static void write_global_metadata(const gchar *filename, const gchar *label){
+  FILE *mdfile=g_fopen(filename, "a");
+  GDateTime *datetime=g_date_time_new_now_local();
+  gchar *datetimestr=g_date_time_format(datetime, "\%Y-\%m-\%d \%H:\%M:\%S");
+  if (!mdfile){
+    g_critical("Couldn't write metadata file %s (%d)", filename, errno);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(mdfile, "%s dump at: %s\n", label, datetimestr);
+  fclose(mdfile);
+  g_free(datetimestr);
+  g_date_time_unref(datetime);
+}
+
+int main(int argc, char *argv[]){
+  struct database database;
+  struct generated_table *gt=NULL;
+  MYSQL *conn=NULL;
+  GString *statement=NULL, *statement_row=NULL, *escaped=NULL;
+  gchar *metadata_partial_filename=NULL, *metadata_filename=NULL, *manifest_filename=NULL;
+  guint64 rows_per_file, first_row;
+  guint t, part;
+  GTimer *timer=NULL;
+  bench_parse_options(argc, argv, "- writes a synthetic mydumper backup", generate_entries);
+  if (output_directory_param == NULL){
+    g_print("--outputdir is required\n");
+    exit(EXIT_FAILURE);
+  }
+  if (g_file_test(output_directory_param, G_FILE_TEST_EXISTS)){
+    g_print("%s already exists\n", output_directory_param);
+    exit(EXIT_FAILURE);
+  }
+  if (strstr(bench_columns, "json") != NULL){
+    g_print("json columns are not supported, their values would not be valid JSON\n");
+    exit(EXIT_FAILURE);
+  }
+  if (generate_tables <= 0 || generate_table_rows < 0 || generate_rows_per_file < 0){
+    g_print("--tables must be bigger than 0, --table-rows and --rows-per-file can not be negative\n");
+    exit(EXIT_FAILURE);
+  }
+  if (generate_database == NULL)
+    generate_database=g_strdup("bench");
+  dump_directory=output_directory_param;
+  if (g_mkdir_with_parents(dump_directory, 0750) != 0){
+    g_critical("Couldn't create %s (%d)", dump_directory, errno);
+    exit(EXIT_FAILURE);
+  }
+  detected_server=SERVER_TYPE_MYSQL;
+  set_names_str=g_strdup("/*!40101 SET NAMES binary*/");
+  initialize_working_thread();
+  initialize_manifest(dump_directory);
+  // mysql_real_escape_string only needs the character set of the handle
+  conn=mysql_init(NULL);
+  statement=g_string_sized_new(statement_size + 1024);
+  statement_row=g_string_sized_new(1024);
+  escaped=g_string_sized_new(3000);
+  timer=g_timer_new();
+
+  metadata_partial_filename=g_strdup_printf("%s/metadata.partial", dump_directory);
+  metadata_filename=g_strndup(metadata_partial_filename, strlen(metadata_partial_filename) - 8);
+  write_global_metadata(metadata_partial_filename, "Started");
+
+  memset(&database, 0, sizeof(database));
+  database.name=generate_database;
+  database.filename=generate_database;
+  write_schema_create(generate_database);
+  rows_per_file=generate_rows_per_file > 0 ? (guint64)generate_rows_per_file : (guint64)MAX(generate_table_rows, 1);
+  for (t=1; t <= (guint)generate_tables; t++){
+    gt=new_generated_table(&database, t);
+    write_table_schema(gt);
+    for (first_row=0, part=0; first_row < (guint64)generate_table_rows; first_row+=rows_per_file, part++)
+      write_data_file(conn, gt, part, first_row, MIN(rows_per_file, generate_table_rows - first_row), statement, statement_row, escaped);
+    write_table_metadata(gt);
+    free_generated_table(gt);
+  }
+
+  write_global_metadata(metadata_partial_filename, "Finished");
+  manifest_filename=finish_manifest();
+  g_rename(metadata_partial_filename, metadata_filename);
+  g_print("%d tables of %" G_GINT64_FORMAT " rows written to %s in %.1f seconds\n", generate_tables,
+          generate_table_rows, dump_directory, g_timer_elapsed(timer, NULL));
+
+  g_timer_destroy(timer);
+  g_free(manifest_filename);
+  g_free(metadata_partial_filename);
+  g_free(metadata_filename);
+  g_string_free(statement, TRUE);
+  g_string_free(statement_row, TRUE);
+  g_string_free(escaped, TRUE);
+  mysql_close(conn);
+  return EXIT_SUCCESS;
+}
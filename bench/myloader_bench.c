@@ -0,0 +1,144 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+// myloader.c is compiled here, without its main, so the benchmarks link
+// with the same globals and functions that myloader uses
+#define main myloader_main
+#include "../src/myloader.c"
+#undef main
+
+#include "bench.h"
+
+int split_and_restore_data_in_gstring_by_statement(struct thread_data *td, GString *data, gboolean is_schema, guint *query_counter, guint offset_line);
+
+struct read_bench {
+  gchar *filename;
+  gboolean is_compressed;
+  guint64 bytes;
+};
+
+struct split_bench {
+  gchar **statements;
+  guint64 bytes;
+};
+
+static guint64 bench_read_data(gpointer data){
+  struct read_bench *rb=data;
+  FILE *infile=NULL;
+  gboolean is_compressed=FALSE, eof=FALSE;
+  GString *line_data=g_string_sized_new(256);
+  guint line=0;
+  ml_open(&infile, rb->filename, &is_compressed);
+  if (infile == NULL || is_compressed != rb->is_compressed){
+    g_print("Could not open %s\n", rb->filename);
+    exit(EXIT_FAILURE);
+  }
+  while (!eof){
+    if (!read_data(infile, is_compressed, line_data, &eof, &line)){
+      g_print("Could not read %s\n", rb->filename);
+      exit(EXIT_FAILURE);
+    }
+    g_string_set_size(line_data, 0);
+  }
+  if (is_compressed)
+    gzclose((gzFile)infile);
+  else
+    fclose(infile);
+  g_string_free(line_data, TRUE);
+  return rb->bytes;
+}
+
+// The statements are skipped as on --resume, so only the split is measured
+static guint64 bench_split(gpointer data){
+  struct split_bench *sb=data;
+  struct thread_data td;
+  GString *statement=g_string_sized_new(256);
+  guint query_counter=0, i;
+  memset(&td, 0, sizeof(td));
+  td.statements_to_skip=G_MAXUINT64;
+  for (i=0; sb->statements[i] != NULL; i++){
+    if (sb->statements[i][0] == '\0')
+      continue;
+    g_string_assign(statement, sb->statements[i]);
+    g_string_append(statement, ";\n");
+    split_and_restore_data_in_gstring_by_statement(&td, statement, FALSE, &query_counter, 1);
+  }
+  g_string_free(statement, TRUE);
+  return sb->bytes;
+}
+
+static void write_file_content(const gchar *filename, GString *content, gboolean compressed){
+  FILE *file=compressed ? (void *)gzopen(filename, "w") : g_fopen(filename, "w");
+  if (file == NULL){
+    g_print("Could not open %s\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  if (compressed){
+    gzwrite((gzFile)file, content->str, content->len);
+    gzclose((gzFile)file);
+  }else{
+    fwrite(content->str, 1, content->len, file);
+    fclose(file);
+  }
+}
+
+int main(int argc, char *argv[]){
+  struct bench_rows *br=NULL;
+  struct read_bench rb;
+  struct split_bench sb;
+  GString *content=NULL;
+  gchar *dir=NULL, *name=NULL;
+  bench_parse_options(argc, argv, "- myloader microbenchmarks", NULL);
+  br=bench_rows_new(bench_columns, bench_num_rows, bench_escape_density, 1);
+  // Statements of 1000 rows and batches of 100 rows with --rows
+  content=bench_insert_statements(br, 1000);
+  rows=100;
+  g_print("%u rows of %s, %.1f MB of INSERT statements, escape density %.3f\n", br->num_rows, bench_columns,
+          (gdouble)content->len / 1024 / 1024, bench_escape_density);
+
+  dir=bench_tmp_dir();
+  rb.bytes=content->len;
+  rb.filename=g_build_filename(dir, "bench.00000.sql", NULL);
+  rb.is_compressed=FALSE;
+  compress_extension=g_strdup(".gz");
+  write_file_content(rb.filename, content, FALSE);
+  bench_run("read_data", bench_read_data, &rb, br->num_rows);
+  g_remove(rb.filename);
+  g_free(rb.filename);
+#ifdef ZWRAP_USE_ZSTD
+  compress_extension=g_strdup(".zst");
+#endif
+  rb.filename=g_strdup_printf("%s/bench.00000.sql%s", dir, compress_extension);
+  rb.is_compressed=TRUE;
+  write_file_content(rb.filename, content, TRUE);
+  name=g_strdup_printf("read_data %s", compress_extension + 1);
+  bench_run(name, bench_read_data, &rb, br->num_rows);
+  g_free(name);
+  g_remove(rb.filename);
+  g_free(rb.filename);
+  g_rmdir(dir);
+  g_free(dir);
+
+  sb.statements=g_strsplit(content->str, ";\n", 0);
+  sb.bytes=content->len;
+  bench_run("split_and_restore_data_in_gstring", bench_split, &sb, br->num_rows);
+  g_strfreev(sb.statements);
+
+  g_string_free(content, TRUE);
+  bench_rows_free(br);
+  return EXIT_SUCCESS;
+}
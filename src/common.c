@@ -22,6 +22,7 @@
 #include <glib/gstdio.h>
 #include "server_detect.h"
 #include "common.h"
+#include "query_profile.h"
 extern gboolean no_delete;
 extern gboolean stream;
 extern gchar *defaults_file;
@@ -45,7 +46,7 @@ char *generic_checksum(MYSQL *conn, char *database, char *table, int *errn,const
   MYSQL_ROW row;
   *errn=0;
   char *query = g_strdup_printf(query_template, database, table);
-  if (mysql_query(conn, query) || !(result = mysql_use_result(conn))) {
+  if (profiled_query(conn, query) || !(result = mysql_use_result(conn))) {
     g_critical("Error dumping checksum (%s.%s): %s", database, table, mysql_error(conn));
     *errn=mysql_errno(conn);
     g_free(query);
@@ -147,7 +148,7 @@ void load_session_hash_from_key_file(GKeyFile *kf, GHashTable * set_session_hash
       g_hash_table_insert(set_session_hash, keys[i], value);
   }
 }
-void load_where_per_table_and_anonymized_functions_from_key_file(GKeyFile *kf, GHashTable *all_where_per_table, GHashTable *all_anonymized_function, fun_ptr get_function_pointer_for()){
+void load_where_per_table_and_anonymized_functions_from_key_file(GKeyFile *kf, GHashTable *all_where_per_table, GHashTable *all_anonymized_function, fun_ptr compile_functions){
   gsize len=0,len2=0;
   gchar **groups=g_key_file_get_groups(kf,&len);
   GHashTable *ht=NULL;
@@ -162,7 +163,7 @@ void load_where_per_table_and_anonymized_functions_from_key_file(GKeyFile *kf, G
       for (j=0; j < len2; j++){
         if (g_str_has_prefix(keys[j],"`") && g_str_has_suffix(keys[j],"`")){
           value = g_key_file_get_value(kf,groups[i],keys[j],&error);
-          g_hash_table_insert(ht,g_strdup(keys[j]),get_function_pointer_for(value));
+          g_hash_table_insert(ht,g_strdup(keys[j]),compile_functions(value));
         }else{
           if (g_strcmp0(keys[j],"where") == 0){
             value = g_key_file_get_value(kf,groups[i],keys[j],&error);
@@ -211,7 +212,7 @@ void execute_gstring(MYSQL *conn, GString *ss)
     gchar** line=g_strsplit(ss->str, ";\n", -1);
     int i=0;
     for (i=0; i < (int)g_strv_length(line);i++){
-       if (strlen(line[i]) > 3 && mysql_query(conn, line[i])){
+       if (strlen(line[i]) > 3 && profiled_query(conn, line[i])){
          g_warning("Set session failed: %s",line[i]);
        }
     }
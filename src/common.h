@@ -19,7 +19,7 @@
 #define _src_common_h
 
 #define STREAM_BUFFER_SIZE 1000000
-typedef gchar * (*fun_ptr)(gchar **);
+typedef gpointer (*fun_ptr)(gchar *);
 
 char * checksum_table_structure(MYSQL *conn, char *database, char *table, int *errn);
 char * checksum_table(MYSQL *conn, char *database, char *table, int *errn);
@@ -36,8 +36,7 @@ void load_config_group(GKeyFile *kf, GOptionContext *context, const gchar * grou
 void execute_gstring(MYSQL *conn, GString *ss);
 gchar *replace_escaped_strings(gchar *c);
 void load_session_hash_from_key_file(GKeyFile *kf, GHashTable * set_session_hash, const gchar * group_variables);
-//void load_anonymized_functions_from_key_file(GKeyFile *kf, GHashTable *all_anonymized_function, fun_ptr get_function_pointer_for());
-void load_where_per_table_and_anonymized_functions_from_key_file(GKeyFile *kf, GHashTable *all_where_per_table, GHashTable *all_anonymized_function, fun_ptr get_function_pointer_for());
+void load_where_per_table_and_anonymized_functions_from_key_file(GKeyFile *kf, GHashTable *all_where_per_table, GHashTable *all_anonymized_function, fun_ptr compile_functions);
 void refresh_set_session_from_hash(GString *ss, GHashTable * set_session_hash);
 gboolean is_table_in_list(gchar *table_name, gchar **table_list);
 GHashTable * initialize_hash_of_session_variables();
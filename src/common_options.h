@@ -42,6 +42,8 @@ gboolean program_version = FALSE;
 
 gchar *tables_list = NULL;
 gchar *tables_skiplist_file = NULL;
+gchar *trace_filename = NULL;
+guint profile_queries = 0;
 char **tables = NULL;
 
 GOptionEntry common_entries[] = {
@@ -83,6 +85,10 @@ GOptionEntry common_entries[] = {
     {"tables-list", 'T', 0, G_OPTION_ARG_STRING, &tables_list,
      "Comma delimited table list to dump (does not exclude regex option)",
      NULL},
+    {"trace-file", 0, 0, G_OPTION_ARG_FILENAME, &trace_filename,
+     "Write the jobs and phases of the run to this file, in Chrome trace event format", NULL},
+    {"profile-queries", 0, 0, G_OPTION_ARG_INT, &profile_queries,
+     "Print the N statements, by fingerprint, that took more time at the end. Default 0, disabled", NULL},
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
 
 int (*m_close)(void *file) = NULL;
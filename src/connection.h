@@ -20,7 +20,7 @@
 
 
 
-//void configure_connection(MYSQL *conn, const char *name);
+void configure_connection(MYSQL *conn, const char *name);
 void m_connect(MYSQL *conn, const gchar *app, gchar *schema);
 void hide_password(int argc, char *argv[]);
 void ask_password();
@@ -0,0 +1,38 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <glib.h>
+#include "metrics.h"
+
+const gdouble metrics_buckets[METRICS_BUCKETS]={0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+
+// Appends name="value", a label of the text format of Prometheus, where a
+// backslash, a double quote or a new line in a name would break the file
+void append_label(GString *content, const gchar *name, const gchar *value){
+  const gchar *p=NULL;
+  g_string_append_printf(content, "%s=\"", name);
+  for (p=value; *p != '\0'; p++){
+    if (*p == '\\' || *p == '"'){
+      g_string_append_c(content, '\\');
+      g_string_append_c(content, *p);
+    }else if (*p == '\n')
+      g_string_append(content, "\\n");
+    else
+      g_string_append_c(content, *p);
+  }
+  g_string_append_c(content, '"');
+}
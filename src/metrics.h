@@ -0,0 +1,32 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_metrics_h
+#define _src_metrics_h
+#include <glib.h>
+
+/* The counters of the metrics and of the stages are only read by the PMM
+ * thread, so they are added and read with relaxed atomics */
+#define METRIC_ADD(counter, n) __atomic_add_fetch(&(counter), (n), __ATOMIC_RELAXED)
+#define METRIC_GET(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#define METRICS_BUCKETS 11
+#define METRICS_RATE_WEIGHT 0.3
+
+extern const gdouble metrics_buckets[METRICS_BUCKETS];
+
+void append_label(GString *content, const gchar *name, const gchar *value);
+#endif
@@ -41,6 +41,7 @@
 #include "regex.h"
 #include "mydumper_start_dump.h"
 #include "mydumper_daemon_thread.h"
+#include "query_profile.h"
 const char DIRECTORY[] = "export";
 
 /* Some earlier versions of MySQL do not yet define MYSQL_TYPE_JSON */
@@ -61,6 +62,7 @@ gboolean no_stream = FALSE;
 gboolean shutdown_triggered = FALSE;
 
 guint errors;
+extern gboolean resume;
 
 gboolean arguments_callback(const gchar *option_name,const gchar *value, gpointer data, GError **error){
   *error=NULL;
@@ -185,6 +187,7 @@ int main(int argc, char *argv[]) {
   g_message("MyDumper backup version: %s", VERSION);
 
   initialize_regex();
+  initialize_query_profile(profile_queries);
   time_t t;
   time(&t);
   localtime_r(&t, &tval);
@@ -198,6 +201,10 @@ int main(int argc, char *argv[]) {
   }else{
     output_directory=output_directory_param;
   }
+  if (resume && !output_directory_param){
+    g_critical("--resume needs --outputdir with the directory of the interrupted dump");
+    exit(EXIT_FAILURE);
+  }
   create_backup_dir(output_directory);
   if (daemon_mode) {
     initialize_daemon_thread();
@@ -219,6 +226,7 @@ int main(int argc, char *argv[]) {
     start_dump();
   }
 
+  print_query_profile();
   g_free(output_directory);
   g_strfreev(tables);
 
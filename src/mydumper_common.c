@@ -25,6 +25,7 @@
 #include <glib/gstdio.h>
 #include <gio/gio.h>
 #include "regex.h"
+#include "query_profile.h"
 #include <errno.h>
 
 extern gchar *compress_extension;
@@ -155,7 +156,7 @@ void clear_dump_directory(gchar *directory) {
 }
 
 void set_transaction_isolation_level_repeatable_read(MYSQL *conn){
-  if (mysql_query(conn,
+  if (profiled_query(conn,
                   "SET SESSION TRANSACTION ISOLATION LEVEL REPEATABLE READ")) {
     g_critical("Failed to set isolation level: %s", mysql_error(conn));
     exit(EXIT_FAILURE);
@@ -33,6 +33,7 @@ struct database * new_database(MYSQL *conn, char *database_name, gboolean alread
   d->escaped = escape_string(conn,d->name);
   d->already_dumped = already_dumped;
   d->ad_mutex=g_mutex_new();
+  d->table_status=NULL;
   g_hash_table_insert(database_hash, d->name,d);
   return d;
 }
@@ -21,6 +21,8 @@ struct database {
   char *escaped;
   GMutex *ad_mutex;
   gboolean already_dumped;
+  // Rows listed by prefetch_table_status, NULL until then
+  GPtrArray *table_status;
 };
 
 void initialize_database();
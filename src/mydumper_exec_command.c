@@ -33,48 +33,168 @@ extern FILE * (*m_open)(const char *filename, const char *);
 extern gchar *compress_extension;
 extern GAsyncQueue *stream_queue;
 extern gboolean no_delete;
+extern guint num_threads;
+extern gboolean less_locking;
+extern guint errors;
 
-GThread *exec_command_thread = NULL;
 extern gchar *exec_command;
+extern guint exec_threads;
+extern guint exec_retries;
+extern guint exec_queue_size;
+
+GThread **exec_command_threads = NULL;
+GThread *exec_monitor_thread = NULL;
+static gchar **exec_arguments = NULL;
+static GAsyncQueue *exec_pause_resume = NULL;
+static gint exec_failures = 0;
+static gint exec_finished = 0;
+
+static int run_exec_command(gchar *filename){
+  gchar **c_arg=g_strdupv(exec_arguments);
+  guint i=0;
+  for(i=0; i<g_strv_length(c_arg); i++){
+    if (g_strcmp0(c_arg[i],"FILENAME") == 0){
+      g_free(c_arg[i]);
+      c_arg[i]=g_strdup(filename);
+    }
+  }
+  int status=0;
+  pid_t childpid=vfork();
+  if (childpid == 0){
+    execv(c_arg[0],c_arg);
+    _exit(127);
+  }
+  g_strfreev(c_arg);
+  if (childpid < 0){
+    g_critical("Could not fork to execute command on %s", filename);
+    return -1;
+  }
+  if (waitpid(childpid, &status, 0) < 0){
+    g_critical("Could not wait command on %s", filename);
+    return -1;
+  }
+  if (!WIFEXITED(status))
+    return -1;
+  return WEXITSTATUS(status);
+}
 
 void *process_exec_command(void *data){
-  (void)data;
-  gchar *space=g_strstr_len(exec_command,-1," ");
-  guint len = strlen(exec_command) - strlen(space);
+  guint thread_id=GPOINTER_TO_UINT(data);
   char * filename=NULL;
-  char * bin=g_strndup(exec_command,len);
-  gchar ** arguments=g_strsplit(space," ", 0);
-  gchar ** volatile c_arg=NULL;
-  guint i=0;
+  guint retry=0;
+  int status=0;
   for(;;){
     filename=(char *)g_async_queue_pop(stream_queue);
     if (strlen(filename) == 0){
+      // Let the other exec threads know that we are done
+      g_async_queue_push(stream_queue, filename);
       break;
     }
-    char *used_filemame=g_path_get_basename(filename);
-    g_strfreev(c_arg);
-    c_arg=g_strdupv(arguments);
-    for(i=0; i<g_strv_length(c_arg); i++){
-      if (g_strcmp0(c_arg[i],"FILENAME") == 0)
-        c_arg[i]=filename;
+    status=run_exec_command(filename);
+    for (retry=0; status != 0 && retry < exec_retries; retry++){
+      g_warning("Exec thread %d: command on %s returned %d, retrying (%d of %d)", thread_id, filename, status, retry + 1, exec_retries);
+      status=run_exec_command(filename);
     }
-    int childpid=vfork();
-    if(!childpid)
-      i=execv(bin,c_arg);
-    wait(&childpid);
-    free(used_filemame);
-    if (no_delete == FALSE)
+    if (status != 0){
+      g_critical("Exec thread %d: command on %s failed with status %d. File was not removed", thread_id, filename, status);
+      g_atomic_int_inc(&exec_failures);
+    }else if (no_delete == FALSE)
       remove(filename);
+    g_free(filename);
   }
   return NULL;
 }
 
-void initialize_exec_command(){
-  g_message("Initializing Execcommand");
+// The mutexes that no thread took yet are removed from the queue, which is
+// shared with the other monitors, so they are not pushed twice on the next
+// pause. Then the threads that are waiting on them are released
+static void resume_working_threads(GMutex **pause_mutex_per_thread, guint n){
+  GPtrArray *others=g_ptr_array_new();
+  GMutex *m=NULL;
+  guint i=0, j=0;
+  while ((m=g_async_queue_try_pop(exec_pause_resume)) != NULL){
+    for (j=0; j<n && pause_mutex_per_thread[j] != m; j++);
+    if (j == n)
+      g_ptr_array_add(others, m);
+  }
+  for (i=0; i<others->len; i++)
+    g_async_queue_push(exec_pause_resume, g_ptr_array_index(others, i));
+  g_ptr_array_free(others, TRUE);
+  for(i=0;i<n;i++){
+    g_mutex_unlock(pause_mutex_per_thread[i]);
+  }
+}
+
+// When the exec threads can not keep up with the files that are being
+// written, we pause the working threads until the pending list gets shorter
+void *monitor_exec_command_queue(void *data){
+  (void)data;
+  guint i=0;
+  guint n=num_threads * (less_locking + 1);
+  GMutex **pause_mutex_per_thread=g_new(GMutex * , n) ;
+  for(i=0;i<n;i++){
+    pause_mutex_per_thread[i]=g_mutex_new();
+  }
+  gboolean paused = FALSE;
+  gint pending=0;
+  while (!g_atomic_int_get(&exec_finished)){
+    pending=g_async_queue_length(stream_queue);
+    if (!paused && pending >= (gint)exec_queue_size){
+      g_message("Pausing working threads, %d files are waiting to be executed", pending);
+      for(i=0;i<n;i++){
+        g_mutex_lock(pause_mutex_per_thread[i]);
+        g_async_queue_push(exec_pause_resume,pause_mutex_per_thread[i]);
+      }
+      paused = TRUE;
+    }else if (paused && pending <= (gint)exec_queue_size / 2){
+      g_message("Resuming working threads, %d files are waiting to be executed", pending);
+      resume_working_threads(pause_mutex_per_thread, n);
+      paused = FALSE;
+    }
+    g_usleep(100000);
+  }
+  if (paused)
+    resume_working_threads(pause_mutex_per_thread, n);
+  // The working threads are done at this point
+  for(i=0;i<n;i++){
+    g_mutex_free(pause_mutex_per_thread[i]);
+  }
+  g_free(pause_mutex_per_thread);
+  return NULL;
+}
+
+void initialize_exec_command(GAsyncQueue *pause_resume){
+  guint n=0;
+  exec_arguments=g_strsplit(exec_command," ", 0);
+  // The commands usually compress or upload the files, which is as much
+  // work as writing them, so we run as many as working threads by default
+  if (exec_threads == 0)
+    exec_threads = num_threads > 0 ? num_threads : 1;
+  if (exec_queue_size == 0)
+    exec_queue_size = exec_threads * 4;
+  g_message("Initializing Execcommand with %d threads", exec_threads);
   stream_queue = g_async_queue_new();
-  exec_command_thread = g_thread_create((GThreadFunc)process_exec_command, stream_queue, TRUE, NULL);
+  exec_pause_resume = pause_resume;
+  exec_command_threads = g_new(GThread *, exec_threads);
+  for (n = 0; n < exec_threads; n++)
+    exec_command_threads[n] = g_thread_create((GThreadFunc)process_exec_command, GUINT_TO_POINTER(n), TRUE, NULL);
+  if (exec_pause_resume != NULL)
+    exec_monitor_thread = g_thread_create((GThreadFunc)monitor_exec_command_queue, NULL, TRUE, NULL);
 }
 
 void wait_exec_command_to_finish(){
-  g_thread_join(exec_command_thread);
+  guint n=0;
+  for (n = 0; n < exec_threads; n++)
+    g_thread_join(exec_command_threads[n]);
+  // The empty filename that stopped the threads is still in the queue
+  g_free(g_async_queue_try_pop(stream_queue));
+  g_atomic_int_set(&exec_finished, 1);
+  if (exec_monitor_thread != NULL)
+    g_thread_join(exec_monitor_thread);
+  if (exec_failures > 0){
+    g_critical("%d files failed to be processed by the exec command", exec_failures);
+    errors+=exec_failures;
+  }
+  g_free(exec_command_threads);
+  g_strfreev(exec_arguments);
 }
@@ -16,6 +16,6 @@
 */
 
 
-void initialize_exec_command();
+void initialize_exec_command(GAsyncQueue *pause_resume);
 void wait_exec_command_to_finish();
 //void *process_stream(void *data);
@@ -33,6 +33,8 @@
 #include "mydumper_common.h"
 #include "mydumper_jobs.h"
 #include "mydumper_database.h"
+#include "mydumper_manifest.h"
+#include "query_profile.h"
 extern gchar *where_option;
 extern gboolean success_on_1146;
 extern int detected_server;
@@ -104,6 +106,7 @@ void write_checksum_into_file(MYSQL *conn, char *database, char *table, char *fi
   fprintf(outfile, "%s", checksum);
   fclose(outfile);
 
+  manifest_append_file(filename, "checksum");
   if (stream) g_async_queue_push(stream_queue, g_strdup(filename));
   g_free(checksum);
 
@@ -120,6 +123,7 @@ void write_table_metadata_into_file(struct db_table * dbt){
   }
   fprintf(table_meta, "%d", dbt->rows);
   fclose(table_meta);
+  manifest_append(filename, "metadata", dbt->database->filename, dbt->table_filename, 0, 0, dbt->rows, manifest_file_checksum(filename), NULL);
   if (stream) g_async_queue_push(stream_queue, g_strdup(filename));
 }
 
@@ -150,7 +154,7 @@ void write_tablespace_definition_into_file(MYSQL *conn,char *filename){
     g_warning("Tablespace resquested, but not possible due to server version not supported");
     return;
   }
-  if (mysql_query(conn, query) || !(result = mysql_use_result(conn))) {
+  if (profiled_query(conn, query) || !(result = mysql_use_result(conn))) {
     if (success_on_1146 && mysql_errno(conn) == 1146) {
       g_warning("Error dumping create tablespace: %s",
                 mysql_error(conn));
@@ -173,6 +177,8 @@ void write_tablespace_definition_into_file(MYSQL *conn,char *filename){
     }
     g_string_set_size(statement, 0);
   }
+  m_close(outfile);
+  manifest_append_file(filename, "tablespace");
 }
 
 void write_schema_definition_into_file(MYSQL *conn, char *database, char *filename, char *checksum_filename) {
@@ -193,7 +199,7 @@ void write_schema_definition_into_file(MYSQL *conn, char *database, char *filena
   GString *statement = g_string_sized_new(statement_size);
 
   query = g_strdup_printf("SHOW CREATE DATABASE IF NOT EXISTS `%s`", database);
-  if (mysql_query(conn, query) || !(result = mysql_use_result(conn))) {
+  if (profiled_query(conn, query) || !(result = mysql_use_result(conn))) {
     if (success_on_1146 && mysql_errno(conn) == 1146) {
       g_warning("Error dumping create database (%s): %s", database,
                 mysql_error(conn));
@@ -217,6 +223,7 @@ void write_schema_definition_into_file(MYSQL *conn, char *database, char *filena
   g_free(query);
 
   m_close(outfile);
+  manifest_append_file(filename, "schema-create");
   if (stream) g_async_queue_push(stream_queue, g_strdup(filename));
   g_string_free(statement, TRUE);
   if (result)
@@ -267,7 +274,7 @@ void write_table_definition_into_file(MYSQL *conn, char *database, char *table,
   }
 
   query = g_strdup_printf("SHOW CREATE TABLE `%s`.`%s`", database, table);
-  if (mysql_query(conn, query) || !(result = mysql_use_result(conn))) {
+  if (profiled_query(conn, query) || !(result = mysql_use_result(conn))) {
     if (success_on_1146 && mysql_errno(conn) == 1146) {
       g_warning("Error dumping schemas (%s.%s): %s", database, table,
                 mysql_error(conn));
@@ -293,6 +300,7 @@ void write_table_definition_into_file(MYSQL *conn, char *database, char *table,
   g_free(query);
 
   m_close(outfile);
+  manifest_append_file(filename, "schema");
   if (stream) g_async_queue_push(stream_queue, g_strdup(filename));
   g_string_free(statement, TRUE);
   if (result)
@@ -325,7 +333,7 @@ void write_triggers_definition_into_file(MYSQL *conn, char *database, char *tabl
 
   // get triggers
   query = g_strdup_printf("SHOW TRIGGERS FROM `%s` LIKE '%s'", database, table);
-  if (mysql_query(conn, query) || !(result = mysql_store_result(conn))) {
+  if (profiled_query(conn, query) || !(result = profiled_store_result(conn))) {
     if (success_on_1146 && mysql_errno(conn) == 1146) {
       g_warning("Error dumping triggers (%s.%s): %s", database, table,
                 mysql_error(conn));
@@ -347,8 +355,8 @@ void write_triggers_definition_into_file(MYSQL *conn, char *database, char *tabl
     }
     g_string_set_size(statement, 0);
     query = g_strdup_printf("SHOW CREATE TRIGGER `%s`.`%s`", database, row[0]);
-    mysql_query(conn, query);
-    result2 = mysql_store_result(conn);
+    profiled_query(conn, query);
+    result2 = profiled_store_result(conn);
     row2 = mysql_fetch_row(result2);
     g_string_append_printf(statement, "%s", row2[2]);
     splited_st = g_strsplit(statement->str, ";\n", 0);
@@ -364,6 +372,7 @@ void write_triggers_definition_into_file(MYSQL *conn, char *database, char *tabl
   }
   g_free(query);
   m_close(outfile);
+  manifest_append_file(filename, "schema-triggers");
   if (stream) g_async_queue_push(stream_queue, g_strdup(filename));
   g_string_free(statement, TRUE);
   g_strfreev(splited_st);
@@ -417,7 +426,7 @@ void write_view_definition_into_file(MYSQL *conn, char *database, char *table, c
   // we create tables as workaround
   // for view dependencies
   query = g_strdup_printf("SHOW FIELDS FROM `%s`.`%s`", database, table);
-  if (mysql_query(conn, query) || !(result = mysql_use_result(conn))) {
+  if (profiled_query(conn, query) || !(result = mysql_use_result(conn))) {
     if (success_on_1146 && mysql_errno(conn) == 1146) {
       g_warning("Error dumping schemas (%s.%s): %s", database, table,
                 mysql_error(conn));
@@ -450,7 +459,7 @@ void write_view_definition_into_file(MYSQL *conn, char *database, char *table, c
 
   // real view
   query = g_strdup_printf("SHOW CREATE VIEW `%s`.`%s`", database, table);
-  if (mysql_query(conn, query) || !(result = mysql_use_result(conn))) {
+  if (profiled_query(conn, query) || !(result = mysql_use_result(conn))) {
     if (success_on_1146 && mysql_errno(conn) == 1146) {
       g_warning("Error dumping schemas (%s.%s): %s", database, table,
                 mysql_error(conn));
@@ -476,9 +485,10 @@ void write_view_definition_into_file(MYSQL *conn, char *database, char *table, c
   }
   g_free(query);
   m_close(outfile);
-
+  manifest_append_file(filename, "schema");
   if (stream) g_async_queue_push(stream_queue, g_strdup(filename));
   m_close(outfile2);
+  manifest_append_file(filename2, "schema-view");
   if (stream) g_async_queue_push(stream_queue, g_strdup(filename2));
   g_string_free(statement, TRUE);
   if (result)
@@ -515,7 +525,7 @@ void write_routines_definition_into_file(MYSQL *conn, struct database *database,
   if (dump_routines) {
     // get functions
     query = g_strdup_printf("SHOW FUNCTION STATUS WHERE CAST(Db AS BINARY) = '%s'", database->escaped);
-    if (mysql_query(conn, query) || !(result = mysql_store_result(conn))) {
+    if (profiled_query(conn, query) || !(result = profiled_store_result(conn))) {
       if (success_on_1146 && mysql_errno(conn) == 1146) {
         g_warning("Error dumping functions from %s: %s", database->name,
                   mysql_error(conn));
@@ -541,8 +551,8 @@ void write_routines_definition_into_file(MYSQL *conn, struct database *database,
       g_string_set_size(statement, 0);
       query =
           g_strdup_printf("SHOW CREATE FUNCTION `%s`.`%s`", database->name, row[1]);
-      mysql_query(conn, query);
-      result2 = mysql_store_result(conn);
+      profiled_query(conn, query);
+      result2 = profiled_store_result(conn);
       row2 = mysql_fetch_row(result2);
       g_string_printf(statement, "%s", row2[2]);
       splited_st = g_strsplit(statement->str, ";\n", 0);
@@ -559,7 +569,7 @@ void write_routines_definition_into_file(MYSQL *conn, struct database *database,
 
     // get sp
     query = g_strdup_printf("SHOW PROCEDURE STATUS WHERE CAST(Db AS BINARY) = '%s'", database->escaped);
-    if (mysql_query(conn, query) || !(result = mysql_store_result(conn))) {
+    if (profiled_query(conn, query) || !(result = profiled_store_result(conn))) {
       if (success_on_1146 && mysql_errno(conn) == 1146) {
         g_warning("Error dumping stored procedures from %s: %s", database->name,
                   mysql_error(conn));
@@ -585,8 +595,8 @@ void write_routines_definition_into_file(MYSQL *conn, struct database *database,
       g_string_set_size(statement, 0);
       query =
           g_strdup_printf("SHOW CREATE PROCEDURE `%s`.`%s`", database->name, row[1]);
-      mysql_query(conn, query);
-      result2 = mysql_store_result(conn);
+      profiled_query(conn, query);
+      result2 = profiled_store_result(conn);
       row2 = mysql_fetch_row(result2);
       g_string_printf(statement, "%s", row2[2]);
       splited_st = g_strsplit(statement->str, ";\n", 0);
@@ -608,7 +618,7 @@ void write_routines_definition_into_file(MYSQL *conn, struct database *database,
   // get events
   if (dump_events) {
     query = g_strdup_printf("SHOW EVENTS FROM `%s`", database->name);
-    if (mysql_query(conn, query) || !(result = mysql_store_result(conn))) {
+    if (profiled_query(conn, query) || !(result = profiled_store_result(conn))) {
       if (success_on_1146 && mysql_errno(conn) == 1146) {
         g_warning("Error dumping events from %s: %s", database->name,
                   mysql_error(conn));
@@ -631,8 +641,8 @@ void write_routines_definition_into_file(MYSQL *conn, struct database *database,
         return;
       }
       query = g_strdup_printf("SHOW CREATE EVENT `%s`.`%s`", database->name, row[1]);
-      mysql_query(conn, query);
-      result2 = mysql_store_result(conn);
+      profiled_query(conn, query);
+      result2 = profiled_store_result(conn);
       // DROP EVENT IF EXISTS event_name
       row2 = mysql_fetch_row(result2);
       g_string_printf(statement, "%s", row2[3]);
@@ -651,6 +661,7 @@ void write_routines_definition_into_file(MYSQL *conn, struct database *database,
 
   g_free(query);
   m_close(outfile);
+  manifest_append_file(filename, "schema-post");
   if (stream) g_async_queue_push(stream_queue, g_strdup(filename));
   g_string_free(statement, TRUE);
   g_strfreev(splited_st);
@@ -764,12 +775,12 @@ void do_JOB_CHECKSUM(struct thread_data *td, struct job *job){
   struct table_checksum_job *tcj = (struct table_checksum_job *)job->job_data;
   g_message("Thread %d dumping checksum for `%s`.`%s`", td->thread_id,
             tcj->database, tcj->table);
-  if (use_savepoints && mysql_query(td->thrconn, "SAVEPOINT mydumper")) {
+  if (use_savepoints && profiled_query(td->thrconn, "SAVEPOINT mydumper")) {
     g_critical("Savepoint failed: %s", mysql_error(td->thrconn));
   }
   write_checksum_into_file(td->thrconn, tcj->database, tcj->table, tcj->filename, checksum_table);
   if (use_savepoints &&
-      mysql_query(td->thrconn, "ROLLBACK TO SAVEPOINT mydumper")) {
+      profiled_query(td->thrconn, "ROLLBACK TO SAVEPOINT mydumper")) {
     g_critical("Rollback to savepoint failed: %s", mysql_error(td->thrconn));
   }
   free_table_checksum_job(tcj);
@@ -812,7 +823,7 @@ void create_job_to_dump_triggers(MYSQL *conn, struct db_table *dbt, struct confi
 
     query =
         g_strdup_printf("SHOW TRIGGERS FROM `%s` LIKE '%s'", dbt->database->name, dbt->escaped_table);
-    if (mysql_query(conn, query) || !(result = mysql_store_result(conn))) {
+    if (profiled_query(conn, query) || !(result = profiled_store_result(conn))) {
       g_critical("Error Checking triggers for %s.%s. Err: %s St: %s", dbt->database->name, dbt->table,
                  mysql_error(conn),query);
       errors++;
@@ -935,10 +946,10 @@ GList * get_partitions_for_table(MYSQL *conn, char *database, char *table){
   GList *partition_list = NULL;
 
   gchar *query = g_strdup_printf("select PARTITION_NAME from information_schema.PARTITIONS where PARTITION_NAME is not null and TABLE_SCHEMA='%s' and TABLE_NAME='%s'", database, table);
-  mysql_query(conn,query);
+  profiled_query(conn,query);
   g_free(query);
 
-  res = mysql_store_result(conn);
+  res = profiled_store_result(conn);
   if (res == NULL)
     //partitioning is not supported
     return partition_list;
@@ -984,11 +995,11 @@ guint64 estimate_count(MYSQL *conn, char *database, char *table, char *field,
       g_free(toclause);
     if (fromclause)
       g_free(fromclause);
-    ret = mysql_query(conn, query);
+    ret = profiled_query(conn, query);
     g_free(querybase);
     g_free(query);
   } else {
-    ret = mysql_query(conn, querybase);
+    ret = profiled_query(conn, querybase);
     g_free(querybase);
   }
 
@@ -997,7 +1008,7 @@ guint64 estimate_count(MYSQL *conn, char *database, char *table, char *field,
               mysql_error(conn));
   }
 
-  MYSQL_RES *result = mysql_store_result(conn);
+  MYSQL_RES *result = profiled_store_result(conn);
   MYSQL_FIELD *fields = mysql_fetch_fields(result);
 
   guint i;
@@ -1034,9 +1045,9 @@ GList *get_chunks_for_table(MYSQL *conn, char *database, char *table,
   /* first have to pick index, in future should be able to preset in
    * configuration too */
   gchar *query = g_strdup_printf("SHOW INDEX FROM `%s`.`%s`", database, table);
-  mysql_query(conn, query);
+  profiled_query(conn, query);
   g_free(query);
-  indexes = mysql_store_result(conn);
+  indexes = profiled_store_result(conn);
 
   if (indexes){
     while ((row = mysql_fetch_row(indexes))) {
@@ -1081,14 +1092,14 @@ GList *get_chunks_for_table(MYSQL *conn, char *database, char *table,
     goto cleanup;
 
   /* Get minimum/maximum */
-  mysql_query(conn, query = g_strdup_printf(
+  profiled_query(conn, query = g_strdup_printf(
                         "SELECT %s MIN(`%s`),MAX(`%s`) FROM `%s`.`%s` %s %s",
                         (detected_server == SERVER_TYPE_MYSQL)
                             ? "/*!40001 SQL_NO_CACHE */"
                             : "",
                         field, field, database, table, where_option ? "WHERE" : "", where_option ? where_option : ""));
   g_free(query);
-  minmax = mysql_store_result(conn);
+  minmax = profiled_store_result(conn);
 
   if (!minmax)
     goto cleanup;
@@ -1190,10 +1201,10 @@ gchar *get_primary_key_string(MYSQL *conn, char *database, char *table) {
                           "AND t.table_name='%s' "
                           "ORDER BY t.constraint_type, ORDINAL_POSITION; ",
                           database, table);
-  mysql_query(conn, query);
+  profiled_query(conn, query);
   g_free(query);
 
-  res = mysql_store_result(conn);
+  res = profiled_store_result(conn);
   gboolean first = TRUE;
   while ((row = mysql_fetch_row(res))) {
     if (first) {
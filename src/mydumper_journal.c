@@ -0,0 +1,229 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <mysql.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "mydumper_start_dump.h"
+#include "mydumper_manifest.h"
+#include "mydumper_journal.h"
+
+/* The dump journal lets --resume skip the chunks that an interrupted run
+ * already wrote. Lines are tab separated and appended as the chunks finish:
+ *   snapshot log pos gtid
+ *   file     chunk manifest_line
+ *   chunk    chunk rows
+ * A chunk is identified by its table, number and where/partition. The file
+ * lines of a chunk are written before its chunk line, so a chunk is only
+ * done when the chunk line is found. The manifest lines are replayed into
+ * the new manifest when a chunk is skipped.
+ */
+
+extern gboolean resume;
+extern gboolean no_locks;
+extern guint trx_consistency_only;
+
+struct journal_chunk {
+  guint64 rows;
+  GString *files;
+  gboolean done;
+};
+
+static FILE *journal_file = NULL;
+static GMutex *journal_mutex = NULL;
+static gchar *journal_filename = NULL;
+static GHashTable *journal_chunks = NULL;
+static gchar **journal_snapshot = NULL;
+
+static void free_journal_chunk(struct journal_chunk *jc){
+  g_string_free(jc->files, TRUE);
+  g_free(jc);
+}
+
+static struct journal_chunk *get_journal_chunk(const gchar *key){
+  struct journal_chunk *jc = g_hash_table_lookup(journal_chunks, key);
+  if (jc == NULL){
+    jc = g_new0(struct journal_chunk, 1);
+    jc->files = g_string_new("");
+    g_hash_table_insert(journal_chunks, g_strdup(key), jc);
+  }
+  return jc;
+}
+
+static void load_dump_journal(){
+  gchar *content = NULL, **lines = NULL, **fields = NULL, *key = NULL;
+  GError *error = NULL;
+  struct journal_chunk *jc = NULL;
+  guint i, done = 0;
+  if (!g_file_get_contents(journal_filename, &content, NULL, &error)){
+    g_critical("Dump journal %s could not be read: %s", journal_filename, error->message);
+    exit(EXIT_FAILURE);
+  }
+  lines = g_strsplit(content, "\n", -1);
+  g_free(content);
+  for (i = 0; lines[i] != NULL; i++){
+    fields = g_strsplit(lines[i], "\t", 3);
+    if (g_strv_length(fields) == 3){
+      if (g_strcmp0(fields[0], "snapshot") == 0 && journal_snapshot == NULL){
+        journal_snapshot = g_strsplit(lines[i] + strlen("snapshot\t"), "\t", 3);
+      }else if (g_strcmp0(fields[0], "file") == 0){
+        key = g_strcompress(fields[1]);
+        jc = get_journal_chunk(key);
+        g_string_append_printf(jc->files, "%s\n", fields[2]);
+        g_free(key);
+      }else if (g_strcmp0(fields[0], "chunk") == 0){
+        key = g_strcompress(fields[1]);
+        jc = get_journal_chunk(key);
+        jc->rows = g_ascii_strtoull(fields[2], NULL, 10);
+        jc->done = TRUE;
+        done++;
+        g_free(key);
+      }
+    }
+    g_strfreev(fields);
+  }
+  g_strfreev(lines);
+  g_message("Dump journal loaded, %u chunks were already dumped", done);
+}
+
+void initialize_dump_journal(const gchar *directory){
+  journal_filename = g_strdup_printf("%s/dump-journal", directory);
+  journal_mutex = g_mutex_new();
+  journal_chunks = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)free_journal_chunk);
+  if (resume){
+    if (g_file_test(journal_filename, G_FILE_TEST_EXISTS))
+      load_dump_journal();
+    else
+      g_warning("Dump journal %s not found, all the tables will be dumped", journal_filename);
+  }
+  journal_file = g_fopen(journal_filename, resume ? "a" : "w");
+  if (!journal_file){
+    g_critical("Couldn't write dump journal %s (%d)", journal_filename, errno);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void journal_write(const gchar *line){
+  g_mutex_lock(journal_mutex);
+  fputs(line, journal_file);
+  fflush(journal_file);
+  g_mutex_unlock(journal_mutex);
+}
+
+void dump_journal_snapshot(const gchar *log, const gchar *pos, const gchar *gtid){
+  gchar *line = NULL;
+  if (journal_file == NULL)
+    return;
+  if (journal_snapshot == NULL){
+    line = g_strdup_printf("snapshot\t%s\t%s\t%s\n", log ? log : "", pos ? pos : "", gtid ? gtid : "");
+    journal_write(line);
+    g_free(line);
+    return;
+  }
+  if (g_strv_length(journal_snapshot) == 3 &&
+      g_strcmp0(journal_snapshot[0], log ? log : "") == 0 &&
+      g_strcmp0(journal_snapshot[1], pos ? pos : "") == 0 &&
+      g_strcmp0(journal_snapshot[2], gtid ? gtid : "") == 0){
+    g_message("Binlog coordinates match the interrupted dump, resuming a consistent backup");
+  }else if (no_locks || trx_consistency_only){
+    g_message("Binlog coordinates changed since the interrupted dump, continuing as the backup is not locked");
+  }else{
+    g_warning("Binlog coordinates changed since the interrupted dump (Log: %s Pos: %s GTID: %s). The chunks dumped before are not consistent with the metadata of this run",
+              journal_snapshot[0], journal_snapshot[1], journal_snapshot[2]);
+  }
+}
+
+static gchar *get_chunk_key(struct table_job *tj){
+  return g_strdup_printf("`%s`.`%s` %u %s", tj->database, tj->table, tj->nchunk,
+      tj->where ? tj->where : (tj->partition ? tj->partition : ""));
+}
+
+void dump_journal_add_file(struct table_job *tj, const gchar *manifest_line){
+  if (journal_file == NULL)
+    return;
+  if (tj->journal_files == NULL)
+    tj->journal_files = g_string_new("");
+  g_string_append(tj->journal_files, manifest_line);
+}
+
+gboolean dump_journal_is_done(struct table_job *tj){
+  struct journal_chunk *jc = NULL;
+  gchar *key = NULL;
+  gchar **lines = NULL;
+  guint i;
+  if (journal_file == NULL || g_hash_table_size(journal_chunks) == 0)
+    return FALSE;
+  key = get_chunk_key(tj);
+  jc = g_hash_table_lookup(journal_chunks, key);
+  if (jc == NULL || !jc->done){
+    g_free(key);
+    return FALSE;
+  }
+  // The new manifest and journal need the files of the chunk
+  lines = g_strsplit(jc->files->str, "\n", -1);
+  for (i = 0; lines[i] != NULL; i++){
+    if (lines[i][0] == '\0')
+      continue;
+    gchar *line = g_strdup_printf("%s\n", lines[i]);
+    manifest_append_line(line);
+    dump_journal_add_file(tj, line);
+    g_free(line);
+  }
+  g_strfreev(lines);
+  g_mutex_lock(tj->dbt->rows_lock);
+  tj->dbt->rows += jc->rows;
+  g_mutex_unlock(tj->dbt->rows_lock);
+  dump_journal_chunk_done(tj, jc->rows);
+  g_free(key);
+  return TRUE;
+}
+
+void dump_journal_chunk_done(struct table_job *tj, guint64 rows){
+  gchar *key = NULL, *e_key = NULL, **lines = NULL;
+  GString *block = NULL;
+  guint i;
+  if (journal_file == NULL)
+    return;
+  key = get_chunk_key(tj);
+  e_key = g_strescape(key, NULL);
+  block = g_string_new("");
+  if (tj->journal_files != NULL){
+    lines = g_strsplit(tj->journal_files->str, "\n", -1);
+    for (i = 0; lines[i] != NULL; i++)
+      if (lines[i][0] != '\0')
+        g_string_append_printf(block, "file\t%s\t%s\n", e_key, lines[i]);
+    g_strfreev(lines);
+  }
+  g_string_append_printf(block, "chunk\t%s\t%"G_GUINT64_FORMAT"\n", e_key, rows);
+  journal_write(block->str);
+  g_string_free(block, TRUE);
+  g_free(e_key);
+  g_free(key);
+}
+
+/* The journal is only kept when the dump did not finish */
+void finish_dump_journal(gboolean completed){
+  if (journal_file == NULL)
+    return;
+  fclose(journal_file);
+  journal_file = NULL;
+  if (completed)
+    g_remove(journal_filename);
+}
@@ -0,0 +1,23 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+void initialize_dump_journal(const gchar *directory);
+void dump_journal_snapshot(const gchar *log, const gchar *pos, const gchar *gtid);
+void dump_journal_add_file(struct table_job *tj, const gchar *manifest_line);
+gboolean dump_journal_is_done(struct table_job *tj);
+void dump_journal_chunk_done(struct table_job *tj, guint64 rows);
+void finish_dump_journal(gboolean completed);
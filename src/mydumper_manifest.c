@@ -0,0 +1,121 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef ZWRAP_USE_ZSTD
+#include "../zstd/zstd_zlibwrapper.h"
+#else
+#include <zlib.h>
+#endif
+#include "mydumper_manifest.h"
+
+/* The manifest has one line per file written by mydumper:
+ *   type filename database table part sub_part bytes rows crc32 key_range
+ * Fields are separated by tabs and the string fields are escaped with
+ * g_strescape. The crc32 is computed over the uncompressed content.
+ * myloader uses it to build the restore without listing the directory.
+ */
+
+static FILE *manifest_file = NULL;
+static GMutex *manifest_mutex = NULL;
+static gchar *manifest_partial_filename = NULL;
+
+void initialize_manifest(const gchar *directory){
+  manifest_partial_filename = g_strdup_printf("%s/manifest.partial", directory);
+  manifest_file = g_fopen(manifest_partial_filename, "w");
+  if (!manifest_file){
+    g_critical("Couldn't write manifest file %s (%d)", manifest_partial_filename, errno);
+    exit(EXIT_FAILURE);
+  }
+  if (manifest_mutex == NULL)
+    manifest_mutex = g_mutex_new();
+  fprintf(manifest_file, "# type\tfilename\tdatabase\ttable\tpart\tsub_part\tbytes\trows\tcrc32\tkey_range\n");
+}
+
+gchar * manifest_line(const gchar *filename, const gchar *type, const gchar *database, const gchar *table, guint part, guint sub_part, guint64 rows, guint32 crc, const gchar *key_range){
+  GStatBuf st;
+  guint64 bytes = 0;
+  if (g_stat(filename, &st) == 0)
+    bytes = st.st_size;
+  gchar *basename = g_path_get_basename(filename);
+  gchar *e_basename = g_strescape(basename, NULL);
+  gchar *e_database = g_strescape(database ? database : "", NULL);
+  gchar *e_table = g_strescape(table ? table : "", NULL);
+  gchar *e_key_range = g_strescape(key_range ? key_range : "", NULL);
+  gchar *line = g_strdup_printf("%s\t%s\t%s\t%s\t%u\t%u\t%"G_GUINT64_FORMAT"\t%"G_GUINT64_FORMAT"\t%08x\t%s\n",
+          type, e_basename, e_database, e_table, part, sub_part, bytes, rows, crc, e_key_range);
+  g_free(basename);
+  g_free(e_basename);
+  g_free(e_database);
+  g_free(e_table);
+  g_free(e_key_range);
+  return line;
+}
+
+void manifest_append_line(const gchar *line){
+  if (manifest_file == NULL)
+    return;
+  g_mutex_lock(manifest_mutex);
+  fputs(line, manifest_file);
+  g_mutex_unlock(manifest_mutex);
+}
+
+void manifest_append(const gchar *filename, const gchar *type, const gchar *database, const gchar *table, guint part, guint sub_part, guint64 rows, guint32 crc, const gchar *key_range){
+  if (manifest_file == NULL)
+    return;
+  gchar *line = manifest_line(filename, type, database, table, part, sub_part, rows, crc, key_range);
+  manifest_append_line(line);
+  g_free(line);
+}
+
+/* Schema and metadata files are small, so we read them back to get the
+ * checksum instead of tracking it on each write. gzread also reads files
+ * that are not compressed. */
+guint32 manifest_file_checksum(const gchar *filename){
+  char buf[65536];
+  int len = 0;
+  uLong crc = crc32(0L, Z_NULL, 0);
+  gzFile file = gzopen(filename, "r");
+  if (file){
+    while ((len = gzread(file, buf, sizeof(buf))) > 0)
+      crc = crc32(crc, (const Bytef *)buf, len);
+    gzclose(file);
+  }
+  return crc;
+}
+
+void manifest_append_file(const gchar *filename, const gchar *type){
+  if (manifest_file == NULL)
+    return;
+  manifest_append(filename, type, NULL, NULL, 0, 0, 0, manifest_file_checksum(filename), NULL);
+}
+
+gchar * finish_manifest(){
+  if (manifest_file == NULL)
+    return NULL;
+  fclose(manifest_file);
+  manifest_file = NULL;
+  gchar *manifest_filename = g_strndup(manifest_partial_filename, (unsigned)strlen(manifest_partial_filename) - 8);
+  g_rename(manifest_partial_filename, manifest_filename);
+  g_free(manifest_partial_filename);
+  manifest_partial_filename = NULL;
+  return manifest_filename;
+}
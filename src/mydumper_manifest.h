@@ -0,0 +1,24 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+void initialize_manifest(const gchar *directory);
+gchar * manifest_line(const gchar *filename, const gchar *type, const gchar *database, const gchar *table, guint part, guint sub_part, guint64 rows, guint32 crc, const gchar *key_range);
+void manifest_append_line(const gchar *line);
+void manifest_append(const gchar *filename, const gchar *type, const gchar *database, const gchar *table, guint part, guint sub_part, guint64 rows, guint32 crc, const gchar *key_range);
+guint32 manifest_file_checksum(const gchar *filename);
+void manifest_append_file(const gchar *filename, const gchar *type);
+gchar * finish_manifest();
@@ -23,24 +23,331 @@
 #include <mysql.h>
 #include "mydumper_masquerade.h"
 
-gchar * identity_function(gchar ** r){
-  return *r;
+/*
+  The functions of a column are compiled once, when the defaults file is
+  loaded, into a pipeline of steps. Each step reads the output of the
+  previous one and writes into one of the two buffers of the thread, so
+  masking a value does not allocate memory once the buffers are as big as
+  the biggest value. The values are hashed with SipHash-2-4 and the key of
+  --masking-key, so the same value gets the same mask in every table and
+  the joins still match. The hash seeds a splitmix64 generator, which gives
+  the characters of the formats that need more than 64 bits.
+*/
+
+#define MASKING_MAX_STEPS 8
+// Every step writes at most the length of its input plus this
+#define MASKING_EXTRA_BYTES 32
+
+typedef gsize (*masking_function)(const gchar *value, gsize length, gchar *out);
+
+struct masking_pipeline {
+  guint steps;
+  masking_function step[MASKING_MAX_STEPS];
+};
+
+struct masking_buffers {
+  GString *buffer[2];
+};
+
+static guint64 sip_key[2]={0, 0};
+static GPrivate *masking_buffers=NULL;
+
+#define ROTL(x, b) (guint64)(((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPROUND \
+  do { \
+    v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+    v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32); \
+  } while (0)
+
+static guint64 siphash(const guchar *in, gsize length){
+  guint64 v0=0x736f6d6570736575ULL ^ sip_key[0];
+  guint64 v1=0x646f72616e646f6dULL ^ sip_key[1];
+  guint64 v2=0x6c7967656e657261ULL ^ sip_key[0];
+  guint64 v3=0x7465646279746573ULL ^ sip_key[1];
+  guint64 m, b=((guint64)length) << 56;
+  const guchar *end=in + length - (length % 8);
+  gsize i;
+  for (; in != end; in+=8){
+    m=0;
+    for (i=0; i < 8; i++)
+      m|=((guint64)in[i]) << (8 * i);
+    v3^=m;
+    SIPROUND;
+    SIPROUND;
+    v0^=m;
+  }
+  for (i=0; i < length % 8; i++)
+    b|=((guint64)in[i]) << (8 * i);
+  v3^=b;
+  SIPROUND;
+  SIPROUND;
+  v0^=b;
+  v2^=0xff;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+static guint64 splitmix64(guint64 *state){
+  guint64 z=(*state+=0x9e3779b97f4a7c15ULL);
+  z=(z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z=(z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// The key is derived from --masking-key, without it a random key is used
+// and the masks are only consistent inside the dump
+void initialize_masquerade(const gchar *key){
+  GChecksum *checksum=NULL;
+  guint8 digest[32];
+  gsize digest_len=sizeof(digest);
+  guint i;
+  if (key != NULL){
+    checksum=g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, (const guchar *)key, strlen(key));
+    g_checksum_get_digest(checksum, digest, &digest_len);
+    g_checksum_free(checksum);
+    sip_key[0]=sip_key[1]=0;
+    for (i=0; i < 8; i++){
+      sip_key[0]|=((guint64)digest[i]) << (8 * i);
+      sip_key[1]|=((guint64)digest[i + 8]) << (8 * i);
+    }
+  }else{
+    sip_key[0]=((guint64)g_random_int() << 32) | g_random_int();
+    sip_key[1]=((guint64)g_random_int() << 32) | g_random_int();
+  }
+  if (masking_buffers == NULL)
+    masking_buffers=g_private_new(NULL);
+}
+
+static gchar random_character(gchar c, guint64 *state){
+  if (g_ascii_islower(c))
+    return 'a' + splitmix64(state) % 26;
+  if (g_ascii_isupper(c))
+    return 'A' + splitmix64(state) % 26;
+  if (g_ascii_isdigit(c))
+    return '0' + splitmix64(state) % 10;
+  return c;
+}
+
+// Letters, digits and the rest of the characters keep their class
+static void mask_characters(const gchar *value, gsize length, gchar *out, guint64 *state){
+  gsize i;
+  for (i=0; i < length; i++)
+    out[i]=random_character(value[i], state);
+}
+
+static gsize random_int_function(const gchar *value, gsize length, gchar *out){
+  (void)value;
+  (void)length;
+  return g_snprintf(out, MASKING_EXTRA_BYTES, "%u", g_random_int());
+}
+
+static gsize hash_function(const gchar *value, gsize length, gchar *out){
+  return g_snprintf(out, MASKING_EXTRA_BYTES, "%016" G_GINT64_MODIFIER "x", siphash((const guchar *)value, length));
 }
 
-gchar * random_int_function(gchar ** r){
-  // TODO: This function is not near to be ok, it is just for testing.
-  gchar * new_number=g_strdup_printf("%u",g_random_int());
-  g_strlcpy(*r,new_number,strlen(*r)+1);
-  return *r;
+static gsize string_function(const gchar *value, gsize length, gchar *out){
+  guint64 state=siphash((const guchar *)value, length);
+  mask_characters(value, length, out, &state);
+  return length;
 }
 
-fun_ptr get_function_pointer_for (gchar *function_char){
-  if (!g_strcmp0(function_char,"random_int"))
+// Same sign, decimal point and number of digits, without leading zeros
+static gsize number_function(const gchar *value, gsize length, gchar *out){
+  guint64 state=siphash((const guchar *)value, length);
+  gboolean first=TRUE;
+  gsize i;
+  for (i=0; i < length; i++){
+    if (g_ascii_isdigit(value[i])){
+      out[i]=first && i + 1 < length && g_ascii_isdigit(value[i + 1]) ?
+             '1' + splitmix64(&state) % 9 : '0' + splitmix64(&state) % 10;
+      first=FALSE;
+    }else{
+      out[i]=value[i];
+      first=value[i] == '-' || value[i] == '+';
+    }
+  }
+  return length;
+}
+
+// The local part and the domain are masked, except the top level domain
+static gsize email_function(const gchar *value, gsize length, gchar *out){
+  guint64 state=siphash((const guchar *)value, length);
+  const gchar *at=memchr(value, '@', length), *tld=NULL;
+  gsize i;
+  if (at == NULL){
+    mask_characters(value, length, out, &state);
+    return length;
+  }
+  for (i=length; i > (gsize)(at - value); i--)
+    if (value[i - 1] == '.'){
+      tld=value + i - 1;
+      break;
+    }
+  if (tld == NULL)
+    tld=value + length;
+  mask_characters(value, tld - value, out, &state);
+  memcpy(out + (tld - value), tld, length - (tld - value));
+  return length;
+}
+
+// The digits are masked, except a country code written as +<code> and
+// followed by a separator
+static gsize phone_function(const gchar *value, gsize length, gchar *out){
+  guint64 state=siphash((const guchar *)value, length);
+  gsize i=0;
+  if (length > 0 && value[0] == '+'){
+    for (i=1; i < length && g_ascii_isdigit(value[i]); i++);
+    if (i == length || i > 4)
+      i=1;
+    memcpy(out, value, i);
+  }
+  for (; i < length; i++)
+    out[i]=g_ascii_isdigit(value[i]) ? (gchar)('0' + splitmix64(&state) % 10) : value[i];
+  return length;
+}
+
+static gboolean parse_digits(const gchar *value, guint count, guint *n){
+  guint i;
+  *n=0;
+  for (i=0; i < count; i++){
+    if (!g_ascii_isdigit(value[i]))
+      return FALSE;
+    *n=*n * 10 + value[i] - '0';
+  }
+  return TRUE;
+}
+
+// YYYY-MM-DD is moved up to a year back or forward, the time is kept.
+// Values that are not valid dates, like 0000-00-00, are kept
+static gsize date_function(const gchar *value, gsize length, gchar *out){
+  GDate date;
+  guint year, month, day;
+  gint days;
+  memcpy(out, value, length);
+  if (length < 10 || value[4] != '-' || value[7] != '-' ||
+      !parse_digits(value, 4, &year) || !parse_digits(value + 5, 2, &month) || !parse_digits(value + 8, 2, &day) ||
+      !g_date_valid_dmy(day, month, year))
+    return length;
+  g_date_clear(&date, 1);
+  g_date_set_dmy(&date, day, month, year);
+  days=(gint)(siphash((const guchar *)value, 10) % 731) - 365;
+  if (days > 0)
+    g_date_add_days(&date, days);
+  else if (days < 0 && g_date_get_julian(&date) > (guint)-days)
+    g_date_subtract_days(&date, -days);
+  year=g_date_get_year(&date);
+  if (year > 9999)
+    return length;
+  g_snprintf(out, 11, "%04u-%02u-%02u", year, g_date_get_month(&date), g_date_get_day(&date));
+  if (length > 10)
+    out[10]=value[10];
+  return length;
+}
+
+static gsize lower_function(const gchar *value, gsize length, gchar *out){
+  gsize i;
+  for (i=0; i < length; i++)
+    out[i]=g_ascii_tolower(value[i]);
+  return length;
+}
+
+static gsize trim_function(const gchar *value, gsize length, gchar *out){
+  while (length > 0 && g_ascii_isspace(*value)){
+    value++;
+    length--;
+  }
+  while (length > 0 && g_ascii_isspace(value[length - 1]))
+    length--;
+  memcpy(out, value, length);
+  return length;
+}
+
+static masking_function get_masking_function(const gchar *name){
+  if (!g_strcmp0(name, "random_int"))
     return &random_int_function;
-  // TODO: more functions needs to be added.
-  if (!g_strcmp0(function_char,""))
-    return &identity_function;
-  if (!g_strcmp0(function_char,""))
-    return &identity_function;
-  return &identity_function;
+  if (!g_strcmp0(name, "hash"))
+    return &hash_function;
+  if (!g_strcmp0(name, "string"))
+    return &string_function;
+  if (!g_strcmp0(name, "number"))
+    return &number_function;
+  if (!g_strcmp0(name, "email"))
+    return &email_function;
+  if (!g_strcmp0(name, "phone"))
+    return &phone_function;
+  if (!g_strcmp0(name, "date"))
+    return &date_function;
+  if (!g_strcmp0(name, "lower"))
+    return &lower_function;
+  if (!g_strcmp0(name, "trim"))
+    return &trim_function;
+  return NULL;
+}
+
+// The values of numeric columns are written without quotes, so they can
+// only be masked by functions that keep a number as a number
+gboolean masking_pipeline_is_numeric(struct masking_pipeline *mp){
+  guint i;
+  for (i=0; i < mp->steps; i++)
+    if (mp->step[i] == &hash_function || mp->step[i] == &string_function || mp->step[i] == &email_function)
+      return FALSE;
+  return TRUE;
+}
+
+// functions is a comma separated list, like: trim,lower,email. It returns
+// NULL when the column is dumped as it is
+gpointer get_masking_pipeline_for(gchar *functions){
+  struct masking_pipeline *mp=g_new0(struct masking_pipeline, 1);
+  gchar **names=g_strsplit(functions != NULL ? functions : "", ",", 0);
+  masking_function f=NULL;
+  guint i;
+  for (i=0; names[i] != NULL; i++){
+    g_strstrip(names[i]);
+    if (names[i][0] == '\0' || !g_strcmp0(names[i], "identity"))
+      continue;
+    if ((f=get_masking_function(names[i])) == NULL){
+      g_critical("Unknown masking function %s in %s", names[i], functions);
+      exit(EXIT_FAILURE);
+    }
+    if (mp->steps == MASKING_MAX_STEPS){
+      g_critical("Too many masking functions in %s, the maximum is %d", functions, MASKING_MAX_STEPS);
+      exit(EXIT_FAILURE);
+    }
+    mp->step[mp->steps++]=f;
+  }
+  g_strfreev(names);
+  if (mp->steps == 0){
+    g_free(mp);
+    return NULL;
+  }
+  return mp;
+}
+
+// Returns the masked value, in a buffer of the thread that is valid until
+// the next call
+gchar *mask_value(struct masking_pipeline *mp, const gchar *value, gulong *length){
+  struct masking_buffers *mb=g_private_get(masking_buffers);
+  GString *out=NULL;
+  guint i;
+  if (mb == NULL){
+    mb=g_new(struct masking_buffers, 1);
+    mb->buffer[0]=g_string_sized_new(256);
+    mb->buffer[1]=g_string_sized_new(256);
+    g_private_set(masking_buffers, mb);
+  }
+  for (i=0; i < mp->steps; i++){
+    out=mb->buffer[i % 2];
+    if (out->allocated_len <= *length + MASKING_EXTRA_BYTES)
+      g_string_set_size(out, *length + MASKING_EXTRA_BYTES);
+    *length=mp->step[i](value, *length, out->str);
+    out->str[*length]='\0';
+    value=out->str;
+  }
+  return out->str;
 }
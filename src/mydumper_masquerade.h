@@ -13,7 +13,10 @@
 */
 #include "common.h"
 
-gchar * identity_function(gchar ** r);
-gchar * random_int_function(gchar ** r);
-fun_ptr get_function_pointer_for (gchar *function_char);
+struct masking_pipeline;
+
+void initialize_masquerade(const gchar *key);
+gpointer get_masking_pipeline_for(gchar *functions);
+gboolean masking_pipeline_is_numeric(struct masking_pipeline *mp);
+gchar *mask_value(struct masking_pipeline *mp, const gchar *value, gulong *length);
 
@@ -0,0 +1,230 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include "metrics.h"
+#include "mydumper_metrics.h"
+
+/* Each worker thread counts what it dumps in its own slot, found with a
+ * GPrivate, and the tables count it in their table_metrics. The counters
+ * are only added with relaxed atomics, without locks. The PMM thread reads
+ * them every second and computes the rates, the progress and the ETA of
+ * each table. The progress compares the bytes written with the data_length
+ * of the table, so it is an estimation.
+ */
+
+struct thread_metrics {
+  guint64 rows;
+  guint64 bytes;
+  guint64 file_bytes;
+  guint64 chunks;
+  guint64 chunk_microseconds;
+  guint64 chunk_buckets[METRICS_BUCKETS + 1];
+  guint64 last_rows;
+  guint64 last_bytes;
+};
+
+struct table_metrics {
+  gchar *labels;
+  guint64 datalength;
+  guint64 rows;
+  guint64 bytes;
+  guint64 file_bytes;
+  guint64 last_bytes;
+  gdouble rate;
+};
+
+static gboolean metrics_enabled=FALSE;
+static GPrivate *thread_slot=NULL;
+static struct thread_metrics **thread_metrics=NULL;
+static guint thread_count=0;
+static GMutex *tables_mutex=NULL;
+static GList *tables=NULL;
+static GTimer *metrics_timer=NULL;
+static gdouble last_elapsed=0;
+static GTimer *global_lock_timer=NULL;
+static gdouble global_lock_seconds=0;
+static GMutex *global_lock_mutex=NULL;
+
+void initialize_metrics(guint threads){
+  guint i;
+  thread_count=threads;
+  thread_metrics=g_new(struct thread_metrics *, thread_count);
+  for (i=0; i < thread_count; i++)
+    thread_metrics[i]=g_new0(struct thread_metrics, 1);
+  thread_slot=g_private_new(NULL);
+  tables_mutex=g_mutex_new();
+  global_lock_mutex=g_mutex_new();
+  metrics_timer=g_timer_new();
+  metrics_enabled=TRUE;
+}
+
+void metrics_register_thread(guint thread_id){
+  if (metrics_enabled && thread_id > 0 && thread_id <= thread_count)
+    g_private_set(thread_slot, thread_metrics[thread_id - 1]);
+}
+
+struct table_metrics *metrics_new_table(const gchar *database, const gchar *table, guint64 datalength){
+  struct table_metrics *tm=NULL;
+  GString *label=NULL;
+  if (!metrics_enabled)
+    return NULL;
+  tm=g_new0(struct table_metrics, 1);
+  label=g_string_new("");
+  append_label(label, "database", database);
+  g_string_append_c(label, ',');
+  append_label(label, "table", table);
+  tm->labels=g_string_free(label, FALSE);
+  tm->datalength=datalength;
+  g_mutex_lock(tables_mutex);
+  tables=g_list_append(tables, tm);
+  g_mutex_unlock(tables_mutex);
+  return tm;
+}
+
+void metrics_data_written(struct table_metrics *tm, guint64 rows, gsize bytes){
+  struct thread_metrics *th=NULL;
+  if (!metrics_enabled)
+    return;
+  th=g_private_get(thread_slot);
+  if (th != NULL){
+    METRIC_ADD(th->rows, rows);
+    METRIC_ADD(th->bytes, bytes);
+  }
+  if (tm != NULL){
+    METRIC_ADD(tm->rows, rows);
+    METRIC_ADD(tm->bytes, bytes);
+  }
+}
+
+// The size of a data file once it is closed, compressed with --compress
+void metrics_file_closed(struct table_metrics *tm, const gchar *filename){
+  struct thread_metrics *th=NULL;
+  GStatBuf st;
+  if (!metrics_enabled || g_stat(filename, &st) != 0)
+    return;
+  th=g_private_get(thread_slot);
+  if (th != NULL)
+    METRIC_ADD(th->file_bytes, st.st_size);
+  if (tm != NULL)
+    METRIC_ADD(tm->file_bytes, st.st_size);
+}
+
+void metrics_chunk_query(gdouble seconds){
+  struct thread_metrics *th=NULL;
+  guint i;
+  if (!metrics_enabled || (th=g_private_get(thread_slot)) == NULL)
+    return;
+  for (i=0; i < METRICS_BUCKETS && seconds > metrics_buckets[i]; i++);
+  METRIC_ADD(th->chunk_buckets[i], 1);
+  METRIC_ADD(th->chunks, 1);
+  METRIC_ADD(th->chunk_microseconds, (guint64)(seconds * G_USEC_PER_SEC));
+}
+
+// Time between FLUSH TABLES WITH READ LOCK and its UNLOCK TABLES
+void metrics_global_lock(gboolean locked){
+  if (!metrics_enabled)
+    return;
+  g_mutex_lock(global_lock_mutex);
+  if (locked && global_lock_timer == NULL)
+    global_lock_timer=g_timer_new();
+  else if (!locked && global_lock_timer != NULL){
+    global_lock_seconds+=g_timer_elapsed(global_lock_timer, NULL);
+    g_timer_destroy(global_lock_timer);
+    global_lock_timer=NULL;
+  }
+  g_mutex_unlock(global_lock_mutex);
+}
+
+static void write_thread_metrics(GString *content, gdouble interval){
+  struct thread_metrics *th=NULL;
+  guint64 rows, bytes, count=0, microseconds=0, buckets[METRICS_BUCKETS + 1];
+  guint i, b;
+  memset(buckets, 0, sizeof(buckets));
+  for (i=0; i < thread_count; i++){
+    th=thread_metrics[i];
+    rows=METRIC_GET(th->rows);
+    bytes=METRIC_GET(th->bytes);
+    g_string_append_printf(content, "mydumper_thread_rows_total{thread=\"%u\"} %" G_GUINT64_FORMAT "\n", i + 1, rows);
+    g_string_append_printf(content, "mydumper_thread_bytes_total{thread=\"%u\"} %" G_GUINT64_FORMAT "\n", i + 1, bytes);
+    g_string_append_printf(content, "mydumper_thread_file_bytes_total{thread=\"%u\"} %" G_GUINT64_FORMAT "\n", i + 1, METRIC_GET(th->file_bytes));
+    if (interval > 0){
+      g_string_append_printf(content, "mydumper_thread_rows_per_second{thread=\"%u\"} %.0f\n", i + 1, (rows - th->last_rows) / interval);
+      g_string_append_printf(content, "mydumper_thread_bytes_per_second{thread=\"%u\"} %.0f\n", i + 1, (bytes - th->last_bytes) / interval);
+    }
+    th->last_rows=rows;
+    th->last_bytes=bytes;
+    for (b=0; b <= METRICS_BUCKETS; b++)
+      buckets[b]+=METRIC_GET(th->chunk_buckets[b]);
+    count+=METRIC_GET(th->chunks);
+    microseconds+=METRIC_GET(th->chunk_microseconds);
+  }
+  for (b=0; b < METRICS_BUCKETS; b++){
+    if (b > 0)
+      buckets[b]+=buckets[b - 1];
+    g_string_append_printf(content, "mydumper_chunk_query_seconds_bucket{le=\"%g\"} %" G_GUINT64_FORMAT "\n", metrics_buckets[b], buckets[b]);
+  }
+  g_string_append_printf(content, "mydumper_chunk_query_seconds_bucket{le=\"+Inf\"} %" G_GUINT64_FORMAT "\n", count);
+  g_string_append_printf(content, "mydumper_chunk_query_seconds_sum %.6f\n", (gdouble)microseconds / G_USEC_PER_SEC);
+  g_string_append_printf(content, "mydumper_chunk_query_seconds_count %" G_GUINT64_FORMAT "\n", count);
+}
+
+static void write_table_metrics(GString *content, gdouble interval){
+  struct table_metrics *tm=NULL;
+  GList *l=NULL;
+  guint64 bytes;
+  gdouble progress;
+  g_mutex_lock(tables_mutex);
+  for (l=tables; l != NULL; l=l->next){
+    tm=l->data;
+    bytes=METRIC_GET(tm->bytes);
+    if (interval > 0)
+      tm->rate=tm->last_bytes == 0 ? (bytes - tm->last_bytes) / interval :
+               METRICS_RATE_WEIGHT * (bytes - tm->last_bytes) / interval + (1 - METRICS_RATE_WEIGHT) * tm->rate;
+    tm->last_bytes=bytes;
+    if (bytes == 0)
+      continue;
+    g_string_append_printf(content, "mydumper_table_rows_total{%s} %" G_GUINT64_FORMAT "\n", tm->labels, METRIC_GET(tm->rows));
+    g_string_append_printf(content, "mydumper_table_bytes_total{%s} %" G_GUINT64_FORMAT "\n", tm->labels, bytes);
+    g_string_append_printf(content, "mydumper_table_file_bytes_total{%s} %" G_GUINT64_FORMAT "\n", tm->labels, METRIC_GET(tm->file_bytes));
+    g_string_append_printf(content, "mydumper_table_bytes_per_second{%s} %.0f\n", tm->labels, tm->rate);
+    if (tm->datalength > 0){
+      progress=MIN(1.0, (gdouble)bytes / tm->datalength);
+      g_string_append_printf(content, "mydumper_table_progress_ratio{%s} %.4f\n", tm->labels, progress);
+      if (tm->rate > 0)
+        g_string_append_printf(content, "mydumper_table_eta_seconds{%s} %.0f\n", tm->labels,
+                               bytes < tm->datalength ? (tm->datalength - bytes) / tm->rate : 0);
+    }
+  }
+  g_mutex_unlock(tables_mutex);
+}
+
+void write_metrics(GString *content){
+  gdouble elapsed, lock_seconds;
+  if (!metrics_enabled)
+    return;
+  elapsed=g_timer_elapsed(metrics_timer, NULL);
+  write_thread_metrics(content, elapsed - last_elapsed);
+  write_table_metrics(content, elapsed - last_elapsed);
+  last_elapsed=elapsed;
+  g_mutex_lock(global_lock_mutex);
+  lock_seconds=global_lock_seconds + (global_lock_timer != NULL ? g_timer_elapsed(global_lock_timer, NULL) : 0);
+  g_mutex_unlock(global_lock_mutex);
+  g_string_append_printf(content, "mydumper_global_lock_seconds %.3f\n", lock_seconds);
+}
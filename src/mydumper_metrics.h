@@ -0,0 +1,27 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+struct table_metrics;
+
+void initialize_metrics(guint threads);
+void metrics_register_thread(guint thread_id);
+struct table_metrics *metrics_new_table(const gchar *database, const gchar *table, guint64 datalength);
+void metrics_data_written(struct table_metrics *tm, guint64 rows, gsize bytes);
+void metrics_file_closed(struct table_metrics *tm, const gchar *filename);
+void metrics_chunk_query(gdouble seconds);
+void metrics_global_lock(gboolean locked);
+void write_metrics(GString *content);
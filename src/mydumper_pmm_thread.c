@@ -24,6 +24,8 @@
 #include <gio/gio.h>
 #include <mysql.h>
 #include "mydumper_start_dump.h"
+#include "mydumper_metrics.h"
+#include "stages.h"
 extern gchar *pmm_resolution ;
 extern gchar *pmm_path;
 extern GAsyncQueue *stream_queue;
@@ -48,6 +50,8 @@ void write_pmm_entries(const gchar* filename, GString *content, struct configura
   append_pmm_entry(content,"unlock_tables",     conf->unlock_tables);
   append_pmm_entry(content,"pause_resume",      conf->pause_resume);
   append_pmm_entry(content,"stream_queue",      stream_queue);
+  write_metrics(content);
+  write_stages(content, "mydumper");
   g_file_set_contents( filename , content->str, content->len, NULL);
 }
 
@@ -70,6 +70,13 @@
 #include "mydumper_pmm_thread.h"
 #include "mydumper_exec_command.h"
 #include "mydumper_masquerade.h"
+#include "mydumper_manifest.h"
+#include "mydumper_journal.h"
+#include "mydumper_throttle.h"
+#include "mydumper_metrics.h"
+#include "stages.h"
+#include "trace.h"
+#include "query_profile.h"
 /* Some earlier versions of MySQL do not yet define MYSQL_TYPE_JSON */
 #ifndef MYSQL_TYPE_JSON
 #define MYSQL_TYPE_JSON 245
@@ -98,9 +105,10 @@ extern GString *set_session;
 extern guint num_threads;
 extern char **tables;
 extern gchar *tables_skiplist_file;
+extern gchar *trace_filename;
 
 gchar *tidb_snapshot = NULL;
-GList *no_updated_tables = NULL;
+GHashTable *no_updated_tables = NULL;
 int longquery = 60;
 int longquery_retries = 0;
 int longquery_retry_interval = 60;
@@ -125,11 +133,16 @@ gint non_innodb_table_counter = 0;
 gint non_innodb_done = 0;
 guint updated_since = 0;
 guint trx_consistency_only = 0;
+gboolean resume = FALSE;
+guint throttle_threads_running = 0;
+guint throttle_buffer_pool_reads = 0;
+guint throttle_query_latency_ms = 0;
 gchar *set_names_str=NULL;
 gchar *pmm_resolution = NULL;
 gchar *pmm_path = NULL;
 gboolean pmm = FALSE;
 GHashTable *all_anonymized_function=NULL;
+gchar *masking_key=NULL;
 GHashTable *all_where_per_table=NULL;
 guint pause_at=0;
 guint resume_at=0;
@@ -145,12 +158,21 @@ extern GAsyncQueue *start_scheduled_dump;
 extern guint errors;
 
 gchar *exec_command=NULL;
+guint exec_threads=0;
+guint exec_retries=0;
+guint exec_queue_size=0;
 
 static GOptionEntry start_dump_entries[] = {
     {"compress", 'c', 0, G_OPTION_ARG_NONE, &compress_output,
      "Compress output files", NULL},
     {"exec", 0, 0, G_OPTION_ARG_STRING, &exec_command,
       "Command to execute using the file as parameter", NULL},
+    {"exec-threads", 0, 0, G_OPTION_ARG_INT, &exec_threads,
+      "Amount of commands that --exec will run in parallel, default --threads", NULL},
+    {"exec-retries", 0, 0, G_OPTION_ARG_INT, &exec_retries,
+      "Times that --exec will retry a command that did not return 0, default 0", NULL},
+    {"exec-queue-size", 0, 0, G_OPTION_ARG_INT, &exec_queue_size,
+      "Amount of files waiting for --exec that pauses the dump, default 4 times --exec-threads", NULL},
     {"long-query-retries", 0, 0, G_OPTION_ARG_INT, &longquery_retries,
      "Retry checking for long queries, default 0 (do not retry)", NULL},
     {"long-query-retry-interval", 0, 0, G_OPTION_ARG_INT, &longquery_retry_interval,
@@ -175,6 +197,14 @@ static GOptionEntry start_dump_entries[] = {
      "Minimize locking time on InnoDB tables.", NULL},
     {"trx-consistency-only", 0, 0, G_OPTION_ARG_NONE, &trx_consistency_only,
      "Transactional consistency only", NULL},
+    {"resume", 0, 0, G_OPTION_ARG_NONE, &resume,
+     "Continue an interrupted dump in --outputdir, skipping the chunks found in its dump journal", NULL},
+    {"throttle-threads-running", 0, 0, G_OPTION_ARG_INT, &throttle_threads_running,
+     "Park threads while Threads_running on the source is over this value, default 0 (disabled)", NULL},
+    {"throttle-buffer-pool-reads", 0, 0, G_OPTION_ARG_INT, &throttle_buffer_pool_reads,
+     "Park threads while Innodb_buffer_pool_reads per second is over this value, default 0 (disabled)", NULL},
+    {"throttle-query-latency", 0, 0, G_OPTION_ARG_INT, &throttle_query_latency_ms,
+     "Park threads while the p99 latency in milliseconds of the chunk queries is over this value, default 0 (disabled)", NULL},
     {"no-schemas", 'm', 0, G_OPTION_ARG_NONE, &no_schemas,
       "Do not dump table schemas with the data and triggers", NULL},
     {"kill-long-queries", 'K', 0, G_OPTION_ARG_NONE, &killqueries,
@@ -185,6 +215,8 @@ static GOptionEntry start_dump_entries[] = {
       "which default value will be /usr/local/percona/pmm2/collectors/textfile-collector/high-resolution", NULL },
     { "pmm-resolution", 0, 0, G_OPTION_ARG_STRING, &pmm_resolution,
       "which default will be high", NULL },
+    {"masking-key", 0, 0, G_OPTION_ARG_STRING, &masking_key,
+     "Key of the hash of the masking functions, the same key gives the same masks on every dump. Default a random key", NULL},
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
 
 void load_start_dump_entries(GOptionGroup *main_group){
@@ -198,6 +230,7 @@ void initialize_start_dump(){
   initialize_common();
   initialize_working_thread();
   all_anonymized_function=g_hash_table_new ( g_str_hash, g_str_equal );
+  initialize_masquerade(masking_key);
   all_where_per_table=g_hash_table_new ( g_str_hash, g_str_equal );
 
   if (set_names_str){
@@ -236,6 +269,11 @@ void initialize_start_dump(){
     g_critical("Stream and execute a command is not supported");
     exit(EXIT_FAILURE);
   }
+
+  if (resume && (stream || daemon_mode)){
+    g_critical("--resume is not supported with --stream or --daemon");
+    exit(EXIT_FAILURE);
+  }
 }
 
 /* Write some stuff we know about snapshot, before it changes */
@@ -256,8 +294,8 @@ void write_snapshot_info(MYSQL *conn, FILE *file) {
   guint isms;
   guint i;
 
-  mysql_query(conn, "SHOW MASTER STATUS");
-  master = mysql_store_result(conn);
+  profiled_query(conn, "SHOW MASTER STATUS");
+  master = profiled_store_result(conn);
   if (master && (row = mysql_fetch_row(master))) {
     masterlog = row[0];
     masterpos = row[1];
@@ -269,8 +307,8 @@ void write_snapshot_info(MYSQL *conn, FILE *file) {
       /* Use gtid_binlog_pos due to issue with gtid_current_pos with galera
        * cluster, gtid_binlog_pos works as well with normal mariadb server
        * https://jira.mariadb.org/browse/MDEV-10279 */
-      mysql_query(conn, "SELECT @@gtid_binlog_pos");
-      mdb = mysql_store_result(conn);
+      profiled_query(conn, "SELECT @@gtid_binlog_pos");
+      mdb = profiled_store_result(conn);
       if (mdb && (row = mysql_fetch_row(mdb))) {
         mastergtid = row[0];
       }
@@ -281,11 +319,12 @@ void write_snapshot_info(MYSQL *conn, FILE *file) {
     fprintf(file, "SHOW MASTER STATUS:\n\tLog: %s\n\tPos: %s\n\tGTID:%s\n\n",
             masterlog, masterpos, mastergtid);
     g_message("Written master status");
+    dump_journal_snapshot(masterlog, masterpos, mastergtid);
   }
 
   isms = 0;
-  mysql_query(conn, "SELECT @@default_master_connection");
-  MYSQL_RES *rest = mysql_store_result(conn);
+  profiled_query(conn, "SELECT @@default_master_connection");
+  MYSQL_RES *rest = profiled_store_result(conn);
   if (rest != NULL && mysql_num_rows(rest)) {
     mysql_free_result(rest);
     g_message("Multisource slave detected.");
@@ -293,12 +332,12 @@ void write_snapshot_info(MYSQL *conn, FILE *file) {
   }
 
   if (isms)
-    mysql_query(conn, "SHOW ALL SLAVES STATUS");
+    profiled_query(conn, "SHOW ALL SLAVES STATUS");
   else
-    mysql_query(conn, "SHOW SLAVE STATUS");
+    profiled_query(conn, "SHOW SLAVE STATUS");
 
   guint slave_count=0;
-  slave = mysql_store_result(conn);
+  slave = profiled_store_result(conn);
   while (slave && (row = mysql_fetch_row(slave))) {
     fields = mysql_fetch_fields(slave);
     for (i = 0; i < mysql_num_fields(slave); i++) {
@@ -469,7 +508,7 @@ MYSQL *create_main_connection() {
   GHashTable * set_session_hash = mydumper_initialize_hash_of_session_variables();
   if (key_file != NULL ){
     load_session_hash_from_key_file(key_file,set_session_hash,"mydumper_variables");
-    load_where_per_table_and_anonymized_functions_from_key_file(key_file, all_where_per_table, all_anonymized_function, &get_function_pointer_for);
+    load_where_per_table_and_anonymized_functions_from_key_file(key_file, all_where_per_table, all_anonymized_function, &get_masking_pipeline_for);
   }
   refresh_set_session_from_hash(set_session,set_session_hash);
   execute_gstring(conn, set_session);
@@ -503,15 +542,16 @@ void get_not_updated(MYSQL *conn, FILE *file) {
                       "information_schema.TABLES WHERE TABLE_TYPE = 'BASE "
                       "TABLE' AND UPDATE_TIME < NOW() - INTERVAL %d DAY",
                       updated_since);
-  mysql_query(conn, query);
+  profiled_query(conn, query);
   g_free(query);
 
-  res = mysql_store_result(conn);
+  res = profiled_store_result(conn);
+  no_updated_tables = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
   while ((row = mysql_fetch_row(res))) {
-    no_updated_tables = g_list_prepend(no_updated_tables, row[0]);
+    g_hash_table_replace(no_updated_tables, g_ascii_strdown(row[0], -1), GINT_TO_POINTER(1));
     fprintf(file, "%s\n", row[0]);
   }
-  no_updated_tables = g_list_reverse(no_updated_tables);
+  mysql_free_result(res);
   fflush(file);
 }
 
@@ -527,14 +567,14 @@ void get_table_info_to_process_from_list(MYSQL *conn, struct configuration *conf
     query =
         g_strdup_printf("SHOW TABLE STATUS FROM %s LIKE '%s'", dt[0], dt[1]);
 
-    if (mysql_query(conn, (query))) {
+    if (profiled_query(conn, (query))) {
       g_critical("Error showing table status on: %s - Could not execute query: %s", dt[0],
                  mysql_error(conn));
       errors++;
       return;
     }
 
-    MYSQL_RES *result = mysql_store_result(conn);
+    MYSQL_RES *result = profiled_store_result(conn);
     guint ecol = -1, ccol = -1;
     determine_ecol_ccol(result, &ecol, &ccol);
 
@@ -585,12 +625,12 @@ void long_query_wait(MYSQL *conn){
   char *p3=NULL;
     while (TRUE) {
       int longquery_count = 0;
-      if (mysql_query(conn, "SHOW PROCESSLIST")) {
+      if (profiled_query(conn, "SHOW PROCESSLIST")) {
         g_warning("Could not check PROCESSLIST, no long query guard enabled: %s",
                   mysql_error(conn));
         break;
       } else {
-       MYSQL_RES *res = mysql_store_result(conn);
+       MYSQL_RES *res = profiled_store_result(conn);
         MYSQL_ROW row;
 
         /* Just in case PROCESSLIST output column order changes */
@@ -618,7 +658,7 @@ void long_query_wait(MYSQL *conn){
             continue;
           if (row[tcol] && atoi(row[tcol]) > longquery) {
             if (killqueries) {
-              if (mysql_query(conn,
+              if (profiled_query(conn,
                               p3 = g_strdup_printf("KILL %lu", atol(row[icol])))) {
                 g_warning("Could not KILL slow query: %s", mysql_error(conn));
                 longquery_count++;
@@ -655,27 +695,27 @@ void long_query_wait(MYSQL *conn){
 }
 
 void send_mariadb_backup_locks(MYSQL *conn){
-  if (mysql_query(conn, "BACKUP STAGE START")) {
+  if (profiled_query(conn, "BACKUP STAGE START")) {
     g_critical("Couldn't acquire BACKUP STAGE START: %s",
                mysql_error(conn));
     errors++;
     exit(EXIT_FAILURE);
   }
 
-  if (mysql_query(conn, "BACKUP STAGE FLUSH")) {
+  if (profiled_query(conn, "BACKUP STAGE FLUSH")) {
     g_critical("Couldn't acquire BACKUP STAGE FLUSH: %s",
                mysql_error(conn));
     errors++;
     exit(EXIT_FAILURE);
   }
-  if (mysql_query(conn, "BACKUP STAGE BLOCK_DDL")) {
+  if (profiled_query(conn, "BACKUP STAGE BLOCK_DDL")) {
     g_critical("Couldn't acquire BACKUP STAGE BLOCK_DDL: %s",
                mysql_error(conn));
     errors++;
     exit(EXIT_FAILURE);
   }
 
-  if (mysql_query(conn, "BACKUP STAGE BLOCK_COMMIT")) {
+  if (profiled_query(conn, "BACKUP STAGE BLOCK_COMMIT")) {
     g_critical("Couldn't acquire BACKUP STAGE BLOCK_COMMIT: %s",
                mysql_error(conn));
     errors++;
@@ -684,7 +724,7 @@ void send_mariadb_backup_locks(MYSQL *conn){
 }
 
 void send_percona57_backup_locks(MYSQL *conn){
-  if (mysql_query(conn, "LOCK TABLES FOR BACKUP")) {
+  if (profiled_query(conn, "LOCK TABLES FOR BACKUP")) {
     g_critical("Couldn't acquire LOCK TABLES FOR BACKUP, snapshots will "
                "not be consistent: %s",
                mysql_error(conn));
@@ -692,7 +732,7 @@ void send_percona57_backup_locks(MYSQL *conn){
     exit(EXIT_FAILURE);
   }
 
-  if (mysql_query(conn, "LOCK BINLOG FOR BACKUP")) {
+  if (profiled_query(conn, "LOCK BINLOG FOR BACKUP")) {
     g_critical("Couldn't acquire LOCK BINLOG FOR BACKUP, snapshots will "
                "not be consistent: %s",
                mysql_error(conn));
@@ -702,7 +742,7 @@ void send_percona57_backup_locks(MYSQL *conn){
 }
 
 void send_lock_instance_backup(MYSQL *conn){
-  if (mysql_query(conn, "LOCK INSTANCE FOR BACKUP")) {
+  if (profiled_query(conn, "LOCK INSTANCE FOR BACKUP")) {
     g_critical("Couldn't acquire LOCK INSTANCE FOR BACKUP: %s",
                mysql_error(conn));
     errors++;
@@ -711,24 +751,24 @@ void send_lock_instance_backup(MYSQL *conn){
 } 
 
 void send_unlock_tables(MYSQL *conn){
-  mysql_query(conn, "UNLOCK TABLES");
+  profiled_query(conn, "UNLOCK TABLES");
 }
 
 void send_unlock_binlogs(MYSQL *conn){
-  mysql_query(conn, "UNLOCK BINLOG");
+  profiled_query(conn, "UNLOCK BINLOG");
 }
 
 void send_unlock_instance_backup(MYSQL *conn){
-  mysql_query(conn, "UNLOCK INSTANCE");
+  profiled_query(conn, "UNLOCK INSTANCE");
 }
 
 void send_backup_stage_end(MYSQL *conn){
-  mysql_query(conn, "BACKUP STAGE END");
+  profiled_query(conn, "BACKUP STAGE END");
 }
 
 void determine_ddl_lock_function(MYSQL ** conn, void (**acquire_lock_function)(MYSQL *), void (** release_lock_function)(MYSQL *), void (** release_binlog_function)(MYSQL *)) {
-  mysql_query(*conn, "SELECT @@version_comment, @@version");
-  MYSQL_RES *res2 = mysql_store_result(*conn);
+  profiled_query(*conn, "SELECT @@version_comment, @@version");
+  MYSQL_RES *res2 = profiled_store_result(*conn);
   MYSQL_ROW ver;
   while ((ver = mysql_fetch_row(res2))) {
     if (g_str_has_prefix(ver[0], "Percona")){
@@ -818,12 +858,12 @@ void send_lock_all_tables(MYSQL *conn){
   }
 
   if (tables_lock == NULL && query->len > 0  ) {
-    if (mysql_query(conn, query->str)) {
+    if (profiled_query(conn, query->str)) {
       g_critical("Couldn't get table list for lock all tables: %s",
                  mysql_error(conn));
       errors++;
     } else {
-      MYSQL_RES *res = mysql_store_result(conn);
+      MYSQL_RES *res = profiled_store_result(conn);
       MYSQL_ROW row;
 
       while ((row = mysql_fetch_row(res))) {
@@ -859,7 +899,7 @@ void send_lock_all_tables(MYSQL *conn){
       }
       g_strrstr(query->str,",")[0]=' ';
 
-      if (mysql_query(conn, query->str)) {
+      if (profiled_query(conn, query->str)) {
         gchar *failed_table = NULL;
         gchar **tmp_fail;
 
@@ -927,10 +967,13 @@ void start_dump() {
   }
 
 
+  initialize_trace(trace_filename, "mydumper");
+
   GThread *pmmthread = NULL;
   if (pmm){
 
     g_message("Using PMM resolution %s at %s", pmm_resolution, pmm_path);
+    initialize_metrics(num_threads * (less_locking + 1));
     GError *serror;
     pmmthread =
         g_thread_create(pmm_thread, &conf, FALSE, &serror);
@@ -954,6 +997,9 @@ void start_dump() {
     g_critical("Couldn't write metadata file %s (%d)", metadata_partial_filename, errno);
     exit(EXIT_FAILURE);
   }
+  initialize_manifest(dump_directory);
+  if (!stream && !daemon_mode)
+    initialize_dump_journal(dump_directory);
 
   if (updated_since > 0) {
     u = g_strdup_printf("%s/not_updated_tables", dump_directory);
@@ -979,12 +1025,12 @@ void start_dump() {
       // Generate a @@tidb_snapshot to use for the worker threads since
       // the tidb-snapshot argument was not specified when starting mydumper
 
-      if (mysql_query(conn, "SHOW MASTER STATUS")) {
+      if (profiled_query(conn, "SHOW MASTER STATUS")) {
         g_critical("Couldn't generate @@tidb_snapshot: %s", mysql_error(conn));
         exit(EXIT_FAILURE);
       } else {
 
-        MYSQL_RES *result = mysql_store_result(conn);
+        MYSQL_RES *result = profiled_store_result(conn);
         MYSQL_ROW row = mysql_fetch_row(
             result); /* There should never be more than one row */
         tidb_snapshot = g_strdup(row[1]);
@@ -998,7 +1044,7 @@ void start_dump() {
 
     g_message("Set to tidb_snapshot '%s'", tidb_snapshot);
 
-    if (mysql_query(conn, query)) {
+    if (profiled_query(conn, query)) {
       g_critical("Failed to set tidb_snapshot: %s", mysql_error(conn));
       exit(EXIT_FAILURE);
     }
@@ -1015,12 +1061,14 @@ void start_dump() {
         send_lock_all_tables(conn);
       } else {
         g_message("Sending Flush Table");
-        if (mysql_query(conn, "FLUSH NO_WRITE_TO_BINLOG TABLES")) {
+        if (profiled_query(conn, "FLUSH NO_WRITE_TO_BINLOG TABLES")) {
           g_warning("Flush tables failed, we are continuing anyways: %s",
                    mysql_error(conn));
         }
         g_message("Acquiring FTWRL");
-        if (mysql_query(conn, "FLUSH TABLES WITH READ LOCK")) {
+        metrics_global_lock(TRUE);
+        trace_phase("FTWRL", TRUE);
+        if (profiled_query(conn, "FLUSH TABLES WITH READ LOCK")) {
           g_critical("Couldn't acquire global lock, snapshots will not be "
                    "consistent: %s",
                    mysql_error(conn));
@@ -1039,19 +1087,19 @@ void start_dump() {
 
 // TODO: this should be deleted on future releases. 
   if (mysql_get_server_version(conn) < 40108) {
-    mysql_query(
+    profiled_query(
         conn,
         "CREATE TABLE IF NOT EXISTS mysql.mydumperdummy (a INT) ENGINE=INNODB");
     need_dummy_read = 1;
   }
 
   // tokudb do not support consistent snapshot
-  mysql_query(conn, "SELECT @@tokudb_version");
-  MYSQL_RES *rest = mysql_store_result(conn);
+  profiled_query(conn, "SELECT @@tokudb_version");
+  MYSQL_RES *rest = profiled_store_result(conn);
   if (rest != NULL && mysql_num_rows(rest)) {
     mysql_free_result(rest);
     g_message("TokuDB detected, creating dummy table for CS");
-    mysql_query(
+    profiled_query(
         conn,
         "CREATE TABLE IF NOT EXISTS mysql.tokudbdummy (a INT) ENGINE=TokuDB");
     need_dummy_toku_read = 1;
@@ -1062,20 +1110,20 @@ void start_dump() {
   // TODO: this should be deleted as main connection is not being used for export data
   if (!lock_all_tables) {
     g_message("Sending start transaction in main connection");
-    mysql_query(conn, "START TRANSACTION /*!40108 WITH CONSISTENT SNAPSHOT */");
+    profiled_query(conn, "START TRANSACTION /*!40108 WITH CONSISTENT SNAPSHOT */");
   }
 
   if (need_dummy_read) {
-    mysql_query(conn,
+    profiled_query(conn,
                 "SELECT /*!40001 SQL_NO_CACHE */ * FROM mysql.mydumperdummy");
-    MYSQL_RES *res = mysql_store_result(conn);
+    MYSQL_RES *res = profiled_store_result(conn);
     if (res)
       mysql_free_result(res);
   }
   if (need_dummy_toku_read) {
-    mysql_query(conn,
+    profiled_query(conn,
                 "SELECT /*!40001 SQL_NO_CACHE */ * FROM mysql.tokudbdummy");
-    MYSQL_RES *res = mysql_store_result(conn);
+    MYSQL_RES *res = profiled_store_result(conn);
     if (res)
       mysql_free_result(res);
   }
@@ -1088,7 +1136,7 @@ void start_dump() {
 
   if (detected_server == SERVER_TYPE_MYSQL) {
     if (set_names_str)
-  		mysql_query(conn, set_names_str);
+  		profiled_query(conn, set_names_str);
     write_snapshot_info(conn, mdfile);
   }
 
@@ -1098,7 +1146,9 @@ void start_dump() {
   }
 
   if (exec_command != NULL){
-    initialize_exec_command();
+    if (conf.pause_resume == NULL)
+      conf.pause_resume = g_async_queue_new();
+    initialize_exec_command(conf.pause_resume);
     stream=TRUE;
   
   }
@@ -1107,7 +1157,9 @@ void start_dump() {
   struct thread_data *td =
       g_new(struct thread_data, num_threads * (less_locking + 1));
 
+  trace_phase("dump", TRUE);
   if (less_locking) {
+    trace_phase("less locking", TRUE);
     conf.queue_less_locking = g_async_queue_new();
     conf.ready_less_locking = g_async_queue_new();
     for (n = num_threads; n < num_threads * 2; n++) {
@@ -1156,20 +1208,25 @@ void start_dump() {
 
   if (trx_consistency_only) {
     g_message("Transactions started, unlocking tables");
-    mysql_query(conn, "UNLOCK TABLES /* trx-only */");
+    profiled_query(conn, "UNLOCK TABLES /* trx-only */");
+    metrics_global_lock(FALSE);
+    trace_phase("FTWRL", FALSE);
     if (release_binlog_function != NULL){
       g_message("Releasing binlog lock");
       release_binlog_function(second_conn);
     }
   }
+  if (no_locks || trx_consistency_only)
+    start_throttle();
   if (dump_tablespaces){
     create_job_to_dump_tablespaces(conn,&conf);
   }
 
+  GList *dump_databases=NULL, *l=NULL;
   if (db) {
     guint i=0;
     for (i=0;i<g_strv_length(db_items);i++){
-      create_job_to_dump_database(new_database(conn,db_items[i],TRUE), &conf, less_locking);
+      dump_databases=g_list_prepend(dump_databases, new_database(conn,db_items[i],TRUE));
       if (!no_schemas)
         create_job_to_dump_schema(db_items[i], &conf);
     }
@@ -1180,8 +1237,8 @@ void start_dump() {
   if (( db == NULL ) && ( tables == NULL )) {
     MYSQL_RES *databases;
     MYSQL_ROW row;
-    if (mysql_query(conn, "SHOW DATABASES") ||
-        !(databases = mysql_store_result(conn))) {
+    if (profiled_query(conn, "SHOW DATABASES") ||
+        !(databases = profiled_store_result(conn))) {
       g_critical("Unable to list databases: %s", mysql_error(conn));
       exit(EXIT_FAILURE);
     }
@@ -1200,13 +1257,22 @@ void start_dump() {
         }
         g_mutex_unlock(db_tmp->ad_mutex);
       }
-      create_job_to_dump_database(db_tmp, &conf, less_locking);
+      dump_databases=g_list_prepend(dump_databases, db_tmp);
     }
     mysql_free_result(databases);
   }
+  // The tables of all the databases are listed with a single query
+  dump_databases=g_list_reverse(dump_databases);
+  prefetch_table_status(conn, dump_databases);
+  for (l=dump_databases; l != NULL; l=l->next)
+    create_job_to_dump_database(l->data, &conf, less_locking);
+  g_list_free(dump_databases);
   if (database_counter > 0)
     g_mutex_lock(ready_database_dump_mutex);
-  g_list_free(no_updated_tables);
+  if (no_updated_tables){
+    g_hash_table_destroy(no_updated_tables);
+    no_updated_tables = NULL;
+  }
 
   GList *iter;
   non_innodb_table = g_list_reverse(non_innodb_table);
@@ -1264,6 +1330,7 @@ void start_dump() {
     for (n = num_threads; n < num_threads * 2; n++) {
       g_thread_join(threads[n]);
     }
+    trace_phase("less locking", FALSE);
     g_async_queue_unref(conf.queue_less_locking);
     conf.queue_less_locking=NULL;
   }
@@ -1271,12 +1338,15 @@ void start_dump() {
   if (!no_locks && !trx_consistency_only) {
     g_async_queue_pop(conf.unlock_tables);
     g_message("Non-InnoDB dump complete, unlocking tables");
-    mysql_query(conn, "UNLOCK TABLES /* FTWRL */");
+    profiled_query(conn, "UNLOCK TABLES /* FTWRL */");
+    metrics_global_lock(FALSE);
+    trace_phase("FTWRL", FALSE);
     g_message("Releasing DDL lock");
     if (release_binlog_function != NULL){
       g_message("Releasing binlog lock");
       release_binlog_function(second_conn);
     }
+    start_throttle();
   }
 
   g_message("Shutdown jobs enqueued");
@@ -1290,6 +1360,9 @@ void start_dump() {
   for (n = 0; n < num_threads; n++) {
     g_thread_join(threads[n]);
   }
+  stop_throttle();
+  print_stages();
+  trace_phase("dump", FALSE);
 
   if (release_ddl_lock_function != NULL) {
     g_message("Releasing DDL lock");
@@ -1307,6 +1380,11 @@ void start_dump() {
   }
   g_list_free(table_schemas);
   table_schemas=NULL;
+  gchar *manifest_filename = finish_manifest();
+  if (stream && manifest_filename != NULL) {
+    g_async_queue_push(stream_queue, g_strdup(manifest_filename));
+  }
+  g_free(manifest_filename);
   if (pmm){
     kill_pmm_thread();
 //    g_thread_join(pmmthread);
@@ -1328,6 +1406,8 @@ void start_dump() {
   }
   g_free(metadata_partial_filename);
   g_free(metadata_filename);
+  finish_dump_journal(errors == 0 && !shutdown_triggered);
+  finish_trace();
   g_message("Finished dump at: %s",datetimestr);
   g_free(datetimestr);
 
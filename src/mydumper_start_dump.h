@@ -74,6 +74,7 @@ struct table_job {
   char *where;
   char *order_by;
   struct db_table *dbt;
+  GString *journal_files;
 };
 
 struct tables_job {
@@ -106,8 +107,10 @@ struct db_table {
   guint64 datalength;
   guint rows;
   GMutex *rows_lock;
-  GList *anonymized_function;
+  struct masking_pipeline **masking;
+  guint masking_columns;
   gchar *where;
+  struct table_metrics *metrics;
 };
 
 struct schema_post {
@@ -0,0 +1,197 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <mysql.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "connection.h"
+#include "mydumper_start_dump.h"
+#include "mydumper_throttle.h"
+#include "query_profile.h"
+
+/* The throttle parks worker threads while the source server is busy. Every
+ * THROTTLE_INTERVAL seconds it checks Threads_running, the rate of
+ * Innodb_buffer_pool_reads and the p99 of the chunk queries latency of the
+ * interval against their --throttle-* limits. When one is over its limit,
+ * half of the threads that are running are parked, but one is always kept.
+ * When all are under 80% of their limits, one parked thread is unparked.
+ * The worker threads call throttle_wait before their next job, and wait
+ * there while fewer threads than the parked ones are waiting.
+ */
+
+#define THROTTLE_INTERVAL 2
+#define THROTTLE_MAX_LATENCIES 4096
+
+extern guint num_threads;
+extern gboolean shutdown_triggered;
+extern guint throttle_threads_running;
+extern guint throttle_buffer_pool_reads;
+extern guint throttle_query_latency_ms;
+
+static GThread *throttle_thread = NULL;
+static gboolean throttle_stop = FALSE;
+static GMutex *park_mutex = NULL;
+static GCond *park_cond = NULL;
+static guint parked = 0;
+static guint waiting = 0;
+static GMutex *latency_mutex = NULL;
+static gdouble latencies[THROTTLE_MAX_LATENCIES];
+static guint latency_count = 0;
+
+gboolean is_throttle_enabled(){
+  return throttle_threads_running > 0 || throttle_buffer_pool_reads > 0 || throttle_query_latency_ms > 0;
+}
+
+// Once the buffer is full the new latencies overwrite the old ones
+void throttle_query_latency(gdouble seconds){
+  if (latency_mutex == NULL)
+    return;
+  g_mutex_lock(latency_mutex);
+  latencies[latency_count % THROTTLE_MAX_LATENCIES] = seconds * 1000;
+  latency_count++;
+  g_mutex_unlock(latency_mutex);
+}
+
+static gint compare_latency(gconstpointer a, gconstpointer b){
+  gdouble x = *(const gdouble *)a, y = *(const gdouble *)b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static gboolean get_p99_latency(gdouble *p99){
+  gdouble sorted[THROTTLE_MAX_LATENCIES];
+  guint n;
+  g_mutex_lock(latency_mutex);
+  n = latency_count < THROTTLE_MAX_LATENCIES ? latency_count : THROTTLE_MAX_LATENCIES;
+  memcpy(sorted, latencies, n * sizeof(gdouble));
+  latency_count = 0;
+  g_mutex_unlock(latency_mutex);
+  if (n == 0)
+    return FALSE;
+  qsort(sorted, n, sizeof(gdouble), (int (*)(const void *, const void *))compare_latency);
+  *p99 = sorted[(n * 99 + 99) / 100 - 1];
+  return TRUE;
+}
+
+static gboolean get_status(MYSQL *conn, const gchar *name, guint64 *value){
+  MYSQL_RES *result = NULL;
+  MYSQL_ROW row;
+  gboolean found = FALSE;
+  gchar *query = g_strdup_printf("SHOW GLOBAL STATUS LIKE '%s'", name);
+  if (!profiled_query(conn, query) && (result = profiled_store_result(conn)) != NULL){
+    if ((row = mysql_fetch_row(result)) != NULL && row[1] != NULL){
+      *value = g_ascii_strtoull(row[1], NULL, 10);
+      found = TRUE;
+    }
+    mysql_free_result(result);
+  }
+  g_free(query);
+  return found;
+}
+
+static void park_threads(guint n){
+  g_mutex_lock(park_mutex);
+  parked += n;
+  g_mutex_unlock(park_mutex);
+}
+
+static void unpark_threads(guint n){
+  g_mutex_lock(park_mutex);
+  parked -= n;
+  g_cond_broadcast(park_cond);
+  g_mutex_unlock(park_mutex);
+}
+
+void throttle_wait(){
+  if (park_mutex == NULL)
+    return;
+  g_mutex_lock(park_mutex);
+  if (waiting < parked){
+    waiting++;
+    while (waiting <= parked)
+      g_cond_wait(park_cond, park_mutex);
+    waiting--;
+  }
+  g_mutex_unlock(park_mutex);
+}
+
+static void *throttle_source(void *data){
+  (void)data;
+  MYSQL *conn = mysql_init(NULL);
+  guint64 value = 0, reads = 0, last_reads = 0;
+  gdouble p99 = 0;
+  gboolean over, near;
+  guint n;
+  m_connect(conn, "mydumper", NULL);
+  get_status(conn, "Innodb_buffer_pool_reads", &last_reads);
+  while (!throttle_stop && !shutdown_triggered){
+    sleep(THROTTLE_INTERVAL);
+    over = FALSE;
+    near = FALSE;
+    if (throttle_threads_running > 0 && get_status(conn, "Threads_running", &value)){
+      over |= value > throttle_threads_running;
+      near |= value * 10 > throttle_threads_running * 8;
+    }
+    if (throttle_buffer_pool_reads > 0 && get_status(conn, "Innodb_buffer_pool_reads", &reads)){
+      value = (reads - last_reads) / THROTTLE_INTERVAL;
+      last_reads = reads;
+      over |= value > throttle_buffer_pool_reads;
+      near |= value * 10 > throttle_buffer_pool_reads * 8;
+    }
+    if (throttle_query_latency_ms > 0 && get_p99_latency(&p99)){
+      over |= p99 > throttle_query_latency_ms;
+      near |= p99 * 10 > throttle_query_latency_ms * 8;
+    }
+    if (over && parked < num_threads - 1){
+      n = (num_threads - parked) / 2;
+      park_threads(n);
+      g_message("Source server is busy, %u of %u threads are parked", parked, num_threads);
+    }else if (!near && parked > 0){
+      unpark_threads(1);
+      if (parked == 0)
+        g_message("All the threads are dumping again");
+    }
+  }
+  unpark_threads(parked);
+  mysql_close(conn);
+  return NULL;
+}
+
+// It is started once the tables are unlocked, parking threads while
+// FTWRL is held would make the lock last longer
+void start_throttle(){
+  GError *error = NULL;
+  if (!is_throttle_enabled() || throttle_thread != NULL)
+    return;
+  park_mutex = g_mutex_new();
+  park_cond = g_cond_new();
+  latency_mutex = g_mutex_new();
+  throttle_thread = g_thread_create((GThreadFunc)throttle_source, NULL, TRUE, &error);
+  if (throttle_thread == NULL){
+    g_critical("Could not create throttle thread: %s", error->message);
+    g_error_free(error);
+    exit(EXIT_FAILURE);
+  }
+}
+
+void stop_throttle(){
+  if (throttle_thread == NULL)
+    return;
+  throttle_stop = TRUE;
+  g_thread_join(throttle_thread);
+  throttle_thread = NULL;
+}
@@ -68,6 +68,13 @@
 #include "mydumper_database.h"
 #include "mydumper_working_thread.h"
 #include "mydumper_masquerade.h"
+#include "mydumper_manifest.h"
+#include "mydumper_journal.h"
+#include "mydumper_throttle.h"
+#include "mydumper_metrics.h"
+#include "stages.h"
+#include "trace.h"
+#include "query_profile.h"
 /* Some earlier versions of MySQL do not yet define MYSQL_TYPE_JSON */
 #ifndef MYSQL_TYPE_JSON
 #define MYSQL_TYPE_JSON 245
@@ -117,7 +124,7 @@ gboolean binlog_snapshot_gtid_executed_status = FALSE;
 guint binlog_snapshot_gtid_executed_count = 0;
 char **ignore = NULL;
 extern gchar *tidb_snapshot;
-extern GList *no_updated_tables;
+extern GHashTable *no_updated_tables;
 int skip_tz = 0;
 extern int need_dummy_read;
 extern int need_dummy_toku_read;
@@ -261,6 +268,8 @@ void load_working_thread_entries(GOptionGroup *main_group){
 }
 
 
+static const gchar *dump_stage_names[]={"query", "fetch", "format", "write", "close"};
+
 void initialize_working_thread(){
   non_innodb_table_mutex = g_mutex_new();
   innodb_tables_mutex = g_mutex_new();
@@ -361,6 +370,8 @@ void initialize_working_thread(){
   if (ignore_engines)
     ignore = g_strsplit(ignore_engines, ",", 0);
 
+  initialize_stages(dump_stage_names, G_N_ELEMENTS(dump_stage_names));
+
   if (!compress_output) {
     m_open=&g_fopen;
     m_close=(void *) &fclose;
@@ -403,6 +414,8 @@ void free_table_job(struct table_job *tj){
     g_free(tj->where);
   if (tj->order_by)
     g_free(tj->order_by);
+  if (tj->journal_files)
+    g_string_free(tj->journal_files, TRUE);
 //  if (tj->filename)
 //    g_free(tj->filename);
 //  g_free(tj);
@@ -435,12 +448,12 @@ void thd_JOB_DUMP_DATABASE(struct configuration *conf, struct thread_data *td, s
 void thd_JOB_DUMP(struct thread_data *td, struct job *job){
   struct table_job *tj = (struct table_job *)job->job_data;
   message_dumping_data(td,tj);
-  if (use_savepoints && mysql_query(td->thrconn, "SAVEPOINT mydumper")) {
+  if (use_savepoints && profiled_query(td->thrconn, "SAVEPOINT mydumper")) {
     g_critical("Savepoint failed: %s", mysql_error(td->thrconn));
   }
   write_table_job_into_file(td->thrconn, tj);
   if (use_savepoints &&
-      mysql_query(td->thrconn, "ROLLBACK TO SAVEPOINT mydumper")) {
+      profiled_query(td->thrconn, "ROLLBACK TO SAVEPOINT mydumper")) {
     g_critical("Rollback to savepoint failed: %s", mysql_error(td->thrconn));
   }
   free_table_job(tj);
@@ -469,7 +482,7 @@ void thd_JOB_LOCK_DUMP_NON_INNODB(struct configuration *conf, struct thread_data
     g_string_printf(prev_database, "%s", tj->database);
   }
   *first = 1;
-  if (mysql_query(td->thrconn, query->str)) {
+  if (profiled_query(td->thrconn, query->str)) {
     g_critical("Non Innodb lock tables fail: %s", mysql_error(td->thrconn));
     exit(EXIT_FAILURE);
   }
@@ -484,13 +497,16 @@ void thd_JOB_LOCK_DUMP_NON_INNODB(struct configuration *conf, struct thread_data
     free_table_job(tj);
     g_free(tj);
   }
-  mysql_query(td->thrconn, "UNLOCK TABLES /* Non Innodb */");
+  profiled_query(td->thrconn, "UNLOCK TABLES /* Non Innodb */");
   g_list_free(mj->table_job_list);
   g_free(mj);
   g_free(job);
 }
 
 void initialize_thread(struct thread_data *td){
+  metrics_register_thread(td->thread_id);
+  stage_register_thread(td->thread_id);
+  trace_thread_name(td->thread_id, td->less_locking_stage ? "less locking" : "worker");
   m_connect(td->thrconn, "mydumper", NULL);
   g_message("Thread %d connected using MySQL connection ID %lu",
             td->thread_id, mysql_thread_id(td->thrconn));
@@ -547,7 +563,7 @@ gboolean are_all_threads_in_same_pos(struct thread_data *td){
 }
 
 void initialize_consistent_snapshot(struct thread_data *td){
-  if ( sync_wait != -1 && mysql_query(td->thrconn, g_strdup_printf("SET SESSION WSREP_SYNC_WAIT = %d",sync_wait))){
+  if ( sync_wait != -1 && profiled_query(td->thrconn, g_strdup_printf("SET SESSION WSREP_SYNC_WAIT = %d",sync_wait))){
     g_critical("Failed to set wsrep_sync_wait for the thread: %s",
                mysql_error(td->thrconn));
     exit(EXIT_FAILURE);
@@ -559,16 +575,16 @@ void initialize_consistent_snapshot(struct thread_data *td){
 //  Uncommenting the sleep will cause inconsitent scenarios always, which is useful for debugging 
 //    sleep(td->thread_id);
     g_debug("Thread %d: Start trasaction #%d", td->thread_id, start_transaction_retry);
-    if (mysql_query(td->thrconn,
+    if (profiled_query(td->thrconn,
                   "START TRANSACTION /*!40108 WITH CONSISTENT SNAPSHOT */")) {
       g_critical("Failed to start consistent snapshot: %s", mysql_error(td->thrconn));
       exit(EXIT_FAILURE);
     }
-    if (mysql_query(td->thrconn,
+    if (profiled_query(td->thrconn,
                   "SHOW STATUS LIKE 'binlog_snapshot_gtid_executed'")) {
       g_warning("Failed to get binlog_snapshot_gtid_executed: %s", mysql_error(td->thrconn));
     }else{
-      MYSQL_RES *res = mysql_store_result(td->thrconn);
+      MYSQL_RES *res = profiled_store_result(td->thrconn);
       MYSQL_ROW row = mysql_fetch_row(res);
       if (row!=NULL)
         td->binlog_snapshot_gtid_executed=g_strdup(row[1]);
@@ -603,7 +619,7 @@ void check_connection_status(struct thread_data *td){
     // Because no locking has been used.
     gchar *query =
         g_strdup_printf("SET SESSION tidb_snapshot = '%s'", tidb_snapshot);
-    if (mysql_query(td->thrconn, query)) {
+    if (profiled_query(td->thrconn, query)) {
       g_critical("Failed to set tidb_snapshot: %s", mysql_error(td->thrconn));
       exit(EXIT_FAILURE);
     }
@@ -615,21 +631,53 @@ void check_connection_status(struct thread_data *td){
   /* Unfortunately version before 4.1.8 did not support consistent snapshot
    * transaction starts, so we cheat */
   if (need_dummy_read) {
-    mysql_query(td->thrconn,
+    profiled_query(td->thrconn,
                 "SELECT /*!40001 SQL_NO_CACHE */ * FROM mysql.mydumperdummy");
-    MYSQL_RES *res = mysql_store_result(td->thrconn);
+    MYSQL_RES *res = profiled_store_result(td->thrconn);
     if (res)
       mysql_free_result(res);
   }
   if (need_dummy_toku_read) {
-    mysql_query(td->thrconn,
+    profiled_query(td->thrconn,
                 "SELECT /*!40001 SQL_NO_CACHE */ * FROM mysql.tokudbdummy");
-    MYSQL_RES *res = mysql_store_result(td->thrconn);
+    MYSQL_RES *res = profiled_store_result(td->thrconn);
     if (res)
       mysql_free_result(res);
   }
 }
 
+static const gchar *job_type_names[]={"JOB_SHUTDOWN", "JOB_RESTORE", "JOB_DUMP", "JOB_DUMP_NON_INNODB", "JOB_CHECKSUM",
+  "JOB_SCHEMA", "JOB_VIEW", "JOB_TRIGGERS", "JOB_SCHEMA_POST", "JOB_BINLOG", "JOB_LOCK_DUMP_NON_INNODB",
+  "JOB_CREATE_DATABASE", "JOB_CREATE_TABLESPACE", "JOB_DUMP_DATABASE"};
+
+// What the job dumps, for the trace, as the job is freed by its handler
+static gchar *job_object(struct job *job){
+  struct table_job *tj=NULL;
+  switch (job->type) {
+    case JOB_DUMP:
+    case JOB_DUMP_NON_INNODB:
+      tj=(struct table_job *)job->job_data;
+      return g_strdup_printf("`%s`.`%s` chunk %u", tj->database, tj->table, tj->nchunk);
+    case JOB_CHECKSUM:
+      return g_strdup(((struct table_checksum_job *)job->job_data)->filename);
+    case JOB_SCHEMA:
+    case JOB_TRIGGERS:
+      return g_strdup(((struct schema_job *)job->job_data)->filename);
+    case JOB_VIEW:
+      return g_strdup(((struct view_job *)job->job_data)->filename);
+    case JOB_SCHEMA_POST:
+      return g_strdup(((struct schema_post_job *)job->job_data)->filename);
+    case JOB_CREATE_DATABASE:
+      return g_strdup(((struct create_database_job *)job->job_data)->filename);
+    case JOB_CREATE_TABLESPACE:
+      return g_strdup(((struct create_tablespace_job *)job->job_data)->filename);
+    case JOB_DUMP_DATABASE:
+      return g_strdup(((struct dump_database_job *)job->job_data)->database->name);
+    default:
+      return NULL;
+  }
+}
+
 void *working_thread(struct thread_data *td) {
   struct configuration *conf = td->conf;
   // mysql_init is not thread safe, especially in Connector/C
@@ -641,11 +689,11 @@ void *working_thread(struct thread_data *td) {
   execute_gstring(td->thrconn, set_session);
 
   // Initialize connection 
-  if (!skip_tz && mysql_query(td->thrconn, "/*!40103 SET TIME_ZONE='+00:00' */")) {
+  if (!skip_tz && profiled_query(td->thrconn, "/*!40103 SET TIME_ZONE='+00:00' */")) {
     g_critical("Failed to set time zone: %s", mysql_error(td->thrconn));
   }
   if (!td->less_locking_stage){
-    if (use_savepoints && mysql_query(td->thrconn, "SET SQL_LOG_BIN = 0")) {
+    if (use_savepoints && profiled_query(td->thrconn, "SET SQL_LOG_BIN = 0")) {
       g_critical("Failed to disable binlog for the thread: %s",
                  mysql_error(td->thrconn));
       exit(EXIT_FAILURE);
@@ -654,7 +702,7 @@ void *working_thread(struct thread_data *td) {
     check_connection_status(td);
   }
   if (set_names_str)
-    mysql_query(td->thrconn, set_names_str);
+    profiled_query(td->thrconn, set_names_str);
 
   g_async_queue_push(td->ready, GINT_TO_POINTER(1));
   // Thread Ready to process jobs
@@ -677,8 +725,12 @@ void *working_thread(struct thread_data *td) {
   }
 
   GMutex *resume_mutex=NULL;
+  enum job_type job_type;
+  gchar *trace_object=NULL;
+  guint64 trace_start;
 
   for (;;) {
+    throttle_wait();
     if (conf->pause_resume){
       resume_mutex = (GMutex *)g_async_queue_try_pop(conf->pause_resume);
       if (resume_mutex != NULL){
@@ -694,6 +746,9 @@ void *working_thread(struct thread_data *td) {
       continue;
     }
 
+    job_type=job->type;
+    trace_object=is_tracing() ? job_object(job) : NULL;
+    trace_start=trace_clock();
     switch (job->type) {
     case JOB_LOCK_DUMP_NON_INNODB:
       thd_JOB_LOCK_DUMP_NON_INNODB(conf, td, job, &first, prev_database, prev_table);
@@ -753,6 +808,8 @@ void *working_thread(struct thread_data *td) {
       g_critical("Something very bad happened!");
       exit(EXIT_FAILURE);
     }
+    trace_span(td->thread_id, "dump", job_type_names[job_type], trace_object, trace_start);
+    g_free(trace_object);
   }
   if (td->thrconn)
     mysql_close(td->thrconn);
@@ -771,10 +828,10 @@ GString *get_insertable_fields(MYSQL *conn, char *database, char *table) {
                       "where TABLE_SCHEMA='%s' and TABLE_NAME='%s' and extra "
                       "not like '%%VIRTUAL GENERATED%%' and extra not like '%%STORED GENERATED%%'",
                       database, table);
-  mysql_query(conn, query);
+  profiled_query(conn, query);
   g_free(query);
 
-  res = mysql_store_result(conn);
+  res = profiled_store_result(conn);
   gboolean first = TRUE;
   while ((row = mysql_fetch_row(res))) {
     if (first) {
@@ -792,39 +849,63 @@ GString *get_insertable_fields(MYSQL *conn, char *database, char *table) {
   return field_list;
 }
 
-GList *get_anonymized_function_for(MYSQL *conn, gchar *database, gchar *table){
-  // TODO #364: this is the place where we need to link the column between file loaded and dbt.
-  // Currently, we are using identity_function, which return the same data.
-  // Key: `database`.`table`.`column`
+static gboolean is_numeric_data_type(const gchar *data_type){
+  const gchar *numeric[] = {"tinyint", "smallint", "mediumint", "int", "bigint", "decimal", "float", "double", "year", NULL};
+  guint i;
+  for (i = 0; numeric[i] != NULL; i++)
+    if (!g_ascii_strcasecmp(data_type, numeric[i]))
+      return TRUE;
+  return FALSE;
+}
 
+// The pipelines of the columns of the table, in the order of the SELECT,
+// NULL when no column is masked
+static void set_masking_for(MYSQL *conn, struct db_table *dbt){
   MYSQL_RES *res = NULL;
   MYSQL_ROW row;
+  GPtrArray *masking = NULL;
+  gchar *k = g_strdup_printf("`%s`.`%s`",dbt->database->name,dbt->table);
+  GHashTable *ht = g_hash_table_lookup(all_anonymized_function,k);
+  gchar *column = NULL;
+  struct masking_pipeline *mp = NULL;
+  gboolean masked = FALSE;
+  g_free(k);
+  dbt->masking = NULL;
+  dbt->masking_columns = 0;
+  if (!ht)
+    return;
 
   gchar *query =
-      g_strdup_printf("select COLUMN_NAME from information_schema.COLUMNS "
+      g_strdup_printf("select COLUMN_NAME, EXTRA, DATA_TYPE from information_schema.COLUMNS "
                       "where TABLE_SCHEMA='%s' and TABLE_NAME='%s' ORDER BY ORDINAL_POSITION;",
-                      database, table);
-  mysql_query(conn, query);
+                      dbt->database->escaped, dbt->escaped_table);
+  profiled_query(conn, query);
   g_free(query);
+  res = profiled_store_result(conn);
+  if (res == NULL)
+    return;
 
-  GList *anonymized_function_list=NULL;
-  res = mysql_store_result(conn);
-  gchar * k = g_strdup_printf("`%s`.`%s`",database,table);
-  GHashTable *ht = g_hash_table_lookup(all_anonymized_function,k);
-  fun_ptr2 f;
-  if (ht){
-    while ((row = mysql_fetch_row(res))) {
-      f=(fun_ptr2)g_hash_table_lookup(ht,row[0]);
-      if (f  != NULL){
-        anonymized_function_list=g_list_append(anonymized_function_list,f);
-      }else{
-        anonymized_function_list=g_list_append(anonymized_function_list,&identity_function);
-      }
+  masking = g_ptr_array_new();
+  while ((row = mysql_fetch_row(res))) {
+    // The generated columns are not in the SELECT
+    if (dbt->has_generated_fields && row[1] != NULL && strstr(row[1], "GENERATED") && !strstr(row[1], "DEFAULT_GENERATED"))
+      continue;
+    column = g_strdup_printf("`%s`", row[0]);
+    mp = g_hash_table_lookup(ht, column);
+    if (mp != NULL && row[2] != NULL && is_numeric_data_type(row[2]) && !masking_pipeline_is_numeric(mp)) {
+      g_critical("Column %s of `%s`.`%s` is %s, it can not be masked with functions that return letters like hash, string or email",
+                 column, dbt->database->name, dbt->table, row[2]);
+      exit(EXIT_FAILURE);
     }
+    g_ptr_array_add(masking, mp);
+    masked = masked || mp != NULL;
+    g_free(column);
   }
   mysql_free_result(res);
-  g_free(k);
-  return anonymized_function_list;
+  dbt->masking_columns = masking->len;
+  dbt->masking = (struct masking_pipeline **)g_ptr_array_free(masking, !masked);
+  if (!masked)
+    dbt->masking_columns = 0;
 }
 
 gboolean detect_generated_fields(MYSQL *conn, gchar *database, gchar* table) {
@@ -840,10 +921,10 @@ gboolean detect_generated_fields(MYSQL *conn, gchar *database, gchar* table) {
       "TABLE_SCHEMA='%s' and TABLE_NAME='%s' and extra like '%%GENERATED%%' and extra not like '%%DEFAULT_GENERATED%%'",
       database, table);
 
-  mysql_query(conn, query);
+  profiled_query(conn, query);
   g_free(query);
 
-  res = mysql_store_result(conn);
+  res = profiled_store_result(conn);
   if (res == NULL){
     return FALSE;
   }
@@ -863,7 +944,6 @@ struct db_table *new_db_table( MYSQL *conn, struct database *database, char *tab
   dbt->table_filename = get_ref_table(dbt->table);
   dbt->rows_lock= g_mutex_new();
   dbt->escaped_table = escape_string(conn,dbt->table);
-  dbt->anonymized_function=get_anonymized_function_for(conn, dbt->database->name, dbt->table);
   gchar * k = g_strdup_printf("`%s`.`%s`",dbt->database->name,dbt->table);
   dbt->where=g_hash_table_lookup(all_where_per_table, k);
   g_free(k);
@@ -873,12 +953,14 @@ struct db_table *new_db_table( MYSQL *conn, struct database *database, char *tab
   } else {
     dbt->select_fields = g_string_new("*");
   }
+  set_masking_for(conn, dbt);
 
   dbt->rows=0;
   if (!datalength)
     dbt->datalength = 0;
   else
     dbt->datalength = g_ascii_strtoull(datalength, NULL, 10);
+  dbt->metrics = metrics_new_table(database->name, dbt->table, dbt->datalength);
   return dbt; 
 }
 
@@ -928,7 +1010,7 @@ void new_table_to_dump(MYSQL *conn, struct configuration *conf, gboolean is_view
 
 gboolean determine_if_schema_is_elected_to_dump_post(MYSQL *conn, struct database *database){
   char *query;
-  MYSQL_RES *result = mysql_store_result(conn);
+  MYSQL_RES *result = profiled_store_result(conn);
   MYSQL_ROW row;
   // Store Procedures and Events
   // As these are not attached to tables we need to define when we need to dump
@@ -942,14 +1024,14 @@ gboolean determine_if_schema_is_elected_to_dump_post(MYSQL *conn, struct databas
   if (dump_routines) {
     // SP
     query = g_strdup_printf("SHOW PROCEDURE STATUS WHERE CAST(Db AS BINARY) = '%s'", database->escaped);
-    if (mysql_query(conn, (query))) {
+    if (profiled_query(conn, (query))) {
       g_critical("Error showing procedure on: %s - Could not execute query: %s", database->name,
                  mysql_error(conn));
       errors++;
       g_free(query);
       return FALSE;
     }
-    result = mysql_store_result(conn);
+    result = profiled_store_result(conn);
     while ((row = mysql_fetch_row(result)) && !post_dump) {
       /* Checks skip list on 'database.sp' string */
       if (tables_skiplist_file && check_skiplist(database->name, row[1]))
@@ -965,14 +1047,14 @@ gboolean determine_if_schema_is_elected_to_dump_post(MYSQL *conn, struct databas
     if (!post_dump) {
       // FUNCTIONS
       query = g_strdup_printf("SHOW FUNCTION STATUS WHERE CAST(Db AS BINARY) = '%s'", database->escaped);
-      if (mysql_query(conn, (query))) {
+      if (profiled_query(conn, (query))) {
         g_critical("Error showing function on: %s - Could not execute query: %s", database->name,
                    mysql_error(conn));
         errors++;
         g_free(query);
         return FALSE;
       }
-      result = mysql_store_result(conn);
+      result = profiled_store_result(conn);
       while ((row = mysql_fetch_row(result)) && !post_dump) {
         /* Checks skip list on 'database.sp' string */
         if (tables_skiplist_file && check_skiplist(database->name, row[1]))
@@ -990,14 +1072,14 @@ gboolean determine_if_schema_is_elected_to_dump_post(MYSQL *conn, struct databas
   if (dump_events && !post_dump) {
     // EVENTS
     query = g_strdup_printf("SHOW EVENTS FROM `%s`", database->name);
-    if (mysql_query(conn, (query))) {
+    if (profiled_query(conn, (query))) {
       g_critical("Error showing events on: %s - Could not execute query: %s", database->name,
                  mysql_error(conn));
       errors++;
       g_free(query);
       return FALSE;
     }
-    result = mysql_store_result(conn);
+    result = profiled_store_result(conn);
     while ((row = mysql_fetch_row(result)) && !post_dump) {
       /* Checks skip list on 'database.sp' string */
       if (tables_skiplist_file && check_skiplist(database->name, row[1]))
@@ -1013,131 +1095,248 @@ gboolean determine_if_schema_is_elected_to_dump_post(MYSQL *conn, struct databas
   return post_dump;
 }
 
-void dump_database_thread(MYSQL *conn, struct configuration *conf, struct database *database) {
+/* Same columns than SHOW TABLE STATUS up to Data_length, plus Comment and
+ * the schema, but the views and the ignored engines are filtered by the
+ * server, which saves sending and checking the rows of the tables that are
+ * not going to be dumped on schemas with lots of them */
+static gchar *build_table_status_query(MYSQL *conn, GList *databases){
+  GString *query = g_string_new("SELECT TABLE_NAME AS `Name`, ENGINE AS `Engine`, "
+      "VERSION AS `Version`, ROW_FORMAT AS `Row_format`, TABLE_ROWS AS `Rows`, "
+      "AVG_ROW_LENGTH AS `Avg_row_length`, DATA_LENGTH AS `Data_length`, "
+      "TABLE_COMMENT AS `Comment`, TABLE_SCHEMA FROM information_schema.TABLES WHERE TABLE_SCHEMA IN (");
+  gchar *escaped = NULL;
+  GList *l = NULL;
+  guint i = 0;
+  for (l = databases; l != NULL; l = l->next)
+    g_string_append_printf(query, "%s'%s'", l != databases ? "," : "", ((struct database *)l->data)->escaped);
+  g_string_append_c(query, ')');
+  if (no_dump_views)
+    g_string_append(query, " AND TABLE_TYPE != 'VIEW'");
+  if (ignore && ignore[0] != NULL) {
+    g_string_append(query, " AND (ENGINE IS NULL OR ENGINE NOT IN (");
+    for (i = 0; ignore[i] != NULL; i++) {
+      escaped = g_new(gchar, strlen(ignore[i]) * 2 + 1);
+      mysql_real_escape_string(conn, escaped, ignore[i], strlen(ignore[i]));
+      g_string_append_printf(query, "%s'%s'", i > 0 ? "," : "", escaped);
+      g_free(escaped);
+    }
+    g_string_append(query, "))");
+  }
+  g_string_append(query, " ORDER BY TABLE_SCHEMA, TABLE_NAME");
+  return g_string_free(query, FALSE);
+}
 
-  char *query;
-  mysql_select_db(conn, database->name);
-  if (detected_server == SERVER_TYPE_MYSQL ||
-      detected_server == SERVER_TYPE_TIDB)
-    query = g_strdup("SHOW TABLE STATUS");
-  else
-    query =
-        g_strdup_printf("SELECT TABLE_NAME, ENGINE, TABLE_TYPE as COMMENT FROM "
-                        "DATA_DICTIONARY.TABLES WHERE TABLE_SCHEMA='%s'",
-                        database->escaped);
+// Columns of build_table_status_query before TABLE_SCHEMA
+#define TABLE_STATUS_COLUMNS 8
 
-  if (mysql_query(conn, (query))) {
-      g_critical("Error showing tables on: %s - Could not execute query: %s", database->name,
-               mysql_error(conn));
-    errors++;
+static guint table_status_ecol = 0;
+static guint table_status_ccol = 0;
+
+static void free_table_status_row(gchar **row){
+  guint i;
+  for (i = 0; i < TABLE_STATUS_COLUMNS; i++)
+    g_free(row[i]);
+  g_free(row);
+}
+
+/* On MySQL, the tables of all the databases are listed with one query
+ * instead of one per database, and the rows are kept in the table_status
+ * of their database until its JOB_DUMP_DATABASE processes them. The
+ * databases that are not listed here run their own query */
+void prefetch_table_status(MYSQL *conn, GList *databases){
+  GHashTable *by_name = NULL, *by_lower_name = NULL;
+  GList *l = NULL;
+  struct database *database = NULL;
+  MYSQL_RES *result = NULL;
+  MYSQL_ROW row;
+  gchar **copy = NULL, *lower = NULL;
+  gchar *query = NULL;
+  guint i;
+  if (detected_server != SERVER_TYPE_MYSQL || databases == NULL)
+    return;
+  query = build_table_status_query(conn, databases);
+  if (profiled_query(conn, query) || !(result = profiled_store_result(conn))) {
+    g_warning("Could not list the tables of all the databases, they will be listed one database at a time: %s", mysql_error(conn));
     g_free(query);
     return;
   }
-
-  MYSQL_RES *result = mysql_store_result(conn);
-  guint ecol = -1;
-  guint ccol = -1;
-  determine_ecol_ccol(result, &ecol, &ccol);
-  if (!result) {
-    g_critical("Could not list tables for %s: %s", database->name, mysql_error(conn));
-    errors++;
-    return;
+  g_free(query);
+  determine_ecol_ccol(result, &table_status_ecol, &table_status_ccol);
+  by_name = g_hash_table_new(g_str_hash, g_str_equal);
+  by_lower_name = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  for (l = databases; l != NULL; l = l->next) {
+    database = l->data;
+    database->table_status = g_ptr_array_new();
+    g_hash_table_insert(by_name, database->name, database);
+    g_hash_table_insert(by_lower_name, g_ascii_strdown(database->name, -1), database);
   }
-  guint i=0;
-  MYSQL_ROW row;
+  // The names given with --database might not have the case of the server
   while ((row = mysql_fetch_row(result))) {
-
-    int dump = 1;
-    int is_view = 0;
-
-    /* We now do care about views!
-            num_fields>1 kicks in only in case of 5.0 SHOW FULL TABLES or SHOW
-       TABLE STATUS row[1] == NULL if it is a view in 5.0 'SHOW TABLE STATUS'
-            row[1] == "VIEW" if it is a view in 5.0 'SHOW FULL TABLES'
-    */
-    if ((detected_server == SERVER_TYPE_MYSQL) &&
-        (row[ccol] == NULL || !strcmp(row[ccol], "VIEW")))
-      is_view = 1;
-
-    /* Check for broken tables, i.e. mrg with missing source tbl */
-    if (!is_view && row[ecol] == NULL) {
-      g_warning("Broken table detected, please review: %s.%s", database->name,
-                row[0]);
-      if (exit_if_broken_table_found)
-        exit(EXIT_FAILURE);
-      dump = 0;
+    database = g_hash_table_lookup(by_name, row[TABLE_STATUS_COLUMNS]);
+    if (database == NULL) {
+      lower = g_ascii_strdown(row[TABLE_STATUS_COLUMNS], -1);
+      database = g_hash_table_lookup(by_lower_name, lower);
+      g_free(lower);
     }
+    if (database == NULL)
+      continue;
+    copy = g_new(gchar *, TABLE_STATUS_COLUMNS);
+    for (i = 0; i < TABLE_STATUS_COLUMNS; i++)
+      copy[i] = g_strdup(row[i]);
+    g_ptr_array_add(database->table_status, copy);
+  }
+  mysql_free_result(result);
+  g_hash_table_destroy(by_name);
+  g_hash_table_destroy(by_lower_name);
+}
 
-    /* Skip ignored engines, handy for avoiding Merge, Federated or Blackhole
-     * :-) dumps */
-    if (dump && ignore && !is_view) {
-      for (i = 0; ignore[i] != NULL; i++) {
-        if (g_ascii_strcasecmp(ignore[i], row[ecol]) == 0) {
-          dump = 0;
-          break;
-        }
+/* The keys of no_updated_tables are lowercase, as the comparison has always
+ * been case insensitive */
+static gboolean is_not_updated(char *database, char *table){
+  gchar buffer[DBT_KEY_SIZE];
+  gchar *k = build_dbt_key(buffer, sizeof(buffer), database, table), *c;
+  gboolean b;
+  for (c = k; *c != '\0'; c++)
+    *c = g_ascii_tolower(*c);
+  b = g_hash_table_lookup(no_updated_tables, k) != NULL;
+  if (k != buffer)
+    g_free(k);
+  return b;
+}
+
+static void dump_table_status_row(MYSQL *conn, struct configuration *conf, struct database *database, MYSQL_ROW row, guint ecol, guint ccol){
+  guint i=0;
+  int dump = 1;
+  int is_view = 0;
+
+  /* We now do care about views!
+          num_fields>1 kicks in only in case of 5.0 SHOW FULL TABLES or SHOW
+     TABLE STATUS row[1] == NULL if it is a view in 5.0 'SHOW TABLE STATUS'
+          row[1] == "VIEW" if it is a view in 5.0 'SHOW FULL TABLES'
+  */
+  if ((detected_server == SERVER_TYPE_MYSQL) &&
+      (row[ccol] == NULL || !strcmp(row[ccol], "VIEW")))
+    is_view = 1;
+
+  /* Check for broken tables, i.e. mrg with missing source tbl */
+  if (!is_view && row[ecol] == NULL) {
+    g_warning("Broken table detected, please review: %s.%s", database->name,
+              row[0]);
+    if (exit_if_broken_table_found)
+      exit(EXIT_FAILURE);
+    dump = 0;
+  }
+
+  /* Skip ignored engines, handy for avoiding Merge, Federated or Blackhole
+   * :-) dumps */
+  if (dump && ignore && !is_view) {
+    for (i = 0; ignore[i] != NULL; i++) {
+      if (g_ascii_strcasecmp(ignore[i], row[ecol]) == 0) {
+        dump = 0;
+        break;
       }
     }
+  }
 
-    /* Skip views */
-    if (is_view && no_dump_views)
-      dump = 0;
+  /* Skip views */
+  if (is_view && no_dump_views)
+    dump = 0;
 
-    if (!dump)
-      continue;
+  if (!dump)
+    return;
 
-    /* In case of table-list option is enabled, check if table is part of the
-     * list */
-    if (tables) {
+  /* In case of table-list option is enabled, check if table is part of the
+   * list */
+  if (tables) {
 /*      int table_found = 0;
-      for (i = 0; tables[i] != NULL; i++)
-        if (g_ascii_strcasecmp(tables[i], row[0]) == 0)
-          table_found = 1;
+    for (i = 0; tables[i] != NULL; i++)
+      if (g_ascii_strcasecmp(tables[i], row[0]) == 0)
+        table_found = 1;
 */
-      if (!is_table_in_list(row[0], tables))
-        dump = 0;
-    }
-    if (!dump)
-      continue;
-
-    /* Special tables */
-    if (g_ascii_strcasecmp(database->name, "mysql") == 0 &&
-        (g_ascii_strcasecmp(row[0], "general_log") == 0 ||
-         g_ascii_strcasecmp(row[0], "slow_log") == 0 ||
-         g_ascii_strcasecmp(row[0], "innodb_index_stats") == 0 ||
-         g_ascii_strcasecmp(row[0], "innodb_table_stats") == 0)) {
+    if (!is_table_in_list(row[0], tables))
       dump = 0;
-      continue;
-    }
+  }
+  if (!dump)
+    return;
 
-    /* Checks skip list on 'database.table' string */
-    if (tables_skiplist_file && check_skiplist(database->name, row[0]))
-      continue;
+  /* Special tables */
+  if (g_ascii_strcasecmp(database->name, "mysql") == 0 &&
+      (g_ascii_strcasecmp(row[0], "general_log") == 0 ||
+       g_ascii_strcasecmp(row[0], "slow_log") == 0 ||
+       g_ascii_strcasecmp(row[0], "innodb_index_stats") == 0 ||
+       g_ascii_strcasecmp(row[0], "innodb_table_stats") == 0)) {
+    return;
+  }
 
-    /* Checks PCRE expressions on 'database.table' string */
-    if (!eval_regex(database->name, row[0]))
-      continue;
+  /* Checks skip list on 'database.table' string */
+  if (tables_skiplist_file && check_skiplist(database->name, row[0]))
+    return;
 
-    /* Check if the table was recently updated */
-    if (no_updated_tables && !is_view) {
-      GList *iter;
-      for (iter = no_updated_tables; iter != NULL; iter = iter->next) {
-        if (g_ascii_strcasecmp(
-                iter->data, g_strdup_printf("%s.%s", database->name, row[0])) == 0) {
-          g_message("NO UPDATED TABLE: %s.%s", database->name, row[0]);
-          dump = 0;
-        }
-      }
-    }
+  /* Checks PCRE expressions on 'database.table' string */
+  if (!eval_regex(database->name, row[0]))
+    return;
 
-    if (!dump)
-      continue;
+  /* Check if the table was recently updated */
+  if (no_updated_tables && !is_view && is_not_updated(database->name, row[0])) {
+    g_message("NO UPDATED TABLE: %s.%s", database->name, row[0]);
+    dump = 0;
+  }
 
-    new_table_to_dump(conn, conf, is_view, database, row[0], row[6], row[ecol]);
+  if (!dump)
+    return;
 
-  }
+  new_table_to_dump(conn, conf, is_view, database, row[0], row[6], row[ecol]);
+}
 
-  mysql_free_result(result);
+void dump_database_thread(MYSQL *conn, struct configuration *conf, struct database *database) {
+
+  char *query;
+  guint i=0;
+  mysql_select_db(conn, database->name);
+  if (database->table_status != NULL) {
+    for (i = 0; i < database->table_status->len; i++) {
+      dump_table_status_row(conn, conf, database, g_ptr_array_index(database->table_status, i), table_status_ecol, table_status_ccol);
+      free_table_status_row(g_ptr_array_index(database->table_status, i));
+    }
+    g_ptr_array_free(database->table_status, TRUE);
+    database->table_status = NULL;
+  } else {
+    if (detected_server == SERVER_TYPE_MYSQL) {
+      GList *databases = g_list_prepend(NULL, database);
+      query = build_table_status_query(conn, databases);
+      g_list_free(databases);
+    } else if (detected_server == SERVER_TYPE_TIDB)
+      query = g_strdup("SHOW TABLE STATUS");
+    else
+      query =
+          g_strdup_printf("SELECT TABLE_NAME, ENGINE, TABLE_TYPE as COMMENT FROM "
+                          "DATA_DICTIONARY.TABLES WHERE TABLE_SCHEMA='%s'",
+                          database->escaped);
+
+    if (profiled_query(conn, (query))) {
+        g_critical("Error showing tables on: %s - Could not execute query: %s", database->name,
+                 mysql_error(conn));
+      errors++;
+      g_free(query);
+      return;
+    }
+
+    MYSQL_RES *result = profiled_store_result(conn);
+    guint ecol = -1;
+    guint ccol = -1;
+    determine_ecol_ccol(result, &ecol, &ccol);
+    if (!result) {
+      g_critical("Could not list tables for %s: %s", database->name, mysql_error(conn));
+      errors++;
+      return;
+    }
+    MYSQL_ROW row;
+    while ((row = mysql_fetch_row(result)))
+      dump_table_status_row(conn, conf, database, row, ecol, ccol);
+
+    mysql_free_result(result);
+    g_free(query);
+  }
 
   if (determine_if_schema_is_elected_to_dump_post(conn,database)) {
     create_job_to_dump_post(database, conf);
@@ -1146,12 +1345,14 @@ void dump_database_thread(MYSQL *conn, struct configuration *conf, struct databa
 //    schema_post = g_list_prepend(schema_post, sp);
   }
 
-  g_free(query);
-
   return;
 }
 
 void write_table_job_into_file(MYSQL *conn, struct table_job *tj) {
+  if (dump_journal_is_done(tj)){
+    g_message("Skipping chunk %u of `%s`.`%s` as it was dumped by the interrupted run", tj->nchunk, tj->database, tj->table);
+    return;
+  }
   guint64 rows_count =
       write_table_data_into_file(conn, tj);
 
@@ -1184,6 +1385,7 @@ gboolean write_data(FILE *file, GString *data) {
   size_t written = 0;
   ssize_t r = 0;
   gboolean second_write_zero = FALSE;
+  guint64 stage_start = stage_clock();
   while (written < data->len) {
     r=m_write(file, data->str + written, data->len);
     if (r < 0) {
@@ -1203,7 +1405,8 @@ gboolean write_data(FILE *file, GString *data) {
     }
     written += r;
   }
-
+  stage_end(DUMP_STAGE_WRITE, stage_start);
+  trace_bytes(data->len);
   return TRUE;
 }
 
@@ -1240,29 +1443,29 @@ void initialize_sql_statement(GString *statement){
   }
 }
 
-void write_column_into_string( MYSQL *conn, gchar **column, MYSQL_FIELD field, gulong length,GString *escaped, GString *statement_row, gchar * (*fun_ptr_i)(gchar **)){
+void write_column_into_string( MYSQL *conn, gchar *column, MYSQL_FIELD field, gulong length,GString *escaped, GString *statement_row){
   if (load_data){
-    if (!*column) {
+    if (!column) {
       g_string_append(statement_row, "\\N");
     }else if (field.type != MYSQL_TYPE_LONG && field.type != MYSQL_TYPE_LONGLONG  && field.type != MYSQL_TYPE_INT24  && field.type != MYSQL_TYPE_SHORT ){
       g_string_append(statement_row,fields_enclosed_by);
       g_string_set_size(escaped, length * 2 + 1);
-      mysql_real_escape_string(conn, escaped->str, fun_ptr_i(column), length);
+      mysql_real_escape_string(conn, escaped->str, column, length);
       g_string_append(statement_row,escaped->str);
       g_string_append(statement_row,fields_enclosed_by);
     }else
-      g_string_append(statement_row, fun_ptr_i(column));
+      g_string_append(statement_row, column);
   }else{
     /* Don't escape safe formats, saves some time */
-    if (!*column) {
+    if (!column) {
       g_string_append(statement_row, "NULL");
     } else if (field.flags & NUM_FLAG) {
-      g_string_append(statement_row, fun_ptr_i(column));
+      g_string_append(statement_row, column);
     } else {
       /* We reuse buffers for string escaping, growing is expensive just at
        * the beginning */
       g_string_set_size(escaped, length * 2 + 1);
-      mysql_real_escape_string(conn, escaped->str, fun_ptr_i(column), length);
+      mysql_real_escape_string(conn, escaped->str, column, length);
       if (field.type == MYSQL_TYPE_JSON)
         g_string_append(statement_row, "CONVERT(");
       g_string_append_c(statement_row, '\"');
@@ -1276,15 +1479,15 @@ void write_column_into_string( MYSQL *conn, gchar **column, MYSQL_FIELD field, g
 
 void write_row_into_string(MYSQL *conn, struct db_table * dbt, MYSQL_ROW row, MYSQL_FIELD *fields, gulong *lengths, guint num_fields, GString *escaped, GString *statement_row){
   guint i = 0;
+  gchar *column = NULL;
+  gulong length = 0;
   g_string_append(statement_row, lines_starting_by);
-  GList *f = dbt->anonymized_function;
-    gchar * (*fun_ptr_i)(gchar **) = &identity_function;
     for (i = 0; i < num_fields; i++) {
-      if (f){
-        fun_ptr_i=f->data;
-        f=f->next;
-      }
-      write_column_into_string( conn, &(row[i]), fields[i], lengths[i], escaped, statement_row, fun_ptr_i);
+      column = row[i];
+      length = lengths[i];
+      if (column && i < dbt->masking_columns && dbt->masking[i])
+        column = mask_value(dbt->masking[i], column, &length);
+      write_column_into_string( conn, column, fields[i], length, escaped, statement_row);
       if (i < num_fields - 1) {
         g_string_append(statement_row, fields_terminated_by);
       }
@@ -1292,9 +1495,54 @@ void write_row_into_string(MYSQL *conn, struct db_table * dbt, MYSQL_ROW row, MY
     g_string_append_printf(statement_row,"%s", lines_terminated_by);
 }
 
-guint64 write_row_into_file_in_load_data_mode(MYSQL *conn, MYSQL_RES *result, struct db_table * dbt, guint nchunk){
+// The manifest line of a data file is also kept in the chunk for the dump journal
+static void append_data_file(struct table_job *tj, const gchar *filename, const gchar *type, guint part, guint sub_part, guint64 rows, guint32 crc){
+  const gchar *key_range = tj->where ? tj->where : tj->partition;
+  gchar *line = manifest_line(filename, type, tj->dbt->database->filename, tj->dbt->table_filename, part, sub_part, rows, crc, key_range);
+  manifest_append_line(line);
+  dump_journal_add_file(tj, line);
+  g_free(line);
+}
+
+// The rows are fetched and formatted one by one, so only one of every
+// STAGE_SAMPLE is timed
+static MYSQL_ROW fetch_row(MYSQL_RES *result, guint64 *calls){
+  guint64 stage_start = stage_sample(calls);
+  MYSQL_ROW row = mysql_fetch_row(result);
+  stage_end_sampled(DUMP_STAGE_FETCH, stage_start);
+  return row;
+}
+
+static void format_row(MYSQL *conn, struct db_table *dbt, MYSQL_ROW row, MYSQL_FIELD *fields, gulong *lengths, guint num_fields, GString *escaped, GString *statement_row, guint64 *calls){
+  guint64 stage_start = stage_sample(calls);
+  write_row_into_string(conn, dbt, row, fields, lengths, num_fields, escaped, statement_row);
+  stage_end_sampled(DUMP_STAGE_FORMAT, stage_start);
+}
+
+static void close_data_file(void *file){
+  guint64 stage_start = stage_clock();
+  m_close(file);
+  stage_end(DUMP_STAGE_CLOSE, stage_start);
+}
+
+static void close_load_data_files(struct table_job *tj, guint sub_part, guint64 file_rows, FILE *sql_file, gchar *sql_fn, guint32 sql_crc, FILE *load_data_file, gchar *load_data_fn, guint32 load_data_crc){
+  close_data_file(sql_file);
+  close_data_file(load_data_file);
+  metrics_file_closed(tj->dbt->metrics, sql_fn);
+  metrics_file_closed(tj->dbt->metrics, load_data_fn);
+  append_data_file(tj, sql_fn, "data", tj->nchunk, sub_part, file_rows, sql_crc);
+  append_data_file(tj, load_data_fn, "load-data", tj->nchunk, sub_part, file_rows, load_data_crc);
+  if (stream) {
+    g_async_queue_push(stream_queue, g_strdup(sql_fn));
+    g_async_queue_push(stream_queue, g_strdup(load_data_fn));
+  }
+}
+
+guint64 write_row_into_file_in_load_data_mode(MYSQL *conn, MYSQL_RES *result, struct table_job *tj, gboolean *write_failed){
+  struct db_table *dbt = tj->dbt;
   guint num_fields = mysql_num_fields(result);
   guint64 num_rows=0;
+  guint64 file_rows=0;
   GString *escaped = g_string_sized_new(3000);
   MYSQL_FIELD *fields = mysql_fetch_fields(result);
   MYSQL_ROW row;
@@ -1306,106 +1554,114 @@ guint64 write_row_into_file_in_load_data_mode(MYSQL *conn, MYSQL_RES *result, st
   FILE *load_data_file = NULL;
   gchar * sql_fn = NULL;
   gchar * load_data_fn = NULL;
+  uLong sql_crc = 0, load_data_crc = 0;
   gboolean first_time = TRUE;
-  while ((row = mysql_fetch_row(result))) {
+  guint64 reported_rows = 0;
+  guint64 fetch_calls = 0, format_calls = 0;
+  while ((row = fetch_row(result, &fetch_calls))) {
     gulong *lengths = mysql_fetch_lengths(result);
     num_rows++;
     if ((chunk_filesize &&
         (guint)ceil((float)filesize / 1024 / 1024) >
             chunk_filesize) || first_time) {
-      load_data_fn=build_filename(dbt->database->filename, dbt->table_filename, nchunk, sub_part, "dat");
-      sql_fn = build_data_filename(dbt->database->filename, dbt->table_filename, nchunk, sub_part);
+      if (!first_time){
+        if (statement->len > 0){
+          if (!write_data(load_data_file, statement)) {
+            g_critical("Could not write out data for %s.%s", dbt->database->name, dbt->table);
+            errors++;
+            *write_failed = TRUE;
+            return num_rows;
+          }
+          load_data_crc = crc32(load_data_crc, (const Bytef *)statement->str, statement->len);
+          metrics_data_written(dbt->metrics, num_rows - reported_rows, statement->len);
+          reported_rows = num_rows;
+          g_string_set_size(statement, 0);
+        }
+        close_load_data_files(tj, sub_part - 1, file_rows, sql_file, sql_fn, sql_crc, load_data_file, load_data_fn, load_data_crc);
+        g_free(sql_fn);
+        g_free(load_data_fn);
+      }
+      load_data_fn=build_filename(dbt->database->filename, dbt->table_filename, tj->nchunk, sub_part, "dat");
+      sql_fn = build_data_filename(dbt->database->filename, dbt->table_filename, tj->nchunk, sub_part);
       char * basename=g_path_get_basename(load_data_fn);
       initialize_sql_statement(statement);
       initialize_load_data_statement(statement, dbt->table, basename, fields, num_fields);
       g_free(basename);
       if (!compress_output) {
-        if (!first_time){
-          fclose((FILE *)sql_file);
-          fclose((FILE *)load_data_file);
-          if (stream) {
-            g_async_queue_push(stream_queue, g_strdup(sql_fn));
-            g_async_queue_push(stream_queue, g_strdup(load_data_fn));
-          }
-        }
-        sql_file = g_fopen(sql_fn, "a");
+        sql_file = g_fopen(sql_fn, "w");
         if (!sql_file){
           g_critical("Could not open file: %s", sql_fn);
           exit(EXIT_FAILURE);
         }
-        load_data_file = g_fopen(load_data_fn, "a");
+        load_data_file = g_fopen(load_data_fn, "w");
         if (!load_data_file){
           g_critical("Could not open file: %s", load_data_fn);
           exit(EXIT_FAILURE);
         }
       } else {
-        if (!first_time){
-          gzclose((gzFile)sql_file);
-          gzclose((gzFile)load_data_file);
-          if (stream) {
-            g_async_queue_push(stream_queue, g_strdup(sql_fn));
-            g_async_queue_push(stream_queue, g_strdup(load_data_fn));
-          }
-        }
-        load_data_file = (void *)gzopen(load_data_fn, "a");
-        sql_file = (void *)gzopen(sql_fn, "a");
+        load_data_file = (void *)gzopen(load_data_fn, "w");
+        sql_file = (void *)gzopen(sql_fn, "w");
       }
       if (!write_data(sql_file, statement)) {
         g_critical("Could not write out data for %s.%s", dbt->database->name, dbt->table);
+        errors++;
+        *write_failed = TRUE;
         return num_rows;
       }
+      sql_crc = crc32(crc32(0L, Z_NULL, 0), (const Bytef *)statement->str, statement->len);
+      load_data_crc = crc32(0L, Z_NULL, 0);
       g_string_set_size(statement, 0);
       filesize=0;
+      file_rows=0;
       first_time=FALSE;
       sub_part++;
     }
     g_string_set_size(statement_row, 0);
-    write_row_into_string(conn, dbt, row, fields, lengths, num_fields, escaped, statement_row);
+    format_row(conn, dbt, row, fields, lengths, num_fields, escaped, statement_row, &format_calls);
     filesize+=statement_row->len+1;
+    file_rows++;
     g_string_append(statement, statement_row->str);
     /* INSERT statement is closed before over limit but this is load data, so we only need to flush the data to disk*/
     if (statement->len + statement_row->len + 1 > statement_size) {
       if (!write_data(load_data_file, statement)) {
         g_critical("Could not write out data for %s.%s", dbt->database->name, dbt->table);
+        errors++;
+        *write_failed = TRUE;
         return num_rows;
       }
+      load_data_crc = crc32(load_data_crc, (const Bytef *)statement->str, statement->len);
+      metrics_data_written(dbt->metrics, num_rows - reported_rows, statement->len);
+      reported_rows = num_rows;
       g_string_set_size(statement, 0); 
     }
   }
-  if (statement->len > 0)
+  if (statement->len > 0){
     if (!write_data(load_data_file, statement)) {
       g_critical("Could not write out data for %s.%s", dbt->database->name, dbt->table);
+      errors++;
+      *write_failed = TRUE;
       return num_rows;
     }
-      if (!compress_output) {
-          if (sql_file) { 
-            fclose((FILE *)sql_file);
-            if (stream && sql_fn) g_async_queue_push(stream_queue, g_strdup(sql_fn));
-          }
-          if (load_data_file){
-            fclose((FILE *)load_data_file);
-            if (stream && load_data_fn) g_async_queue_push(stream_queue, g_strdup(load_data_fn));
-          }
-        }else{
-          if (sql_file) {
-            gzclose((gzFile)sql_file);
-            if (stream && sql_fn) g_async_queue_push(stream_queue, g_strdup(sql_fn));
-          }
-          if (load_data_file){
-            gzclose((gzFile)load_data_file);
-            if (stream && load_data_fn) g_async_queue_push(stream_queue, g_strdup(load_data_fn));
-          }
-}
+    load_data_crc = crc32(load_data_crc, (const Bytef *)statement->str, statement->len);
+    metrics_data_written(dbt->metrics, num_rows - reported_rows, statement->len);
+    reported_rows = num_rows;
+  }
+  if (sql_file && load_data_file)
+    close_load_data_files(tj, sub_part - 1, file_rows, sql_file, sql_fn, sql_crc, load_data_file, load_data_fn, load_data_crc);
+  g_free(sql_fn);
+  g_free(load_data_fn);
   return num_rows;
 }
 
 
-guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct db_table * dbt, guint nchunk, guint sections){
+guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct table_job *tj, gboolean *write_failed){
   // There are 2 possible options to chunk the files:
   // - no chunk: this means that will be just 1 data file
   // - chunk_filesize: this function will be spliting the per filesize, this means that multiple files will be created
   // Split by row is before this step
   // It could write multiple INSERT statments in a data file if statement_size is reached
+  struct db_table *dbt = tj->dbt;
+  guint sections = tj->where==NULL?1:2;
   guint num_fields = mysql_num_fields(result);
   GString *escaped = g_string_sized_new(3000);
   MYSQL_FIELD *fields = mysql_fetch_fields(result);
@@ -1419,11 +1675,16 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct d
   gulong *lengths = NULL;
   guint64 num_rows = 0;
   guint64 num_rows_st = 0;  
+  guint64 rows_in_previous_files = 0;
+  guint64 file_rows = 0;
+  guint64 reported_rows = 0;
+  guint64 fetch_calls = 0, format_calls = 0;
+  uLong crc = crc32(0L, Z_NULL, 0);
   guint st_in_file = 0;
-  guint fn = nchunk;
+  guint fn = tj->nchunk;
   sql_fn = build_data_filename(dbt->database->filename, dbt->table_filename, fn, sub_part);
   sql_file = m_open(sql_fn,"w"); 
-  while ((row = mysql_fetch_row(result))) {
+  while ((row = fetch_row(result, &fetch_calls))) {
     lengths = mysql_fetch_lengths(result);
     num_rows++;
 
@@ -1435,8 +1696,11 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct d
         initialize_sql_statement(statement);
         if (!write_data(sql_file, statement)) {
           g_critical("Could not write out data for %s.%s", dbt->database->name, dbt->table);
+          errors++;
+          *write_failed = TRUE;
           return num_rows;
         }
+        crc = crc32(crc, (const Bytef *)statement->str, statement->len);
       }
       append_insert ((complete_insert || dbt->has_generated_fields), statement, dbt->table, fields, num_fields);
       num_rows_st = 0;
@@ -1449,7 +1713,7 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct d
       num_rows_st++;
     }
 
-    write_row_into_string(conn, dbt, row, fields, lengths, num_fields, escaped, statement_row);
+    format_row(conn, dbt, row, fields, lengths, num_fields, escaped, statement_row, &format_calls);
 
     if (statement->len + statement_row->len + 1 > statement_size) {
       if (num_rows_st == 0) {
@@ -1462,25 +1726,36 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct d
 
       if (!write_data(sql_file, statement)) {
         g_critical("Could not write out data for %s.%s", dbt->database->name, dbt->table);
+        errors++;
+        *write_failed = TRUE;
         return num_rows;
       }
+      crc = crc32(crc, (const Bytef *)statement->str, statement->len);
+      metrics_data_written(dbt->metrics, num_rows - reported_rows, statement->len);
+      reported_rows = num_rows;
       filesize+=statement->len+1;
       st_in_file++;
       if (chunk_filesize &&
           (guint)ceil((float)filesize / 1024 / 1024) >
               chunk_filesize) {
+        close_data_file(sql_file);
+        metrics_file_closed(dbt->metrics, sql_fn);
+        // The current row is still in statement_row, it goes to the next file
+        file_rows = num_rows - (statement_row->len ? 1 : 0) - rows_in_previous_files;
+        rows_in_previous_files += file_rows;
+        append_data_file(tj, sql_fn, "data", fn, sub_part, file_rows, crc);
+        if (stream) {
+          g_async_queue_push(stream_queue, g_strdup(sql_fn));
+        }
+        g_free(sql_fn);
         if (sections == 1){
           fn++;
         }else{
           sub_part++;
         }
-        m_close(sql_file);
-        if (stream) {
-          g_async_queue_push(stream_queue, g_strdup(sql_fn));
-        }
-        g_free(sql_fn);
         sql_fn = build_data_filename(dbt->database->filename, dbt->table_filename, fn, sub_part);
         sql_file = m_open(sql_fn,"w");
+        crc = crc32(0L, Z_NULL, 0);
         st_in_file = 0;
 	filesize = 0;
       }
@@ -1506,25 +1781,29 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct d
       g_critical(
           "Could not write out closing newline for %s.%s, now this is sad!",
           dbt->database->name, dbt->table);
+      errors++;
+      *write_failed = TRUE;
       return num_rows;
     }
+    crc = crc32(crc, (const Bytef *)statement->str, statement->len);
+    metrics_data_written(dbt->metrics, num_rows - reported_rows, statement->len);
+    reported_rows = num_rows;
     st_in_file++;
   }
+  close_data_file(sql_file);
+  metrics_file_closed(dbt->metrics, sql_fn);
   if (!st_in_file && !build_empty_files) {
     // dropping the useless file
     if (remove(sql_fn)) {
       g_warning("Failed to remove empty file : %s\n", sql_fn);
     }
-  } else if (chunk_filesize) {
-    if (stream) {
-      g_async_queue_push(stream_queue, g_strdup(sql_fn));
-    }
-  }else{
+  } else {
+    append_data_file(tj, sql_fn, "data", fn, sub_part, num_rows - rows_in_previous_files, crc);
     if (stream) {
       g_async_queue_push(stream_queue, g_strdup(sql_fn));
     }
   }
-  m_close(sql_file);
+  g_free(sql_fn);
   g_mutex_lock(dbt->rows_lock);
   dbt->rows+=num_rows;
   g_mutex_unlock(dbt->rows_lock);
@@ -1534,6 +1813,7 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct d
 /* Do actual data chunk reading/writing magic */
 guint64 write_table_data_into_file(MYSQL *conn, struct table_job * tj){
   guint64 num_rows = 0;
+  gboolean write_failed = FALSE;
 //  guint64 num_rows_st = 0;
   MYSQL_RES *result = NULL;
   char *query = NULL;
@@ -1551,7 +1831,10 @@ guint64 write_table_data_into_file(MYSQL *conn, struct table_job * tj){
        (tj->where && where_option )                    ? "AND"   : "" ,   where_option ?   where_option : "", 
       ((tj->where || where_option ) && tj->dbt->where) ? "AND"   : "" , tj->dbt->where ? tj->dbt->where : "", 
       tj->order_by ? "ORDER BY" : "", tj->order_by ? tj->order_by : "");
-  if (mysql_query(conn, query) || !(result = mysql_use_result(conn))) {
+  GTimer *timer = g_timer_new();
+  guint64 stage_start = stage_clock();
+  if (profiled_query(conn, query) || !(result = mysql_use_result(conn))) {
+    g_timer_destroy(timer);
     // ERROR 1146
     if (success_on_1146 && mysql_errno(conn) == 1146) {
       g_warning("Error dumping table (%s.%s) data: %s ", tj->database, tj->table,
@@ -1564,16 +1847,23 @@ guint64 write_table_data_into_file(MYSQL *conn, struct table_job * tj){
     goto cleanup;
   }
 
+  stage_end(DUMP_STAGE_QUERY, stage_start);
+  throttle_query_latency(g_timer_elapsed(timer, NULL));
+  metrics_chunk_query(g_timer_elapsed(timer, NULL));
+  g_timer_destroy(timer);
+
   /* Poor man's data dump code */
   if (load_data)
-    num_rows = write_row_into_file_in_load_data_mode(conn, result, tj->dbt, tj->nchunk);
+    num_rows = write_row_into_file_in_load_data_mode(conn, result, tj, &write_failed);
   else
-    num_rows=write_row_into_file_in_sql_mode(conn, result, tj->dbt, tj->nchunk, tj->where==NULL?1:2);
+    num_rows=write_row_into_file_in_sql_mode(conn, result, tj, &write_failed);
   if (mysql_errno(conn)) {
     g_critical("Could not read data from %s.%s: %s", tj->database, tj->table,
                mysql_error(conn));
     errors++;
-  }
+  }else if (!write_failed)
+    // A chunk that could not be written completely has to be dumped again on --resume
+    dump_journal_chunk_done(tj, num_rows);
 
 
 cleanup:
@@ -23,7 +23,7 @@
 #define INSERT "INSERT"
 #define REPLACE "REPLACE"
 
-typedef gchar * (*fun_ptr2)(gchar **);
+enum dump_stage { DUMP_STAGE_QUERY, DUMP_STAGE_FETCH, DUMP_STAGE_FORMAT, DUMP_STAGE_WRITE, DUMP_STAGE_CLOSE };
 
 
 void load_working_thread_entries(GOptionGroup *main_group);
@@ -32,3 +32,4 @@ void dump_table(MYSQL *conn, struct db_table *dbt, struct configuration *conf, g
 void create_jobs_for_non_innodb_table_list_in_less_locking_mode(MYSQL *conn, GList *noninnodb_tables_list, struct configuration *conf);
 void new_table_to_dump(MYSQL *conn, struct configuration *conf, gboolean is_view, struct database * database, char *table, char *datalength, gchar *ecol);
 void initialize_working_thread();
+void prefetch_table_status(MYSQL *conn, GList *databases);
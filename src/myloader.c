@@ -59,6 +59,17 @@
 #include "myloader_restore.h"
 #include "myloader_pmm_thread.h"
 #include "myloader_restore_job.h"
+#include "myloader_scheduler.h"
+#include "myloader_constraints.h"
+#include "myloader_post.h"
+#include "myloader_journal.h"
+#include "myloader_monitor.h"
+#include "myloader_async.h"
+#include "myloader_transcode.h"
+#include "myloader_metrics.h"
+#include "stages.h"
+#include "trace.h"
+#include "query_profile.h"
 guint commit_count = 1000;
 gchar *input_directory = NULL;
 gchar *directory = NULL;
@@ -73,12 +84,23 @@ gboolean skip_triggers = FALSE;
 gboolean skip_post = FALSE;
 gboolean serial_tbl_creation = FALSE;
 gboolean resume = FALSE;
+gboolean skip_manifest = FALSE;
 guint rows = 0;
 gchar *source_db = NULL;
 gchar *purge_mode_str=NULL;
 gchar *set_names_str=NULL;
 guint errors = 0;
 guint max_threads_per_table=4;
+guint max_threads_for_index_creation=0;
+gboolean adaptive_threads_per_table=FALSE;
+guint throttle_threads_running=0;
+guint throttle_replica_lag=0;
+guint throttle_history_list_length=0;
+gchar *throttle_replica=NULL;
+guint target_commit_latency=0;
+guint64 target_transaction_size=0;
+guint async_connections=0;
+gboolean inserts_as_load_data=FALSE;
 gboolean append_if_not_exist=FALSE;
 gboolean stream = FALSE;
 gboolean no_delete = FALSE;
@@ -118,11 +140,21 @@ gboolean arguments_callback(const gchar *option_name,const gchar *value, gpointe
   return FALSE;
 }
 
+static const gchar *load_stage_names[]={"read", "parse", "query", "commit"};
+
 static GOptionEntry entries[] = {
     {"directory", 'd', 0, G_OPTION_ARG_STRING, &input_directory,
      "Directory of the dump to import", NULL},
     {"queries-per-transaction", 'q', 0, G_OPTION_ARG_INT, &commit_count,
      "Number of queries per transaction, default 1000", NULL},
+    {"target-commit-latency", 0, 0, G_OPTION_ARG_INT, &target_commit_latency,
+     "Adjust the queries per transaction of each thread to get COMMITs of these milliseconds, default 0 (disabled)", NULL},
+    {"target-transaction-size", 0, 0, G_OPTION_ARG_INT64, &target_transaction_size,
+     "Commit when a transaction gets to this amount of bytes and adjust the queries per transaction to it, default 0 (disabled)", NULL},
+    {"async-connections", 0, 0, G_OPTION_ARG_INT, &async_connections,
+     "Amount of connections that restore the data with the non-blocking client API, while --threads only read the files, default 0 (disabled)", NULL},
+    {"inserts-as-load-data", 0, 0, G_OPTION_ARG_NONE, &inserts_as_load_data,
+     "Executes the INSERT statements of the data files as LOAD DATA LOCAL INFILE", NULL},
     {"overwrite-tables", 'o', 0, G_OPTION_ARG_NONE, &overwrite_tables,
      "Drop tables if they already exist", NULL},
     {"append-if-not-exist", 0, 0, G_OPTION_ARG_NONE,&append_if_not_exist,
@@ -147,6 +179,18 @@ static GOptionEntry entries[] = {
      "Split the INSERT statement into this many rows.", NULL},
     {"max-threads-per-table", 0, 0, G_OPTION_ARG_INT, &max_threads_per_table,
      "Maximum number of threads per table to use, default 4", NULL},
+    {"adaptive-threads-per-table", 0, 0, G_OPTION_ARG_NONE, &adaptive_threads_per_table,
+     "Adjust the threads of each table while it is loaded, starting from --max-threads-per-table, depending on its throughput and lock waits", NULL},
+    {"throttle-threads-running", 0, 0, G_OPTION_ARG_INT, &throttle_threads_running,
+     "Pause threads while Threads_running is over this value, default 0 (disabled)", NULL},
+    {"throttle-replica-lag", 0, 0, G_OPTION_ARG_INT, &throttle_replica_lag,
+     "Pause threads while the replica lags more than these seconds, default 0 (disabled)", NULL},
+    {"throttle-replica", 0, 0, G_OPTION_ARG_STRING, &throttle_replica,
+     "Replica to check for --throttle-replica-lag as host[:port], by default the lag of the server that is restored is used", NULL},
+    {"throttle-history-list-length", 0, 0, G_OPTION_ARG_INT, &throttle_history_list_length,
+     "Pause threads while the InnoDB history list length is over this value, default 0 (disabled)", NULL},
+    {"max-threads-for-index-creation", 0, 0, G_OPTION_ARG_INT, &max_threads_for_index_creation,
+     "Maximum number of indexes that are built at the same time with --innodb-optimize-keys. By default, it is calculated from innodb_sort_buffer_size and innodb_buffer_pool_size", NULL},
     {"skip-triggers", 0, 0, G_OPTION_ARG_NONE, &skip_triggers, "Do not import triggers. By default, it imports triggers",
      NULL},
     {"skip-post", 0, 0, G_OPTION_ARG_NONE, &skip_post,
@@ -156,7 +200,9 @@ static GOptionEntry entries[] = {
     {"serialized-table-creation",0, 0, G_OPTION_ARG_NONE, &serial_tbl_creation, 
       "Table recreation will be executed in serie, one thread at a time",NULL},
     {"resume",0, 0, G_OPTION_ARG_NONE, &resume,
-      "Expect to find resume file in backup dir and will only process those files",NULL},
+      "Expect to find resume file or restore-journal in backup dir and will only process the files, and the statements, that are still pending",NULL},
+    {"skip-manifest",0, 0, G_OPTION_ARG_NONE, &skip_manifest,
+      "Scan the backup dir instead of using the manifest file written by mydumper",NULL},
     { "pmm-path", 0, 0, G_OPTION_ARG_STRING, &pmm_path,
       "which default value will be /usr/local/percona/pmm2/collectors/textfile-collector/high-resolution", NULL },
     { "pmm-resolution", 0, 0, G_OPTION_ARG_STRING, &pmm_resolution,
@@ -195,7 +241,7 @@ void create_database(struct thread_data *td, gchar *database) {
     restore_data_from_file(td, database, NULL, filenamegz, TRUE);
   } else {
     query = g_strdup_printf("CREATE DATABASE IF NOT EXISTS `%s`", database);
-    if (mysql_query(td->thrconn, query)){
+    if (profiled_query(td->thrconn, query)){
       g_warning("Fail to create database: %s", database);
     }
   }
@@ -205,7 +251,7 @@ void create_database(struct thread_data *td, gchar *database) {
 }
 
 int main(int argc, char *argv[]) {
-  struct configuration conf = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0};
+  struct configuration conf = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0};
 
   GError *error = NULL;
   GOptionContext *context;
@@ -261,6 +307,12 @@ int main(int argc, char *argv[]) {
   } else 
     set_names_str=g_strdup("/*!40101 SET NAMES binary*/");
 
+  if ((target_commit_latency > 0 || target_transaction_size > 0) && commit_count <= 1){
+    g_warning("--target-commit-latency and --target-transaction-size need --queries-per-transaction bigger than 1, they are ignored");
+    target_commit_latency=0;
+    target_transaction_size=0;
+  }
+
   if (pmm_path){
     pmm=TRUE;
     if (!pmm_resolution){
@@ -271,10 +323,14 @@ int main(int argc, char *argv[]) {
     pmm_path=g_strdup_printf("/usr/local/percona/pmm2/collectors/textfile-collector/%s-resolution",pmm_resolution);
   }
 
+  initialize_trace(trace_filename, "myloader");
+  initialize_query_profile(profile_queries);
+
   GThread *pmmthread = NULL;
   if (pmm){
 
     g_message("Using PMM resolution %s at %s", pmm_resolution, pmm_path);
+    initialize_metrics();
     GError *serror;
     pmmthread =
         g_thread_create(pmm_thread, &conf, FALSE, &serror);
@@ -325,6 +381,9 @@ int main(int argc, char *argv[]) {
   if (tables_skiplist_file)
     read_tables_skiplist(tables_skiplist_file, &errors);
   initialize_process(&conf);
+  initialize_scheduler();
+  initialize_constraints();
+  initialize_post_objects();
   initialize_common();
   initialize_regex();
   GError *serror;
@@ -349,37 +408,40 @@ int main(int argc, char *argv[]) {
   execute_gstring(conn, set_session);
 
   // TODO: we need to set the variables in the initilize session varibles, not from:
-//  if (mysql_query(conn, "SET SESSION wait_timeout = 2147483")) {
+//  if (profiled_query(conn, "SET SESSION wait_timeout = 2147483")) {
 //    g_warning("Failed to increase wait_timeout: %s", mysql_error(conn));
 //  }
 
 //  if (!enable_binlog)
-//    mysql_query(conn, "SET SQL_LOG_BIN=0");
+//    profiled_query(conn, "SET SQL_LOG_BIN=0");
   if (disable_redo_log){
     g_message("Disabling redologs");
-    mysql_query(conn, "ALTER INSTANCE DISABLE INNODB REDO_LOG");
+    profiled_query(conn, "ALTER INSTANCE DISABLE INNODB REDO_LOG");
   }
-  mysql_query(conn, "/*!40014 SET FOREIGN_KEY_CHECKS=0*/");
+  profiled_query(conn, "/*!40014 SET FOREIGN_KEY_CHECKS=0*/");
   // To here.
-  conf.database_queue = g_async_queue_new();
-  conf.table_queue = g_async_queue_new();
+  initialize_index_creation(conn);
   conf.data_queue = g_async_queue_new();
-  conf.post_table_queue = g_async_queue_new();
-  conf.post_queue = g_async_queue_new();
   conf.ready = g_async_queue_new();
   conf.pause_resume = g_async_queue_new();
   db_hash=g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_free );
 
-  if (resume && !g_file_test("resume",G_FILE_TEST_EXISTS)){
+  if (resume && !g_file_test("resume",G_FILE_TEST_EXISTS) && !journal_exists()){
     g_critical("Resume file not found");
     exit(EXIT_FAILURE);
   }
+  initialize_journal();
 
   struct thread_data t;
   t.thread_id = 0;
   t.conf = &conf;
   t.thrconn = conn;
   t.current_database=NULL;
+  t.current_filename=NULL;
+  t.current_dbt=NULL;
+  t.commit_size=commit_count;
+  t.transaction_bytes=0;
+  t.async_file=NULL;
 
   if (tables_list)
     tables = g_strsplit(tables_list, ",", 0);
@@ -394,7 +456,11 @@ int main(int argc, char *argv[]) {
     initialize_stream(&conf);
   }
 
+  initialize_async();
+  initialize_transcode();
+  initialize_stages(load_stage_names, G_N_ELEMENTS(load_stage_names));
   initialize_loader_threads(&conf);
+  initialize_monitor(&conf);
   
   if (stream){
     wait_stream_to_finish();
@@ -402,17 +468,27 @@ int main(int argc, char *argv[]) {
     restore_from_directory(&conf);
   }
 
+  trace_phase("constraints and post objects", TRUE);
   wait_loader_threads_to_finish();
+  trace_phase("constraints and post objects", FALSE);
+  stop_async();
+  print_stages();
+  stop_monitor();
+  finish_journal(!shutdown_triggered);
 
   g_async_queue_unref(conf.ready);
   conf.ready=NULL;
 
   if (disable_redo_log)
-    mysql_query(conn, "ALTER INSTANCE ENABLE INNODB REDO_LOG");
+    profiled_query(conn, "ALTER INSTANCE ENABLE INNODB REDO_LOG");
 
   g_async_queue_unref(conf.data_queue);
   conf.data_queue=NULL;
+  trace_phase("checksum", TRUE);
   checksum_databases(&t);
+  trace_phase("checksum", FALSE);
+  finish_trace();
+  print_query_profile();
 
   if (stream && no_delete == FALSE && input_directory == NULL){
     // remove metadata files
@@ -426,11 +502,7 @@ int main(int argc, char *argv[]) {
         g_critical("Restore directory not removed: %s", directory);
   }
 
-  g_async_queue_unref(conf.database_queue);
-  g_async_queue_unref(conf.table_queue);
   g_async_queue_unref(conf.pause_resume);
-  g_async_queue_unref(conf.post_table_queue);
-  g_async_queue_unref(conf.post_queue);
   free_hash(set_session_hash);
   g_hash_table_remove_all(set_session_hash);
   g_hash_table_unref(set_session_hash);
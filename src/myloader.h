@@ -25,14 +25,17 @@ struct thread_data {
   MYSQL *thrconn;
   gchar *current_database;
   guint thread_id;
+  const gchar *current_filename;
+  guint64 statements;
+  guint64 statements_to_skip;
+  struct db_table *current_dbt;
+  guint commit_size;
+  guint64 transaction_bytes;
+  struct async_file *async_file;
 };
 
 struct configuration {
-  GAsyncQueue *database_queue;
-  GAsyncQueue *table_queue;
   GAsyncQueue *data_queue;
-  GAsyncQueue *post_table_queue;
-  GAsyncQueue *post_queue;
   GAsyncQueue *ready;
   GAsyncQueue *pause_resume;
   GList *table_list;
@@ -50,20 +53,29 @@ struct db_table {
   char *table;
   char *real_table;
   guint64 rows;
+  guint64 bytes;
   GAsyncQueue * queue;
   GList * restore_job_list;
   guint current_threads;
   guint max_threads;
+  guint queued_jobs;
+  guint64 queued_bytes;
+  guint64 restored_bytes;
+  guint64 loaded_rows;
+  gint heap_index;
+  gboolean data_finished;
   GMutex *mutex;
   GString *indexes;
   GString *constraints;
   guint count;
   gboolean schema_created;
+  gboolean schema_pending;
+  gboolean transcode;
   GDateTime * start_time;
   GDateTime * start_index_time;
   GDateTime * finish_time;
 };
 
-enum file_type { INIT, SCHEMA_TABLESPACE, SCHEMA_CREATE, SCHEMA_TABLE, DATA, SCHEMA_VIEW, SCHEMA_TRIGGER, SCHEMA_POST, CHECKSUM, METADATA_TABLE, METADATA_GLOBAL, RESUME, IGNORED, LOAD_DATA, SHUTDOWN, INCOMPLETE };
+enum file_type { INIT, SCHEMA_TABLESPACE, SCHEMA_CREATE, SCHEMA_TABLE, DATA, SCHEMA_VIEW, SCHEMA_TRIGGER, SCHEMA_POST, CHECKSUM, METADATA_TABLE, METADATA_GLOBAL, MANIFEST, RESUME, IGNORED, LOAD_DATA, SHUTDOWN, INCOMPLETE };
 
 #endif
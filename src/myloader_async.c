@@ -0,0 +1,392 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <mysql.h>
+#include <glib.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include "myloader.h"
+#include "myloader_journal.h"
+#include "myloader_metrics.h"
+#include "myloader_async.h"
+#include "connection.h"
+#include "common.h"
+#include "query_profile.h"
+#include "stages.h"
+
+extern guint errors;
+extern guint commit_count;
+extern guint async_connections;
+extern gchar *set_names_str;
+extern GString *set_session;
+
+/*
+  With --async-connections, the loader threads only read and split the data
+  files. Every INSERT is queued and executed by an event loop that drives up
+  to ASYNC_CONNECTIONS_PER_LOOP connections with the non-blocking API of the
+  client library, so many statements are in flight with a few threads.
+  Statements of a file finish out of order, the journal gets the amount of
+  statements of the file that finished without a gap. A thread waits for
+  all the statements of a file before it takes the next one.
+*/
+
+#define ASYNC_CONNECTIONS_PER_LOOP 16
+#define ASYNC_POLL_TIMEOUT 10
+
+// The non-blocking API of MySQL does not tell the socket nor whether it
+// waits to read or to write, so the connections could only be polled with a
+// timeout. The one of MariaDB tells both.
+#if defined MARIADB_CLIENT_VERSION_STR || defined MARIADB_BASE_VERSION
+#define ASYNC_SUPPORTED
+#endif
+
+struct async_file {
+  GMutex *mutex;
+  GCond *cond;
+  const gchar *filename;
+  guint pending;
+  guint errors;
+  guint64 submitted;
+  guint64 committed;
+  GHashTable *done;
+};
+
+struct async_statement {
+  struct async_file *af;
+  struct db_table *dbt;
+  gchar *database;
+  GString *data;
+  guint64 seq;
+};
+
+struct async_connection {
+  MYSQL *conn;
+  gchar *database;
+  struct async_statement *as;
+  gchar *query;
+  gulong query_len;
+  gboolean use;
+  gboolean started;
+  int ret;
+  int wait;
+  guint64 timeout_at;
+};
+
+struct async_loop {
+  struct async_connection *connections;
+  guint count;
+  GThread *thread;
+};
+
+static GAsyncQueue *async_queue=NULL;
+static GMutex *async_mutex=NULL;
+static GCond *async_cond=NULL;
+static guint in_flight=0;
+static struct async_loop *loops=NULL;
+static guint loop_count=0;
+static struct async_statement async_stop;
+
+gboolean is_async_enabled(){
+  return async_queue != NULL;
+}
+
+struct async_file *async_file_new(const gchar *filename, guint64 committed){
+  struct async_file *af=g_new0(struct async_file, 1);
+  af->mutex=g_mutex_new();
+  af->cond=g_cond_new();
+  af->filename=filename;
+  af->submitted=committed;
+  af->committed=committed;
+  af->done=g_hash_table_new(g_direct_hash, g_direct_equal);
+  return af;
+}
+
+// It blocks while there are too many statements queued, so the loader
+// threads do not read the files faster than they are restored
+void async_submit(struct thread_data *td, GString *data){
+  struct async_statement *as=g_new0(struct async_statement, 1);
+  struct async_file *af=td->async_file;
+  g_mutex_lock(async_mutex);
+  while (in_flight >= 2 * async_connections)
+    g_cond_wait(async_cond, async_mutex);
+  in_flight++;
+  g_mutex_unlock(async_mutex);
+  as->af=af;
+  as->dbt=td->current_dbt;
+  as->database=g_strdup(td->current_database);
+  as->data=g_string_new_len(data->str, data->len);
+  g_mutex_lock(af->mutex);
+  as->seq=++af->submitted;
+  af->pending++;
+  g_mutex_unlock(af->mutex);
+  g_async_queue_push(async_queue, as);
+}
+
+// Returns the amount of statements of the file that failed
+guint async_file_wait(struct async_file *af){
+  guint r;
+  g_mutex_lock(af->mutex);
+  while (af->pending > 0)
+    g_cond_wait(af->cond, af->mutex);
+  r=af->errors;
+  g_mutex_unlock(af->mutex);
+  g_hash_table_destroy(af->done);
+  g_mutex_free(af->mutex);
+  g_cond_free(af->cond);
+  g_free(af);
+  return r;
+}
+
+#ifdef ASYNC_SUPPORTED
+// The USE of the database of the statement, when it changes, or the statement
+static const gchar *async_current_query(struct async_connection *ac){
+  return ac->query != NULL ? ac->query : ac->as->data->str;
+}
+
+static void async_options(MYSQL *conn){
+  mysql_options(conn, MYSQL_OPT_NONBLOCK, 0);
+}
+
+static int async_socket(struct async_connection *ac){
+  return mysql_get_socket(ac->conn);
+}
+
+static short async_events(struct async_connection *ac){
+  short events=0;
+  if (ac->wait & MYSQL_WAIT_READ)
+    events|=POLLIN;
+  if (ac->wait & MYSQL_WAIT_WRITE)
+    events|=POLLOUT;
+  if (ac->wait & MYSQL_WAIT_EXCEPT)
+    events|=POLLPRI;
+  return events;
+}
+
+// Returns TRUE when the query finished, ret is the result of mysql_real_query
+static gboolean async_query(struct async_connection *ac, short revents){
+  int status=0;
+  if (!ac->started){
+    ac->started=TRUE;
+    ac->wait=mysql_real_query_start(&ac->ret, ac->conn, async_current_query(ac), ac->query_len);
+  }else{
+    if (revents & POLLIN)
+      status|=MYSQL_WAIT_READ;
+    if (revents & POLLOUT)
+      status|=MYSQL_WAIT_WRITE;
+    if (revents & POLLPRI)
+      status|=MYSQL_WAIT_EXCEPT;
+    if (status == 0 && (ac->wait & MYSQL_WAIT_TIMEOUT) && stage_clock() >= ac->timeout_at)
+      status|=MYSQL_WAIT_TIMEOUT;
+    if (status == 0)
+      return FALSE;
+    ac->wait=mysql_real_query_cont(&ac->ret, ac->conn, status);
+  }
+  if (ac->wait & MYSQL_WAIT_TIMEOUT)
+    ac->timeout_at=stage_clock() + (guint64)mysql_get_timeout_value_ms(ac->conn) * 1000000;
+  return ac->wait == 0;
+}
+
+static void async_statement_done(struct async_connection *ac, gboolean failed){
+  struct async_statement *as=ac->as;
+  struct async_file *af=as->af;
+  guint64 committed;
+  my_ulonglong affected_rows;
+  if (failed)
+    g_critical("Error restoring statement %" G_GUINT64_FORMAT " of %s: %s", as->seq, af->filename, mysql_error(ac->conn));
+  else{
+    affected_rows=mysql_affected_rows(ac->conn);
+    metrics_statement(as->dbt, as->data->len, affected_rows == (my_ulonglong)~0 ? 0 : affected_rows);
+  }
+  g_mutex_lock(af->mutex);
+  if (failed){
+    af->errors++;
+    errors++;
+  }else{
+    committed=af->committed;
+    g_hash_table_insert(af->done, GSIZE_TO_POINTER(as->seq), GSIZE_TO_POINTER(as->seq));
+    while (g_hash_table_remove(af->done, GSIZE_TO_POINTER(af->committed + 1)))
+      af->committed++;
+    if (af->committed > committed)
+      journal_committed(af->filename, af->committed);
+  }
+  af->pending--;
+  g_cond_signal(af->cond);
+  g_mutex_unlock(af->mutex);
+
+  g_mutex_lock(async_mutex);
+  in_flight--;
+  g_cond_signal(async_cond);
+  g_mutex_unlock(async_mutex);
+
+  g_string_free(as->data, TRUE);
+  g_free(as->database);
+  g_free(as);
+  ac->as=NULL;
+}
+
+static void async_prepare(struct async_connection *ac){
+  struct async_statement *as=ac->as;
+  g_free(ac->query);
+  ac->query=NULL;
+  ac->started=FALSE;
+  ac->use=as->database != NULL && g_strcmp0(as->database, ac->database) != 0;
+  if (ac->use){
+    ac->query=g_strdup_printf("USE `%s`", as->database);
+    ac->query_len=strlen(ac->query);
+  }else
+    ac->query_len=as->data->len;
+}
+
+// Returns TRUE when the statement of the connection finished
+static gboolean async_step(struct async_connection *ac, short revents){
+  MYSQL_RES *res=NULL;
+  if (!async_query(ac, revents))
+    return FALSE;
+  if (ac->ret != 0){
+    async_statement_done(ac, TRUE);
+    return TRUE;
+  }
+  if (mysql_field_count(ac->conn) > 0){
+    res=profiled_store_result(ac->conn);
+    if (res != NULL)
+      mysql_free_result(res);
+  }
+  if (ac->use){
+    g_free(ac->database);
+    ac->database=g_strdup(ac->as->database);
+    g_free(ac->query);
+    ac->query=NULL;
+    ac->query_len=ac->as->data->len;
+    ac->use=FALSE;
+    ac->started=FALSE;
+    return async_step(ac, 0);
+  }
+  async_statement_done(ac, FALSE);
+  return TRUE;
+}
+
+static void *async_loop(struct async_loop *loop){
+  struct pollfd *fds=g_new0(struct pollfd, loop->count);
+  struct async_connection *ac=NULL;
+  struct async_statement *as=NULL;
+  gboolean stopping=FALSE;
+  guint i, busy=0;
+  while (!stopping || busy > 0){
+    for (i=0; i < loop->count && !stopping; i++){
+      ac=&loop->connections[i];
+      if (ac->as != NULL)
+        continue;
+      as=busy == 0 ? g_async_queue_pop(async_queue) : g_async_queue_try_pop(async_queue);
+      if (as == NULL)
+        break;
+      if (as == &async_stop){
+        stopping=TRUE;
+        break;
+      }
+      ac->as=as;
+      async_prepare(ac);
+      busy++;
+      if (async_step(ac, 0))
+        busy--;
+    }
+    if (busy == 0)
+      continue;
+    for (i=0; i < loop->count; i++){
+      ac=&loop->connections[i];
+      fds[i].fd=ac->as != NULL ? async_socket(ac) : -1;
+      fds[i].events=ac->as != NULL ? async_events(ac) : 0;
+      fds[i].revents=0;
+    }
+    poll(fds, loop->count, ASYNC_POLL_TIMEOUT);
+    for (i=0; i < loop->count; i++){
+      ac=&loop->connections[i];
+      if (ac->as != NULL && async_step(ac, fds[i].revents))
+        busy--;
+    }
+  }
+  g_free(fds);
+  return NULL;
+}
+#endif
+
+void initialize_async(){
+#ifdef ASYNC_SUPPORTED
+  GError *error=NULL;
+  struct async_connection *ac=NULL;
+  guint i, n;
+  if (async_connections == 0)
+    return;
+  async_queue=g_async_queue_new();
+  async_mutex=g_mutex_new();
+  async_cond=g_cond_new();
+  loop_count=(async_connections + ASYNC_CONNECTIONS_PER_LOOP - 1) / ASYNC_CONNECTIONS_PER_LOOP;
+  loops=g_new0(struct async_loop, loop_count);
+  for (n=0; n < loop_count; n++){
+    loops[n].count=MIN(ASYNC_CONNECTIONS_PER_LOOP, async_connections - n * ASYNC_CONNECTIONS_PER_LOOP);
+    loops[n].connections=g_new0(struct async_connection, loops[n].count);
+    for (i=0; i < loops[n].count; i++){
+      ac=&loops[n].connections[i];
+      ac->conn=mysql_init(NULL);
+      async_options(ac->conn);
+      m_connect(ac->conn, "myloader", NULL);
+      profiled_query(ac->conn, set_names_str);
+      profiled_query(ac->conn, "/*!40101 SET SQL_MODE='NO_AUTO_VALUE_ON_ZERO' */");
+      profiled_query(ac->conn, "/*!40014 SET UNIQUE_CHECKS=0 */");
+      profiled_query(ac->conn, "/*!40014 SET FOREIGN_KEY_CHECKS=0*/");
+      execute_gstring(ac->conn, set_session);
+      // Each statement is its own transaction, as they finish out of order
+      if (commit_count > 1)
+        profiled_query(ac->conn, "SET AUTOCOMMIT=1");
+    }
+    loops[n].thread=g_thread_create((GThreadFunc)async_loop, &loops[n], TRUE, &error);
+    if (loops[n].thread == NULL){
+      g_critical("Could not create async loop thread: %s", error->message);
+      g_error_free(error);
+      exit(EXIT_FAILURE);
+    }
+  }
+  g_message("Restoring data with %u connections driven by %u threads", async_connections, loop_count);
+#else
+  if (async_connections > 0)
+    g_warning("--async-connections needs the MariaDB client library, the data will be restored by the threads");
+#endif
+}
+
+// All the files were waited before, so the queue only gets the stops
+void stop_async(){
+#ifdef ASYNC_SUPPORTED
+  guint n, i;
+  if (async_queue == NULL)
+    return;
+  for (n=0; n < loop_count; n++)
+    g_async_queue_push(async_queue, &async_stop);
+  for (n=0; n < loop_count; n++){
+    g_thread_join(loops[n].thread);
+    for (i=0; i < loops[n].count; i++){
+      mysql_close(loops[n].connections[i].conn);
+      g_free(loops[n].connections[i].database);
+      g_free(loops[n].connections[i].query);
+    }
+    g_free(loops[n].connections);
+  }
+  g_free(loops);
+  loops=NULL;
+  g_async_queue_unref(async_queue);
+  async_queue=NULL;
+#endif
+}
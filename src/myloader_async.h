@@ -0,0 +1,28 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_myloader_async_h
+#define _src_myloader_async_h
+#include "myloader.h"
+
+void initialize_async();
+gboolean is_async_enabled();
+struct async_file *async_file_new(const gchar *filename, guint64 committed);
+void async_submit(struct thread_data *td, GString *data);
+guint async_file_wait(struct async_file *af);
+void stop_async();
+#endif
@@ -35,6 +35,7 @@
 #include "connection.h"
 #include "tables_skiplist.h"
 #include "regex.h"
+#include "query_profile.h"
 #include <errno.h>
 
 extern gchar *compress_extension;
@@ -105,7 +106,7 @@ gboolean eval_table( char *db_name, char * table_name){
 */
 guint execute_use(struct thread_data *td, const gchar * msg){
   gchar *query = g_strdup_printf("USE `%s`", td->current_database);
-  if (mysql_query(td->thrconn, query)) {
+  if (profiled_query(td->thrconn, query)) {
     g_critical("Error switching to database `%s` %s", td->current_database, msg);
     g_free(query);
     return 1;
@@ -132,6 +133,8 @@ enum file_type get_file_type (const char * filename){
     return METADATA_TABLE;
   } else if ( strcmp(filename, "metadata") == 0 ){
     return METADATA_GLOBAL;
+  } else if ( strcmp(filename, "manifest") == 0 ){
+    return MANIFEST;
   } else if ( strcmp(filename, "all-schema-create-tablespace.sql") == 0 ){
     return SCHEMA_TABLESPACE;
   } else if ( strcmp(filename, "resume") == 0 ){
@@ -140,6 +143,8 @@ enum file_type get_file_type (const char * filename){
       exit(EXIT_FAILURE);
     }
     return RESUME;
+  } else if ( strcmp(filename, "restore-journal") == 0 ){
+    return INIT;
   } else if ( strcmp(filename, "resume.partial") == 0 ){
     g_critical("resume.partial file found. Remove it and restart process if you consider that it will be safe.");
     exit(EXIT_FAILURE);
@@ -280,7 +285,13 @@ gint compare_dbt(gconstpointer a, gconstpointer b, gpointer table_hash){
   struct db_table * b_val=g_hash_table_lookup(table_hash,b_key);
   g_free(a_key);
   g_free(b_key);
-  return a_val->rows < b_val->rows;
+  // The biggest tables go first. The size of the data files is only known
+  // when the manifest is used, the rows break the ties
+  if (a_val->bytes != b_val->bytes)
+    return a_val->bytes > b_val->bytes ? -1 : 1;
+  if (a_val->rows != b_val->rows)
+    return a_val->rows > b_val->rows ? -1 : 1;
+  return 0;
 }
 
 void refresh_table_list(struct configuration *conf){
@@ -407,3 +418,14 @@ void remove_definer(GString * data){
   }
 }
 
+// Returns the identifier that starts at the backtick in p, and moves p
+// after it
+gchar *read_identifier(const gchar **p){
+  const gchar *end=strchr(*p+1,'`');
+  gchar *identifier=NULL;
+  if (end == NULL)
+    return NULL;
+  identifier=g_strndup(*p+1, end-*p-1);
+  *p=end+1;
+  return identifier;
+}
@@ -0,0 +1,132 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <glib.h>
+#include <string.h>
+#include "myloader.h"
+#include "myloader_common.h"
+#include "myloader_restore_job.h"
+#include "myloader_constraints.h"
+
+/*
+  The ALTER TABLE ADD CONSTRAINT of a table locks the table and the tables
+  it references. Two of them touching the same table might deadlock, so a
+  constraint job is only started when none of its tables is used by a
+  running one. Jobs that conflict wait and the rest run in parallel.
+*/
+
+struct constraint_job {
+  struct restore_job *rj;
+  gchar **tables;
+};
+
+GMutex *constraints_mutex=NULL;
+GCond *constraints_cond=NULL;
+GList *constraint_jobs=NULL;
+GHashTable *busy_tables=NULL;
+
+void initialize_constraints(){
+  constraints_mutex=g_mutex_new();
+  constraints_cond=g_cond_new();
+  busy_tables=g_hash_table_new(g_str_hash, g_str_equal);
+}
+
+// The table itself plus every table after a REFERENCES, which can be
+// `table` or `database`.`table`. The databases are mapped to the ones we
+// restore into, so the keys match the real_database of the tables
+static gchar **get_constraint_tables(struct db_table *dbt, const gchar *statement){
+  GPtrArray *tables=g_ptr_array_new();
+  const gchar *p=statement;
+  gchar *first=NULL, *second=NULL, *real_database=NULL;
+  g_ptr_array_add(tables, g_strdup_printf("%s.%s", dbt->real_database, dbt->real_table));
+  while ((p=strstr(p,"REFERENCES `")) != NULL){
+    p+=11;
+    first=read_identifier(&p);
+    if (first == NULL)
+      break;
+    if (p[0] == '.' && p[1] == '`'){
+      p++;
+      second=read_identifier(&p);
+      if (second == NULL){
+        g_free(first);
+        break;
+      }
+      real_database=db_hash_lookup(first);
+      g_ptr_array_add(tables, g_strdup_printf("%s.%s", real_database != NULL ? real_database : first, second));
+      g_free(first);
+      g_free(second);
+    }else{
+      g_ptr_array_add(tables, g_strdup_printf("%s.%s", dbt->real_database, first));
+      g_free(first);
+    }
+  }
+  g_ptr_array_add(tables, NULL);
+  return (gchar **)g_ptr_array_free(tables, FALSE);
+}
+
+void add_constraint_job(struct restore_job *rj){
+  struct constraint_job *cj=g_new(struct constraint_job,1);
+  cj->rj=rj;
+  cj->tables=get_constraint_tables(rj->dbt, rj->data.srj->statement->str);
+  g_mutex_lock(constraints_mutex);
+  constraint_jobs=g_list_prepend(constraint_jobs, cj);
+  g_mutex_unlock(constraints_mutex);
+}
+
+static gboolean is_busy(struct constraint_job *cj){
+  guint i;
+  for (i=0; cj->tables[i] != NULL; i++)
+    if (g_hash_table_lookup(busy_tables, cj->tables[i]) != NULL)
+      return TRUE;
+  return FALSE;
+}
+
+static void set_busy(struct constraint_job *cj, gboolean busy){
+  guint i;
+  for (i=0; cj->tables[i] != NULL; i++)
+    if (busy)
+      g_hash_table_insert(busy_tables, cj->tables[i], cj);
+    else
+      g_hash_table_remove(busy_tables, cj->tables[i]);
+}
+
+// It is called by all the threads once the data and the indexes have been
+// restored, so no more jobs are added at this point
+void run_constraints(struct thread_data *td){
+  GList *l=NULL;
+  struct constraint_job *cj=NULL;
+  g_mutex_lock(constraints_mutex);
+  while (constraint_jobs != NULL){
+    for (l=constraint_jobs; l != NULL && is_busy(l->data); l=l->next);
+    if (l == NULL){
+      g_cond_wait(constraints_cond, constraints_mutex);
+      continue;
+    }
+    cj=l->data;
+    constraint_jobs=g_list_delete_link(constraint_jobs, l);
+    set_busy(cj, TRUE);
+    g_mutex_unlock(constraints_mutex);
+    execute_use_if_needs_to(td, cj->rj->dbt->real_database, "Restoring constraints");
+    process_restore_job(td, cj->rj);
+    g_mutex_lock(constraints_mutex);
+    set_busy(cj, FALSE);
+    g_strfreev(cj->tables);
+    g_free(cj);
+    g_cond_broadcast(constraints_cond);
+  }
+  g_mutex_unlock(constraints_mutex);
+}
@@ -36,18 +36,21 @@
 #include "myloader_restore.h"
 #include "myloader_restore_job.h"
 #include "myloader_control_job.h"
+#include "myloader_manifest.h"
+#include "myloader_scheduler.h"
+#include "myloader_post.h"
+#include "trace.h"
 
 extern guint total_data_sql_files;
 extern guint num_threads;
 extern gboolean innodb_optimize_keys;
-extern gboolean innodb_optimize_keys_per_table;
-extern gboolean innodb_optimize_keys_all_tables;
 extern gchar *directory;
 extern guint errors;
 extern gboolean skip_post;
 extern gchar *source_db;
 extern gboolean skip_triggers;
 extern gboolean no_data;
+extern gboolean skip_manifest;
 
 GAsyncQueue *data_filename_queue;
 GAsyncQueue *data_filename_queue_completed;
@@ -70,8 +73,7 @@ gboolean append_filename_to_list (
     GList **view_list, 
     GList **trigger_list, 
     GList **post_list, 
-    GList **checksum_list, const gchar *filename, gboolean inside_resume){
-  enum file_type ft= get_file_type(filename);
+    GList **checksum_list, const gchar *filename, enum file_type ft, gboolean inside_resume){
     if (ft == SCHEMA_POST){
         if (!skip_post)
           *post_list=g_list_insert(*post_list,g_strdup(filename),-1);
@@ -101,6 +103,8 @@ gboolean append_filename_to_list (
             break;
           case METADATA_GLOBAL:
             break;
+          case MANIFEST:
+            break;
           case METADATA_TABLE:
             // TODO: we need to process this info
             *metadata_list=g_list_append(*metadata_list,g_strdup(filename));
@@ -142,7 +146,7 @@ gboolean append_filename_to_list (
                 split=g_strsplit(data->str,"\n",0);
                 for (i=0; i<g_strv_length(split);i++){
                   if (strlen(split[i])>2)
-                    append_filename_to_list(schema_create_list,create_table_list,metadata_list,data_files_list,view_list,trigger_list,post_list,checksum_list,split[i],TRUE);
+                    append_filename_to_list(schema_create_list,create_table_list,metadata_list,data_files_list,view_list,trigger_list,post_list,checksum_list,split[i],get_file_type(split[i]),TRUE);
                 }
                 g_string_set_size(data, 0);
               } 
@@ -165,14 +169,6 @@ gint compare_filename_part (gconstpointer a, gconstpointer b){
 
 void load_directory_information(struct configuration *conf) {
   GError *error = NULL;
-  GDir *dir = g_dir_open(directory, 0, &error);
-
-  if (error) {
-    g_critical("cannot open directory %s, %s\n", directory, error->message);
-    errors++;
-    return;
-  }
-
   const gchar *filename = NULL;
   GList *create_table_list=NULL,
         *metadata_list= NULL,
@@ -182,10 +178,30 @@ void load_directory_information(struct configuration *conf) {
         *trigger_list=NULL,
         *post_list=NULL;
   gboolean cont=TRUE;
-  while (cont && (filename = g_dir_read_name(dir)))
-    cont=append_filename_to_list(&schema_create_list,&create_table_list,&metadata_list,&data_files_list,&view_list,&trigger_list,&post_list,&(conf->checksum_list),filename,FALSE);
- 
-  g_dir_close(dir);
+  gchar *resume_filename = g_build_filename(directory, "resume", NULL);
+  // The resume file lists the files that are still pending, so the
+  // manifest can only be used when there is no resume file
+  if (!skip_manifest && !g_file_test(resume_filename, G_FILE_TEST_EXISTS) && load_manifest(directory)){
+    GList *m=get_manifest_entries();
+    struct manifest_entry *e=NULL;
+    while (cont && m){
+      e=m->data;
+      cont=append_filename_to_list(&schema_create_list,&create_table_list,&metadata_list,&data_files_list,&view_list,&trigger_list,&post_list,&(conf->checksum_list),e->filename,e->type,FALSE);
+      m=m->next;
+    }
+  }else{
+    GDir *dir = g_dir_open(directory, 0, &error);
+    if (error) {
+      g_critical("cannot open directory %s, %s\n", directory, error->message);
+      errors++;
+      g_free(resume_filename);
+      return;
+    }
+    while (cont && (filename = g_dir_read_name(dir)))
+      cont=append_filename_to_list(&schema_create_list,&create_table_list,&metadata_list,&data_files_list,&view_list,&trigger_list,&post_list,&(conf->checksum_list),filename,get_file_type(filename),FALSE);
+    g_dir_close(dir);
+  }
+  g_free(resume_filename);
 
   gchar *f = NULL;
   g_debug("Processing database files");
@@ -244,7 +260,7 @@ void load_directory_information(struct configuration *conf) {
     dbt->restore_job_list=g_list_sort(dbt->restore_job_list,&compare_filename_part);
     GList *i=dbt->restore_job_list;
     while (i) {
-      g_async_queue_push(dbt->queue, new_job(JOB_RESTORE ,i->data,dbt->real_database));
+      scheduler_add_job(i->data);
       i=i->next;
     }
     dbt->count=g_list_length(dbt->restore_job_list);
@@ -253,6 +269,7 @@ void load_directory_information(struct configuration *conf) {
   }
   conf->table_list=table_list;
   // conf->table needs to be set.
+  scheduler_seal(conf->table_hash);
 
   g_debug("Processing trigger files");
   while (trigger_list != NULL){
@@ -274,11 +291,11 @@ void load_directory_information(struct configuration *conf) {
     view_list=view_list->next;
   }
 
+  prepare_post_objects();
   g_debug("Loading file completed");
 }
 
 void *process_directory_queue(struct thread_data * td) {
-  struct db_table *dbt=NULL;
   struct control_job *job = NULL;
   gboolean cont=TRUE;
 
@@ -290,99 +307,13 @@ void *process_directory_queue(struct thread_data * td) {
     f = (gchar *)g_async_queue_pop(data_filename_queue);
   }
   g_async_queue_push(data_filename_queue_completed, GINT_TO_POINTER(1) );
-  // Step 1: creating databases
+  // Databases, tables, data and indexes are restored as soon as the
+  // objects they depend on are done
+  run_scheduler(td);
+  // Wait until all the threads finished before the post table tasks
   cont=TRUE;
   while (cont){
-    job = (struct control_job *)g_async_queue_pop(td->conf->database_queue);
-    cont=process_job(td, job);
-  }
-  // Step 2: Create tables
-  cont=TRUE;
-  while (cont){
-    job = (struct control_job *)g_async_queue_pop(td->conf->table_queue);
-    execute_use_if_needs_to(td, job->use_database, "Restoring tables");
-    cont=process_job(td, job);
-  }
-
-  // Is this correct in a streaming scenario ?
-  GList *table_list=td->conf->table_list;
-  if (table_list == NULL ) {
-    dbt=NULL;
-  }else{
-    dbt=table_list->data;
-    g_mutex_lock(dbt->mutex);
-    dbt->current_threads++;
-    if (dbt->start_time==NULL)
-      dbt->start_time=g_date_time_new_now_local();
-    g_mutex_unlock(dbt->mutex);
-  }
-
-
-  // Step 3: Load data
-  cont=TRUE;
-  while (cont){
-    if (dbt != NULL){
-      g_mutex_lock(dbt->mutex);
-      if (dbt->current_threads > dbt->max_threads){
-        dbt->current_threads--;
-        g_mutex_unlock(dbt->mutex);
-        table_list=table_list->next;
-        if (table_list == NULL ){
-          dbt=NULL;
-          continue;
-        }
-        dbt=table_list->data;
-        g_mutex_lock(dbt->mutex);
-        if (dbt->start_time==NULL) dbt->start_time=g_date_time_new_now_local();
-        dbt->current_threads++;
-        g_mutex_unlock(dbt->mutex);
-        continue;
-      }
-      g_mutex_unlock(dbt->mutex);
-
-      job = (struct control_job *)g_async_queue_try_pop(dbt->queue);
-
-      if (job == NULL){
-        g_mutex_lock(dbt->mutex);
-        dbt->current_threads--;
-        if (dbt->current_threads == 0){
-          dbt->current_threads--;
-          dbt->start_index_time=g_date_time_new_now_local();
-          g_mutex_unlock(dbt->mutex);
-          if (dbt->indexes != NULL){ 
-            if (innodb_optimize_keys_per_table ) {
-              g_message("Thread %d restoring indexes `%s`.`%s`", td->thread_id,
-                  dbt->real_database, dbt->real_table);
-              guint query_counter=0;
-              restore_data_in_gstring(td, dbt->indexes, FALSE, &query_counter);
-            }else if (innodb_optimize_keys_all_tables ){
-              struct restore_job *rj = new_schema_restore_job(strdup("index"),JOB_RESTORE_STRING, dbt, dbt->real_database,dbt->indexes,"indexes");
-              g_async_queue_push(td->conf->post_table_queue, new_job(JOB_RESTORE,rj,dbt->real_database));
-            }else{
-              g_critical("This should not happen, wrong config on --innodb-optimize-keys");
-            }
-          }
-          dbt->finish_time=g_date_time_new_now_local();
-        }else{
-          g_mutex_unlock(dbt->mutex);
-        }
-        guint max=dbt->max_threads;
-        table_list=table_list->next;
-        if (table_list == NULL ){
-          dbt=NULL;
-          continue;
-        }
-        dbt=table_list->data;
-        g_mutex_lock(dbt->mutex);
-        if (dbt->start_time==NULL) dbt->start_time=g_date_time_new_now_local();
-        dbt->max_threads = max;
-        dbt->current_threads++;
-        g_mutex_unlock(dbt->mutex);
-        continue;
-      }
-    }else{
-     job = (struct control_job *)g_async_queue_pop(td->conf->data_queue);
-    }
+    job = (struct control_job *)g_async_queue_pop(td->conf->data_queue);
     execute_use_if_needs_to(td, job->use_database, "Restoring data");
     cont=process_job(td, job);
   }
@@ -415,26 +346,17 @@ gchar * print_time(GTimeSpan timespan){
 }
 
 void restore_from_directory(struct configuration *conf){
-  // Leaving just on thread to execute the add constraints as it might cause deadlocks
   guint n=0;
-  for (n = 0; n < num_threads-1; n++) {
-    g_async_queue_push(conf->post_queue, new_job(JOB_SHUTDOWN,NULL,NULL));
-  }
+  trace_phase("load directory", TRUE);
   load_directory_information(conf);
-  sync_threads_on_queue(conf->ready,conf->database_queue,"Step 1 completed, Databases created");
-  for (n = 0; n < num_threads; n++) {
-    g_async_queue_push(conf->database_queue, new_job(JOB_SHUTDOWN,NULL,NULL));
-  }
-  sync_threads_on_queue(conf->ready,conf->table_queue,"Step 2 completed, Tables created");
-  for (n = 0; n < num_threads; n++) {
-    g_async_queue_push(conf->table_queue, new_job(JOB_SHUTDOWN,NULL,NULL));
-  }
+  trace_phase("load directory", FALSE);
   // We need to sync all the threads before continue
-  sync_threads_on_queue(conf->ready,conf->data_queue,"Step 3 completed, load data finished");
+  trace_phase("databases, tables, data and indexes", TRUE);
+  sync_threads_on_queue(conf->ready,conf->data_queue,"Databases, tables, data and indexes restored");
+  trace_phase("databases, tables, data and indexes", FALSE);
   for (n = 0; n < num_threads; n++) {
     g_async_queue_push(conf->data_queue, new_job(JOB_SHUTDOWN,NULL,NULL));
   }
-  g_async_queue_push(conf->post_queue, new_job(JOB_SHUTDOWN,NULL,NULL));
   g_debug("Step 4 completed");
 
   GList * t=g_list_sort(conf->table_list, compare_by_time);
@@ -448,12 +370,4 @@ void restore_from_directory(struct configuration *conf){
     t=t->next;
   }
   innodb_optimize_keys=FALSE;
-
-  for (n = 0; n < num_threads; n++) {
-    g_async_queue_push(conf->post_table_queue, new_job(JOB_SHUTDOWN,NULL,NULL));
-  }
-  // Step 5: Create remaining objects.
-  // TODO: is it possible to do it in parallel? Actually, why aren't we queuing this files?
-  g_debug("Step 5 started");
-
 }
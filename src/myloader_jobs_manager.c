@@ -30,7 +30,12 @@
 #include "myloader_restore.h"
 #include "myloader_restore_job.h"
 #include "myloader_control_job.h"
+#include "myloader_constraints.h"
+#include "myloader_post.h"
 #include "connection.h"
+#include "stages.h"
+#include "trace.h"
+#include "query_profile.h"
 #include <errno.h>
 
 extern gchar *db;
@@ -38,6 +43,7 @@ extern gchar *set_names_str;
 extern GString *set_session;
 extern guint num_threads;
 extern gboolean stream;
+extern guint commit_count;
 
 static GMutex *init_mutex=NULL;
 
@@ -52,13 +58,15 @@ void *loader_thread(struct thread_data *td) {
   td->thrconn = mysql_init(NULL);
   g_mutex_unlock(init_mutex);
   td->current_database=NULL;
+  stage_register_thread(td->thread_id);
+  trace_thread_name(td->thread_id, "loader");
 
   m_connect(td->thrconn, "myloader", NULL);
 
-  mysql_query(td->thrconn, set_names_str);
-  mysql_query(td->thrconn, "/*!40101 SET SQL_MODE='NO_AUTO_VALUE_ON_ZERO' */");
-  mysql_query(td->thrconn, "/*!40014 SET UNIQUE_CHECKS=0 */");
-  mysql_query(td->thrconn, "/*!40014 SET FOREIGN_KEY_CHECKS=0*/");
+  profiled_query(td->thrconn, set_names_str);
+  profiled_query(td->thrconn, "/*!40101 SET SQL_MODE='NO_AUTO_VALUE_ON_ZERO' */");
+  profiled_query(td->thrconn, "/*!40014 SET UNIQUE_CHECKS=0 */");
+  profiled_query(td->thrconn, "/*!40014 SET FOREIGN_KEY_CHECKS=0*/");
 
   execute_gstring(td->thrconn, set_session);
   g_async_queue_push(conf->ready, GINT_TO_POINTER(1));
@@ -77,24 +85,15 @@ void *loader_thread(struct thread_data *td) {
   }else{
     process_directory_queue(td);
   }
-  struct control_job *job = NULL;
-  gboolean cont=TRUE;
 
 //  g_message("Thread %d: Starting post import task over table", td->thread_id);
-  cont=TRUE;
-  while (cont){
-    job = (struct control_job *)g_async_queue_pop(conf->post_table_queue);
-//    g_message("%s",((struct restore_job *)job->job_data)->object);
-    execute_use_if_needs_to(td, job->use_database, "Restoring post table");
-    cont=process_job(td, job);
-  }
+  guint64 trace_start=trace_clock();
+  run_constraints(td);
+  trace_span(td->thread_id, "post", "constraints", NULL, trace_start);
 //  g_message("Thread %d: Starting post import task: triggers, procedures and triggers", td->thread_id);
-  cont=TRUE;
-  while (cont){
-    job = (struct control_job *)g_async_queue_pop(conf->post_queue);
-    execute_use_if_needs_to(td, job->use_database, "Restoring post tasks");
-    cont=process_job(td, job);
-  }
+  trace_start=trace_clock();
+  run_post_objects(td);
+  trace_span(td->thread_id, "post", "post objects", NULL, trace_start);
 
   if (td->thrconn)
     mysql_close(td->thrconn);
@@ -113,6 +112,11 @@ void initialize_loader_threads(struct configuration *conf){
   for (n = 0; n < num_threads; n++) {
     td[n].conf = conf;
     td[n].thread_id = n + 1;
+    td[n].current_filename = NULL;
+    td[n].current_dbt = NULL;
+    td[n].commit_size = commit_count;
+    td[n].transaction_bytes = 0;
+    td[n].async_file = NULL;
     threads[n] =
         g_thread_create((GThreadFunc)loader_thread, &td[n], TRUE, NULL);
     // Here, the ready queue is being used to serialize the connection to the database.
@@ -0,0 +1,145 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "myloader.h"
+#include "myloader_journal.h"
+
+extern gchar *directory;
+extern gboolean resume;
+extern gboolean stream;
+
+/*
+  The restore journal is an append only file in the backup directory. Each
+  line is the name of a file followed by a tab and either the number of
+  statements of that file that have been committed or "done" once the whole
+  file has been restored. The last line of a file wins. With --resume, done
+  files are skipped and the data files skip the committed statements.
+
+  Each line is written and synced to disk as soon as the COMMIT it records
+  returns, before the thread sends anything else to the server.
+*/
+
+#define JOURNAL_DONE_PTR GSIZE_TO_POINTER(G_MAXSIZE)
+
+gchar *journal_filename=NULL;
+FILE *journal_file=NULL;
+GMutex *journal_mutex=NULL;
+GHashTable *journal_hash=NULL;
+
+gboolean journal_exists(){
+  gchar *path=g_build_filename(directory, "restore-journal", NULL);
+  gboolean r=g_file_test(path, G_FILE_TEST_EXISTS);
+  g_free(path);
+  return r;
+}
+
+static void load_journal(){
+  gchar *content=NULL, **lines=NULL, *tab=NULL;
+  GError *error=NULL;
+  guint i;
+  if (!g_file_get_contents(journal_filename, &content, NULL, &error)){
+    g_critical("Restore journal %s could not be read: %s", journal_filename, error->message);
+    exit(EXIT_FAILURE);
+  }
+  lines=g_strsplit(content, "\n", -1);
+  g_free(content);
+  for (i=0; lines[i] != NULL; i++){
+    tab=strrchr(lines[i], '\t');
+    if (tab == NULL)
+      continue;
+    *tab='\0';
+    g_hash_table_insert(journal_hash, g_strdup(lines[i]),
+        g_strcmp0(tab+1, "done") == 0 ? JOURNAL_DONE_PTR : GSIZE_TO_POINTER(g_ascii_strtoull(tab+1, NULL, 10)));
+  }
+  g_strfreev(lines);
+  g_message("Restore journal loaded, %u files were already started", g_hash_table_size(journal_hash));
+}
+
+void initialize_journal(){
+  if (stream)
+    return;
+  journal_mutex=g_mutex_new();
+  journal_hash=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  journal_filename=g_build_filename(directory, "restore-journal", NULL);
+  if (g_file_test(journal_filename, G_FILE_TEST_EXISTS)){
+    if (!resume){
+      g_critical("restore-journal file found, but no --resume option passed. Use --resume or remove it and restart process if you consider that it will be safe.");
+      exit(EXIT_FAILURE);
+    }
+    load_journal();
+  }
+  // A read-only backup directory can be restored, but not resumed
+  journal_file=g_fopen(journal_filename, "a");
+  if (journal_file == NULL)
+    g_warning("Restore journal %s could not be opened, this restore will not be able to be resumed", journal_filename);
+}
+
+static void journal_write(const gchar *filename, const gchar *value){
+  g_mutex_lock(journal_mutex);
+  if (fprintf(journal_file, "%s\t%s\n", filename, value) < 0 || fflush(journal_file) != 0 || fsync(fileno(journal_file)) != 0)
+    g_warning("Restore journal %s could not be written, %s might be restored again with --resume", journal_filename, filename);
+  g_mutex_unlock(journal_mutex);
+}
+
+void journal_committed(const gchar *filename, guint64 statements){
+  gchar *value=NULL;
+  if (journal_file == NULL)
+    return;
+  value=g_strdup_printf("%" G_GUINT64_FORMAT, statements);
+  journal_write(filename, value);
+  g_free(value);
+}
+
+void journal_commit(struct thread_data *td){
+  if (td->current_filename != NULL)
+    journal_committed(td->current_filename, td->statements);
+}
+
+void journal_file_done(const gchar *filename){
+  if (journal_file != NULL)
+    journal_write(filename, "done");
+}
+
+gboolean journal_is_done(const gchar *filename){
+  gpointer value=NULL;
+  if (journal_hash == NULL || !g_hash_table_lookup_extended(journal_hash, filename, NULL, &value))
+    return FALSE;
+  return value == JOURNAL_DONE_PTR;
+}
+
+guint64 journal_committed_statements(const gchar *filename){
+  gpointer value=NULL;
+  if (journal_hash == NULL || !g_hash_table_lookup_extended(journal_hash, filename, NULL, &value) || value == JOURNAL_DONE_PTR)
+    return 0;
+  return GPOINTER_TO_SIZE(value);
+}
+
+// The journal is only kept when the restore did not finish
+void finish_journal(gboolean completed){
+  if (journal_file == NULL)
+    return;
+  fclose(journal_file);
+  journal_file=NULL;
+  if (completed)
+    g_remove(journal_filename);
+}
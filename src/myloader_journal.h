@@ -0,0 +1,30 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_myloader_journal_h
+#define _src_myloader_journal_h
+#include "myloader.h"
+
+void initialize_journal();
+gboolean journal_exists();
+void journal_committed(const gchar *filename, guint64 statements);
+void journal_commit(struct thread_data *td);
+void journal_file_done(const gchar *filename);
+gboolean journal_is_done(const gchar *filename);
+guint64 journal_committed_statements(const gchar *filename);
+void finish_journal(gboolean completed);
+#endif
@@ -0,0 +1,122 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mysql.h>
+#include "myloader.h"
+#include "myloader_manifest.h"
+
+/* The manifest is written by mydumper, one tab separated line per file:
+ *   type filename database table part sub_part bytes rows crc32 key_range
+ * When it is present we don't need to list the directory, guess the type
+ * of each file from its name nor open the -metadata files. */
+
+static GHashTable *manifest_hash = NULL;
+static GList *manifest_list = NULL;
+
+static enum file_type get_manifest_file_type(const gchar *type){
+  if (g_strcmp0(type, "data") == 0)
+    return DATA;
+  if (g_strcmp0(type, "metadata") == 0)
+    return METADATA_TABLE;
+  if (g_strcmp0(type, "schema") == 0)
+    return SCHEMA_TABLE;
+  if (g_strcmp0(type, "schema-create") == 0)
+    return SCHEMA_CREATE;
+  if (g_strcmp0(type, "schema-view") == 0)
+    return SCHEMA_VIEW;
+  if (g_strcmp0(type, "schema-triggers") == 0)
+    return SCHEMA_TRIGGER;
+  if (g_strcmp0(type, "schema-post") == 0)
+    return SCHEMA_POST;
+  if (g_strcmp0(type, "tablespace") == 0)
+    return SCHEMA_TABLESPACE;
+  if (g_strcmp0(type, "checksum") == 0)
+    return CHECKSUM;
+  if (g_strcmp0(type, "load-data") == 0)
+    return LOAD_DATA;
+  return IGNORED;
+}
+
+gboolean load_manifest(const gchar *directory){
+  gchar *path = g_build_filename(directory, "manifest", NULL);
+  gchar *content = NULL;
+  GError *error = NULL;
+  if (!g_file_test(path, G_FILE_TEST_EXISTS)){
+    g_free(path);
+    return FALSE;
+  }
+  if (!g_file_get_contents(path, &content, NULL, &error)){
+    g_warning("Manifest file %s could not be read, the directory will be scanned: %s", path, error->message);
+    g_error_free(error);
+    g_free(path);
+    return FALSE;
+  }
+  manifest_hash = g_hash_table_new(g_str_hash, g_str_equal);
+  gchar **lines = g_strsplit(content, "\n", -1);
+  g_free(content);
+  guint i=0;
+  for (i=0; lines[i] != NULL; i++){
+    if (lines[i][0] == '\0' || lines[i][0] == '#')
+      continue;
+    gchar **fields = g_strsplit(lines[i], "\t", 10);
+    if (g_strv_length(fields) != 10){
+      g_critical("Line %d of manifest file %s is malformed, the directory will be scanned", i + 1, path);
+      g_strfreev(fields);
+      g_strfreev(lines);
+      g_free(path);
+      g_list_free(manifest_list);
+      manifest_list = NULL;
+      g_hash_table_destroy(manifest_hash);
+      manifest_hash = NULL;
+      return FALSE;
+    }
+    struct manifest_entry *e = g_new(struct manifest_entry, 1);
+    e->type = get_manifest_file_type(fields[0]);
+    e->filename = g_strcompress(fields[1]);
+    e->database = g_strcompress(fields[2]);
+    e->table = g_strcompress(fields[3]);
+    e->part = g_ascii_strtoull(fields[4], NULL, 10);
+    e->sub_part = g_ascii_strtoull(fields[5], NULL, 10);
+    e->bytes = g_ascii_strtoull(fields[6], NULL, 10);
+    e->rows = g_ascii_strtoull(fields[7], NULL, 10);
+    e->crc = g_ascii_strtoull(fields[8], NULL, 16);
+    e->key_range = g_strcompress(fields[9]);
+    g_strfreev(fields);
+    g_hash_table_insert(manifest_hash, e->filename, e);
+    manifest_list = g_list_prepend(manifest_list, e);
+  }
+  g_strfreev(lines);
+  manifest_list = g_list_reverse(manifest_list);
+  g_message("Using manifest file %s with %d files", path, g_hash_table_size(manifest_hash));
+  g_free(path);
+  return TRUE;
+}
+
+GList *get_manifest_entries(){
+  return manifest_list;
+}
+
+struct manifest_entry *get_manifest_entry(const gchar *filename){
+  if (manifest_hash == NULL)
+    return NULL;
+  return g_hash_table_lookup(manifest_hash, filename);
+}
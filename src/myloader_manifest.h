@@ -0,0 +1,38 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_myloader_manifest_h
+#define _src_myloader_manifest_h
+#include "myloader.h"
+
+struct manifest_entry {
+  gchar *filename;
+  enum file_type type;
+  gchar *database;
+  gchar *table;
+  guint part;
+  guint sub_part;
+  guint64 bytes;
+  guint64 rows;
+  guint32 crc;
+  gchar *key_range;
+};
+
+gboolean load_manifest(const gchar *directory);
+GList *get_manifest_entries();
+struct manifest_entry *get_manifest_entry(const gchar *filename);
+#endif
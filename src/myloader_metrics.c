@@ -0,0 +1,179 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <glib.h>
+#include <string.h>
+#include "myloader.h"
+#include "metrics.h"
+#include "myloader_metrics.h"
+
+/*
+  The bytes and rows restored are added to the db_table and to the global
+  counters with relaxed atomics by the thread that executes the statement.
+  A table is only exported while it is active: from its first data job
+  until its indexes are built, plus one more time once it is done. So the
+  PMM thread does not go over all the tables every second. The progress and
+  the ETA of a table come from the rows of its metadata file.
+*/
+
+static const gchar *phase_names[]={"data", "indexes", "done"};
+
+struct table_rate {
+  enum table_phase phase;
+  guint64 last_rows;
+  gdouble rate;
+};
+
+static gboolean metrics_enabled=FALSE;
+static GMutex *active_mutex=NULL;
+static GHashTable *active_tables=NULL;
+static guint64 statements=0;
+static guint64 bytes_read=0;
+static guint64 bytes_decompressed=0;
+static guint64 commits=0;
+static guint64 commit_microseconds=0;
+static guint64 commit_buckets[METRICS_BUCKETS + 1];
+static guint tables_done=0;
+static GTimer *metrics_timer=NULL;
+static gdouble last_elapsed=0;
+static guint64 last_statements=0, last_bytes_read=0, last_bytes_decompressed=0;
+
+void initialize_metrics(){
+  active_mutex=g_mutex_new();
+  active_tables=g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  metrics_timer=g_timer_new();
+  metrics_enabled=TRUE;
+}
+
+// The restored_bytes and loaded_rows of the table are always counted, the
+// monitor uses them
+void metrics_statement(struct db_table *dbt, gsize bytes, guint64 rows){
+  if (dbt != NULL){
+    METRIC_ADD(dbt->restored_bytes, bytes);
+    METRIC_ADD(dbt->loaded_rows, rows);
+  }
+  if (metrics_enabled)
+    METRIC_ADD(statements, 1);
+}
+
+void metrics_read(gsize bytes, gboolean is_compressed){
+  if (!metrics_enabled)
+    return;
+  if (is_compressed)
+    METRIC_ADD(bytes_decompressed, bytes);
+  else
+    METRIC_ADD(bytes_read, bytes);
+}
+
+void metrics_commit(gdouble seconds){
+  guint i;
+  if (!metrics_enabled)
+    return;
+  for (i=0; i < METRICS_BUCKETS && seconds > metrics_buckets[i]; i++);
+  METRIC_ADD(commit_buckets[i], 1);
+  METRIC_ADD(commits, 1);
+  METRIC_ADD(commit_microseconds, (guint64)(seconds * G_USEC_PER_SEC));
+}
+
+void metrics_table_phase(struct db_table *dbt, enum table_phase phase){
+  struct table_rate *tr=NULL;
+  if (!metrics_enabled)
+    return;
+  g_mutex_lock(active_mutex);
+  tr=g_hash_table_lookup(active_tables, dbt);
+  if (tr == NULL){
+    tr=g_new0(struct table_rate, 1);
+    g_hash_table_insert(active_tables, dbt, tr);
+  }
+  tr->phase=phase;
+  g_mutex_unlock(active_mutex);
+}
+
+static void write_table(GString *content, struct db_table *dbt, struct table_rate *tr, gdouble interval){
+  guint64 rows=METRIC_GET(dbt->loaded_rows);
+  GString *labels=g_string_sized_new(64);
+  gdouble progress;
+  append_label(labels, "database", dbt->real_database);
+  g_string_append_c(labels, ',');
+  append_label(labels, "table", dbt->real_table);
+  if (interval > 0)
+    tr->rate=tr->last_rows == 0 ? (rows - tr->last_rows) / interval :
+             METRICS_RATE_WEIGHT * (rows - tr->last_rows) / interval + (1 - METRICS_RATE_WEIGHT) * tr->rate;
+  tr->last_rows=rows;
+  g_string_append_printf(content, "myloader_table_phase{%s,phase=\"%s\"} 1\n",
+                         labels->str, phase_names[tr->phase]);
+  g_string_append_printf(content, "myloader_table_jobs{%s} %u\n",
+                         labels->str, dbt->queued_jobs);
+  g_string_append_printf(content, "myloader_table_bytes_total{%s} %" G_GUINT64_FORMAT "\n",
+                         labels->str, METRIC_GET(dbt->restored_bytes));
+  g_string_append_printf(content, "myloader_table_rows_total{%s} %" G_GUINT64_FORMAT "\n",
+                         labels->str, rows);
+  g_string_append_printf(content, "myloader_table_rows_per_second{%s} %.0f\n",
+                         labels->str, tr->rate);
+  if (dbt->rows > 0){
+    progress=tr->phase == TABLE_PHASE_DATA ? MIN(1.0, (gdouble)rows / dbt->rows) : 1.0;
+    g_string_append_printf(content, "myloader_table_progress_ratio{%s} %.4f\n",
+                           labels->str, progress);
+    if (tr->phase == TABLE_PHASE_DATA && tr->rate > 0)
+      g_string_append_printf(content, "myloader_table_eta_seconds{%s} %.0f\n",
+                             labels->str, rows < dbt->rows ? (dbt->rows - rows) / tr->rate : 0);
+  }
+  g_string_free(labels, TRUE);
+}
+
+static void write_rate(GString *content, const gchar *name, guint64 value, guint64 *last, gdouble interval){
+  g_string_append_printf(content, "myloader_%s_total %" G_GUINT64_FORMAT "\n", name, value);
+  if (interval > 0)
+    g_string_append_printf(content, "myloader_%s_per_second %.0f\n", name, (value - *last) / interval);
+  *last=value;
+}
+
+void write_metrics(GString *content){
+  GHashTableIter iter;
+  struct db_table *dbt=NULL;
+  struct table_rate *tr=NULL;
+  guint64 buckets=0;
+  gdouble elapsed, interval;
+  guint b;
+  if (!metrics_enabled)
+    return;
+  elapsed=g_timer_elapsed(metrics_timer, NULL);
+  interval=elapsed - last_elapsed;
+  last_elapsed=elapsed;
+  g_mutex_lock(active_mutex);
+  g_hash_table_iter_init(&iter, active_tables);
+  while (g_hash_table_iter_next(&iter, (gpointer *) &dbt, (gpointer *) &tr)){
+    write_table(content, dbt, tr, interval);
+    if (tr->phase == TABLE_PHASE_DONE){
+      tables_done++;
+      g_hash_table_iter_remove(&iter);
+    }
+  }
+  g_string_append_printf(content, "myloader_tables_active %u\n", g_hash_table_size(active_tables));
+  g_string_append_printf(content, "myloader_tables_done %u\n", tables_done);
+  g_mutex_unlock(active_mutex);
+  write_rate(content, "statements", METRIC_GET(statements), &last_statements, interval);
+  write_rate(content, "bytes_read", METRIC_GET(bytes_read), &last_bytes_read, interval);
+  write_rate(content, "bytes_decompressed", METRIC_GET(bytes_decompressed), &last_bytes_decompressed, interval);
+  for (b=0; b < METRICS_BUCKETS; b++){
+    buckets+=METRIC_GET(commit_buckets[b]);
+    g_string_append_printf(content, "myloader_commit_seconds_bucket{le=\"%g\"} %" G_GUINT64_FORMAT "\n", metrics_buckets[b], buckets);
+  }
+  g_string_append_printf(content, "myloader_commit_seconds_bucket{le=\"+Inf\"} %" G_GUINT64_FORMAT "\n", METRIC_GET(commits));
+  g_string_append_printf(content, "myloader_commit_seconds_sum %.6f\n", (gdouble)METRIC_GET(commit_microseconds) / G_USEC_PER_SEC);
+  g_string_append_printf(content, "myloader_commit_seconds_count %" G_GUINT64_FORMAT "\n", METRIC_GET(commits));
+}
@@ -0,0 +1,30 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_myloader_metrics_h
+#define _src_myloader_metrics_h
+#include "myloader.h"
+
+enum table_phase { TABLE_PHASE_DATA, TABLE_PHASE_INDEXES, TABLE_PHASE_DONE };
+
+void initialize_metrics();
+void metrics_statement(struct db_table *dbt, gsize bytes, guint64 rows);
+void metrics_read(gsize bytes, gboolean is_compressed);
+void metrics_commit(gdouble seconds);
+void metrics_table_phase(struct db_table *dbt, enum table_phase phase);
+void write_metrics(GString *content);
+#endif
@@ -0,0 +1,375 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <mysql.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "myloader.h"
+#include "myloader_scheduler.h"
+#include "myloader_monitor.h"
+#include "connection.h"
+#include "query_profile.h"
+
+extern guint num_threads;
+extern GMutex *table_hash_mutex;
+extern gboolean adaptive_threads_per_table;
+extern guint throttle_threads_running;
+extern guint throttle_replica_lag;
+extern guint throttle_history_list_length;
+extern gchar *throttle_replica;
+extern gboolean shutdown_triggered;
+extern char *username;
+extern char *password;
+
+/*
+  The monitor thread samples the server every second with its own
+  connection. With --adaptive-threads-per-table, every
+  MONITOR_SAMPLES_PER_ROUND samples it changes the max_threads of each
+  table that is loading data:
+  - a table whose inserts waited for row locks loses a thread,
+  - a table that got one more thread in the previous round and did not
+    load at least 5% faster gives it back and is left alone for a while,
+  - a table that is using all its threads and has jobs queued gets one
+    more, up to --threads.
+  The lock waits come from performance_schema.data_lock_waits. When it is
+  not available, an increase of Innodb_row_lock_waits stops the increases
+  for all the tables.
+
+  The throttle checks Threads_running, the lag of a replica and the history
+  list length every second against their --throttle-* limits. When one is
+  over its limit, half of the running threads are paused, and when all are
+  under 80% of their limit, one paused thread is resumed. The throttle
+  keeps the number of threads that have to be paused, and that many threads
+  wait on throttle_cond before their next job or transaction.
+*/
+
+#define MONITOR_SAMPLES_PER_ROUND 5
+#define MONITOR_HOLD_ROUNDS 3
+
+struct table_controller {
+  guint64 last_bytes;
+  guint64 last_rate;
+  guint lock_waits;
+  guint hold;
+  gboolean raised;
+  gboolean indexed;
+};
+
+static GThread *monitor_thread=NULL;
+static gboolean monitor_stop=FALSE;
+static GHashTable *controllers=NULL;
+static GHashTable *tables_by_name=NULL;
+static gboolean per_table_lock_waits=TRUE;
+static guint64 last_row_lock_waits=0;
+static gboolean global_lock_waits=FALSE;
+static GMutex *throttle_mutex=NULL;
+static GCond *throttle_cond=NULL;
+static guint throttle_paused=0;
+static guint throttle_waiting=0;
+static MYSQL *replica_conn=NULL;
+
+static struct table_controller *get_controller(struct db_table *dbt){
+  struct table_controller *c=g_hash_table_lookup(controllers, dbt);
+  if (c == NULL){
+    c=g_new0(struct table_controller,1);
+    g_hash_table_insert(controllers, dbt, c);
+  }
+  return c;
+}
+
+// The table_hash is keyed on the names of the files, the server reports
+// the names the tables were restored with. tables_by_name is keyed on those,
+// the tables are added by adjust_tables once they are created
+static void index_table(struct db_table *dbt){
+  struct table_controller *c=get_controller(dbt);
+  if (c->indexed)
+    return;
+  g_hash_table_insert(tables_by_name, g_strdup_printf("%s.%s", dbt->real_database, dbt->real_table), dbt);
+  c->indexed=TRUE;
+}
+
+static struct db_table *find_table(const gchar *database, const gchar *table){
+  gchar *key=g_strdup_printf("%s.%s", database, table);
+  struct db_table *dbt=g_hash_table_lookup(tables_by_name, key);
+  g_free(key);
+  return dbt;
+}
+
+static void sample_table_lock_waits(MYSQL *conn){
+  MYSQL_RES *result=NULL;
+  MYSQL_ROW row;
+  struct db_table *dbt=NULL;
+  if (profiled_query(conn, "SELECT l.OBJECT_SCHEMA, l.OBJECT_NAME, COUNT(*) FROM performance_schema.data_lock_waits w "
+                        "JOIN performance_schema.data_locks l ON l.ENGINE_LOCK_ID = w.REQUESTING_ENGINE_LOCK_ID "
+                        "GROUP BY l.OBJECT_SCHEMA, l.OBJECT_NAME")){
+    g_message("performance_schema.data_lock_waits is not available, using Innodb_row_lock_waits: %s", mysql_error(conn));
+    per_table_lock_waits=FALSE;
+    return;
+  }
+  result=profiled_store_result(conn);
+  while (result != NULL && (row=mysql_fetch_row(result)) != NULL){
+    if (row[0] == NULL || row[1] == NULL)
+      continue;
+    dbt=find_table(row[0], row[1]);
+    if (dbt != NULL)
+      get_controller(dbt)->lock_waits+=g_ascii_strtoull(row[2], NULL, 10);
+  }
+  if (result != NULL)
+    mysql_free_result(result);
+}
+
+static void sample_global_lock_waits(MYSQL *conn){
+  MYSQL_RES *result=NULL;
+  MYSQL_ROW row;
+  guint64 waits=0;
+  if (profiled_query(conn, "SHOW GLOBAL STATUS LIKE 'Innodb_row_lock_waits'"))
+    return;
+  result=profiled_store_result(conn);
+  if (result != NULL && (row=mysql_fetch_row(result)) != NULL && row[1] != NULL){
+    waits=g_ascii_strtoull(row[1], NULL, 10);
+    if (last_row_lock_waits > 0 && waits > last_row_lock_waits)
+      global_lock_waits=TRUE;
+    last_row_lock_waits=waits;
+  }
+  if (result != NULL)
+    mysql_free_result(result);
+}
+
+static void adjust_table(struct db_table *dbt, struct table_load *load, guint seconds){
+  struct table_controller *c=get_controller(dbt);
+  guint64 bytes, rate;
+  guint max_threads=load->max_threads;
+  bytes=__atomic_load_n(&dbt->restored_bytes, __ATOMIC_RELAXED);
+  rate=(bytes - c->last_bytes)/seconds;
+  if (c->lock_waits > 0){
+    if (max_threads > 1)
+      max_threads--;
+    c->hold=MONITOR_HOLD_ROUNDS;
+  }else if (c->raised && rate*100 < c->last_rate*105){
+    if (max_threads > 1)
+      max_threads--;
+    c->hold=MONITOR_HOLD_ROUNDS;
+  }else if (c->hold > 0){
+    c->hold--;
+  }else if (!global_lock_waits && load->current_threads >= max_threads && load->queued_jobs > 0 && max_threads < num_threads){
+    max_threads++;
+  }
+  c->raised=max_threads > load->max_threads;
+  if (max_threads != load->max_threads){
+    g_debug("Threads for `%s`.`%s` changed from %u to %u, %" G_GUINT64_FORMAT " bytes/s and %u lock waits",
+            dbt->real_database, dbt->real_table, load->max_threads, max_threads, rate, c->lock_waits);
+    scheduler_set_max_threads(dbt, max_threads);
+  }
+  c->last_bytes=bytes;
+  c->last_rate=rate;
+  c->lock_waits=0;
+}
+
+static void adjust_tables(struct configuration *conf){
+  GHashTableIter iter;
+  gchar *lkey=NULL;
+  struct db_table *dbt=NULL;
+  struct table_load load;
+  g_mutex_lock(table_hash_mutex);
+  g_hash_table_iter_init(&iter, conf->table_hash);
+  while (g_hash_table_iter_next(&iter, (gpointer *) &lkey, (gpointer *) &dbt)){
+    scheduler_get_table_load(dbt, &load);
+    if (load.schema_created)
+      index_table(dbt);
+    if (load.schema_created && !load.data_finished && (load.queued_jobs > 0 || load.current_threads > 0))
+      adjust_table(dbt, &load, MONITOR_SAMPLES_PER_ROUND);
+  }
+  g_mutex_unlock(table_hash_mutex);
+  global_lock_waits=FALSE;
+}
+
+static gboolean get_uint64(MYSQL *conn, const gchar *query, guint column, guint64 *value){
+  MYSQL_RES *result=NULL;
+  MYSQL_ROW row;
+  gboolean found=FALSE;
+  if (profiled_query(conn, query))
+    return FALSE;
+  result=profiled_store_result(conn);
+  if (result == NULL)
+    return FALSE;
+  if (mysql_num_fields(result) > column && (row=mysql_fetch_row(result)) != NULL && row[column] != NULL){
+    *value=g_ascii_strtoull(row[column], NULL, 10);
+    found=TRUE;
+  }
+  mysql_free_result(result);
+  return found;
+}
+
+static gboolean get_status_value(MYSQL *conn, const gchar *query, const gchar *column, guint64 *value){
+  MYSQL_RES *result=NULL;
+  MYSQL_FIELD *fields=NULL;
+  MYSQL_ROW row;
+  guint i;
+  gboolean found=FALSE;
+  if (profiled_query(conn, query))
+    return FALSE;
+  result=profiled_store_result(conn);
+  if (result == NULL)
+    return FALSE;
+  fields=mysql_fetch_fields(result);
+  if ((row=mysql_fetch_row(result)) != NULL)
+    for (i=0; i < mysql_num_fields(result); i++)
+      if (strcmp(fields[i].name, column) == 0 && row[i] != NULL){
+        *value=g_ascii_strtoull(row[i], NULL, 10);
+        found=TRUE;
+      }
+  mysql_free_result(result);
+  return found;
+}
+
+// The lag of the transactions that the workers are applying, or
+// Seconds_Behind_Master on servers without that table
+static gboolean get_replica_lag(MYSQL *conn, guint64 *lag){
+  if (get_uint64(conn, "SELECT IFNULL(MAX(TIMESTAMPDIFF(SECOND, APPLYING_TRANSACTION_ORIGINAL_COMMIT_TIMESTAMP, NOW())), 0) "
+                       "FROM performance_schema.replication_applier_status_by_worker WHERE APPLYING_TRANSACTION <> ''", 0, lag))
+    return TRUE;
+  return get_status_value(conn, "SHOW SLAVE STATUS", "Seconds_Behind_Master", lag);
+}
+
+static void connect_replica(){
+  gchar **host_port=g_strsplit(throttle_replica, ":", 2);
+  replica_conn=mysql_init(NULL);
+  configure_connection(replica_conn, "myloader");
+  if (!mysql_real_connect(replica_conn, host_port[0], username, password, NULL,
+                          host_port[1] != NULL ? atoi(host_port[1]) : 0, NULL, 0)) {
+    g_critical("Error connecting to the replica %s: %s", throttle_replica, mysql_error(replica_conn));
+    exit(EXIT_FAILURE);
+  }
+  g_strfreev(host_port);
+}
+
+static void pause_threads(guint n){
+  g_mutex_lock(throttle_mutex);
+  throttle_paused+=n;
+  g_mutex_unlock(throttle_mutex);
+}
+
+static void resume_threads(guint n){
+  g_mutex_lock(throttle_mutex);
+  throttle_paused=n < throttle_paused ? throttle_paused - n : 0;
+  g_cond_broadcast(throttle_cond);
+  g_mutex_unlock(throttle_mutex);
+}
+
+// While fewer threads than the paused ones are waiting, the thread waits
+// until one of the waiting threads is resumed
+void throttle_wait(){
+  if (throttle_mutex == NULL)
+    return;
+  g_mutex_lock(throttle_mutex);
+  if (throttle_waiting < throttle_paused){
+    throttle_waiting++;
+    while (throttle_waiting <= throttle_paused)
+      g_cond_wait(throttle_cond, throttle_mutex);
+    throttle_waiting--;
+  }
+  g_mutex_unlock(throttle_mutex);
+}
+
+static void throttle(MYSQL *conn){
+  guint64 value=0;
+  gboolean over=FALSE, near=FALSE;
+  guint n;
+  if (throttle_threads_running > 0 && get_status_value(conn, "SHOW GLOBAL STATUS LIKE 'Threads_running'", "Value", &value)){
+    over|=value > throttle_threads_running;
+    near|=value*10 > throttle_threads_running*8;
+  }
+  if (throttle_replica_lag > 0 && get_replica_lag(replica_conn != NULL ? replica_conn : conn, &value)){
+    over|=value > throttle_replica_lag;
+    near|=value*10 > throttle_replica_lag*8;
+  }
+  if (throttle_history_list_length > 0 &&
+      (get_uint64(conn, "SELECT COUNT FROM information_schema.INNODB_METRICS WHERE NAME='trx_rseg_history_len'", 0, &value) ||
+       get_status_value(conn, "SHOW GLOBAL STATUS LIKE 'Innodb_history_list_length'", "Value", &value))){
+    over|=value > throttle_history_list_length;
+    near|=value*10 > throttle_history_list_length*8;
+  }
+  if (over && throttle_paused < num_threads){
+    n=(num_threads - throttle_paused + 1)/2;
+    pause_threads(n);
+    g_message("Throttling, %u of %u threads are paused", throttle_paused, num_threads);
+  }else if (!near && throttle_paused > 0){
+    resume_threads(1);
+    if (throttle_paused == 0)
+      g_message("Throttling finished, all the threads are running");
+  }
+}
+
+static void *monitor(struct configuration *conf){
+  MYSQL *conn=mysql_init(NULL);
+  guint samples=0;
+  m_connect(conn, "myloader", NULL);
+  if (throttle_replica != NULL)
+    connect_replica();
+  while (!monitor_stop){
+    sleep(1);
+    if (throttle_mutex != NULL){
+      if (shutdown_triggered)
+        resume_threads(num_threads);
+      else
+        throttle(conn);
+    }
+    if (adaptive_threads_per_table){
+      if (per_table_lock_waits)
+        sample_table_lock_waits(conn);
+      if (!per_table_lock_waits)
+        sample_global_lock_waits(conn);
+      if (++samples == MONITOR_SAMPLES_PER_ROUND){
+        adjust_tables(conf);
+        samples=0;
+      }
+    }
+  }
+  if (throttle_mutex != NULL)
+    resume_threads(num_threads);
+  if (replica_conn != NULL)
+    mysql_close(replica_conn);
+  mysql_close(conn);
+  return NULL;
+}
+
+void initialize_monitor(struct configuration *conf){
+  GError *error=NULL;
+  if (throttle_threads_running > 0 || throttle_replica_lag > 0 || throttle_history_list_length > 0){
+    throttle_mutex=g_mutex_new();
+    throttle_cond=g_cond_new();
+  }else if (!adaptive_threads_per_table)
+    return;
+  controllers=g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  tables_by_name=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  monitor_thread=g_thread_create((GThreadFunc)monitor, conf, TRUE, &error);
+  if (monitor_thread == NULL){
+    g_critical("Could not create monitor thread: %s", error->message);
+    g_error_free(error);
+    exit(EXIT_FAILURE);
+  }
+}
+
+void stop_monitor(){
+  if (monitor_thread == NULL)
+    return;
+  monitor_stop=TRUE;
+  g_thread_join(monitor_thread);
+  monitor_thread=NULL;
+}
@@ -24,10 +24,10 @@
 #include <gio/gio.h>
 #include <mysql.h>
 #include "myloader.h"
+#include "myloader_metrics.h"
+#include "stages.h"
 extern gchar *pmm_resolution ;
 extern gchar *pmm_path;
-extern GAsyncQueue *stream_queue;
-extern gboolean stream;
 gint kill_pmm = 0;
 
 void kill_pmm_thread(){
@@ -39,30 +39,14 @@ void append_pmm_entry(GString *content, const gchar *key, GAsyncQueue * queue){
     g_string_append_printf(content,"myloader_queue{name=\"%s\"} %d\n",key,g_async_queue_length(queue));
 }
 
-void append_pmm_entry_tables(GString *content,struct configuration *conf){
-  GHashTableIter iter;
-  gchar * lkey;
-  if (conf->table_hash){
-    g_hash_table_iter_init ( &iter, conf->table_hash );
-    struct db_table *dbt=NULL;
-    while ( g_hash_table_iter_next ( &iter, (gpointer *) &lkey, (gpointer *) &dbt ) ) {
-      g_string_append_printf(content,"myloader_table{name=\"%s\"} %d\n",lkey,stream?(guint)g_list_length(dbt->restore_job_list):(guint)g_async_queue_length(dbt->queue));
-    }
-  }
-}
-
 void write_pmm_entries(const gchar* filename, GString *content, struct configuration* conf){
   g_string_set_size(content,0);
-  append_pmm_entry(content,"database_queue",    conf->database_queue);
-  append_pmm_entry(content,"table_queue",       conf->table_queue);
   append_pmm_entry(content,"ready",             conf->ready);
   append_pmm_entry(content,"data_queue",        conf->data_queue);
-  append_pmm_entry(content,"post_table_queue",  conf->post_table_queue);
-  append_pmm_entry(content,"post_queue",        conf->post_queue);
   append_pmm_entry(content,"pause_resume",      conf->pause_resume);
-  append_pmm_entry(content,"stream_queue",      stream_queue);
   append_pmm_entry(content,"ready",             conf->ready);
-  append_pmm_entry_tables(content,conf);
+  write_metrics(content);
+  write_stages(content, "myloader");
   g_file_set_contents( filename , content->str, content->len, NULL);
 }
 
@@ -0,0 +1,294 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef ZWRAP_USE_ZSTD
+#include "../zstd/zstd_zlibwrapper.h"
+#else
+#include <zlib.h>
+#endif
+#include "myloader.h"
+#include "myloader_common.h"
+#include "myloader_restore_job.h"
+#include "myloader_scheduler.h"
+#include "myloader_post.h"
+
+extern gchar *directory;
+
+/*
+  Triggers, views, routines and events are restored by all the threads.
+  Triggers and routines do not depend on each other. A view depends on the
+  views it selects from and on the post file of the functions it calls,
+  which are found by looking up the identifiers of its file. Each node runs
+  when all the nodes it depends on are done.
+*/
+
+GMutex *post_mutex=NULL;
+GCond *post_cond=NULL;
+GAsyncQueue *post_ready=NULL;
+GList *post_nodes=NULL;
+GList *routine_nodes=NULL;
+GHashTable *view_nodes=NULL;
+GHashTable *function_nodes=NULL;
+guint post_pending=0;
+
+void initialize_post_objects(){
+  post_mutex=g_mutex_new();
+  post_cond=g_cond_new();
+  post_ready=g_async_queue_new();
+  view_nodes=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  function_nodes=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+}
+
+void add_post_object(struct restore_job *rj, const gchar *table){
+  struct dag_node *node=g_new0(struct dag_node,1);
+  node->rj=rj;
+  node->use_database=rj->data.srj->database;
+  post_nodes=g_list_prepend(post_nodes, node);
+  if (g_strcmp0(rj->data.srj->object,"view") == 0 && table != NULL)
+    g_hash_table_insert(view_nodes, g_strdup_printf("%s.%s", rj->data.srj->database, table), node);
+  else if (g_strcmp0(rj->data.srj->object,"post") == 0)
+    routine_nodes=g_list_prepend(routine_nodes, node);
+}
+
+static void add_dependency(struct dag_node *parent, struct dag_node *child){
+  if (parent == child || g_list_find(parent->children, child) != NULL)
+    return;
+  parent->children=g_list_prepend(parent->children, child);
+  child->pending++;
+}
+
+static GString *read_file_content(const gchar *filename){
+  FILE *infile=NULL;
+  gboolean is_compressed=FALSE, eof=FALSE;
+  guint line=0;
+  gchar *path=g_build_filename(directory, filename, NULL);
+  GString *data=g_string_sized_new(1024);
+  ml_open(&infile, path, &is_compressed);
+  g_free(path);
+  if (!infile)
+    return data;
+  while (!eof)
+    read_data(infile, is_compressed, data, &eof, &line);
+  if (!is_compressed)
+    fclose(infile);
+  else
+    gzclose((gzFile)infile);
+  return data;
+}
+
+// The functions of a post file, keyed on `real_database`.`name`
+static void add_function_names(struct dag_node *node){
+  GString *data=read_file_content(node->rj->filename);
+  const gchar *p=data->str;
+  gchar *name=NULL;
+  while ((p=strstr(p,"FUNCTION `")) != NULL){
+    p+=9;
+    if ((name=read_identifier(&p)) == NULL)
+      break;
+    g_hash_table_insert(function_nodes, g_strdup_printf("%s.%s", node->use_database, name), node);
+    g_free(name);
+  }
+  g_string_free(data, TRUE);
+}
+
+static gboolean follows_keyword(const gchar *start, const gchar *p, const gchar *keyword){
+  gsize len=strlen(keyword);
+  while (p > start && g_ascii_isspace(p[-1]))
+    p--;
+  return (gsize)(p - start) >= len && g_ascii_strncasecmp(p - len, keyword, len) == 0 &&
+         (p - start == (gssize)len || !g_ascii_isalnum(p[-len-1]));
+}
+
+// The definition of a view has its tables, views and functions qualified as
+// `db`.`name`, the database is the one of the dump, so it is translated to
+// the one being restored. A bare `name` is only taken after FROM or JOIN,
+// as otherwise it is a column or an alias.
+static void add_view_dependencies(struct dag_node *node){
+  GString *data=read_file_content(node->rj->filename);
+  const gchar *p=data->str, *start=NULL;
+  gchar *first=NULL, *second=NULL, *key=NULL, *real_database=NULL;
+  struct dag_node *parent=NULL;
+  while ((p=strchr(p,'`')) != NULL){
+    start=p;
+    if ((first=read_identifier(&p)) == NULL)
+      break;
+    if (start > data->str && start[-1] == '.'){
+      // A column of a qualified name already looked up
+      g_free(first);
+      continue;
+    }
+    if (p[0] == '.' && p[1] == '`'){
+      p++;
+      if ((second=read_identifier(&p)) == NULL){
+        g_free(first);
+        break;
+      }
+      real_database=db_hash_lookup(first);
+      key=g_strdup_printf("%s.%s", real_database != NULL ? real_database : first, second);
+      g_free(second);
+    }else if (follows_keyword(data->str, start, "FROM") || follows_keyword(data->str, start, "JOIN"))
+      key=g_strdup_printf("%s.%s", node->use_database, first);
+    g_free(first);
+    if (key == NULL)
+      continue;
+    parent=g_hash_table_lookup(view_nodes, key);
+    if (parent == NULL)
+      parent=g_hash_table_lookup(function_nodes, key);
+    if (parent != NULL)
+      add_dependency(parent, node);
+    g_free(key);
+    key=NULL;
+  }
+  g_string_free(data, TRUE);
+}
+
+struct tarjan_state {
+  GHashTable *index;
+  GHashTable *lowlink;
+  GHashTable *component;
+  GList *stack;
+  guint next_index;
+  guint next_component;
+};
+
+static guint tarjan_get(GHashTable *h, struct dag_node *node){
+  return GPOINTER_TO_UINT(g_hash_table_lookup(h, node));
+}
+
+// Index and lowlink are stored plus one, so 0 means not visited
+static void tarjan_visit(struct tarjan_state *ts, struct dag_node *node){
+  GList *c=NULL;
+  struct dag_node *child=NULL, *member=NULL;
+  ts->next_index++;
+  g_hash_table_insert(ts->index, node, GUINT_TO_POINTER(ts->next_index));
+  g_hash_table_insert(ts->lowlink, node, GUINT_TO_POINTER(ts->next_index));
+  ts->stack=g_list_prepend(ts->stack, node);
+  for (c=node->children; c != NULL; c=c->next){
+    child=c->data;
+    if (tarjan_get(ts->index, child) == 0){
+      tarjan_visit(ts, child);
+      if (tarjan_get(ts->lowlink, child) < tarjan_get(ts->lowlink, node))
+        g_hash_table_insert(ts->lowlink, node, GUINT_TO_POINTER(tarjan_get(ts->lowlink, child)));
+    }else if (tarjan_get(ts->component, child) == 0 && tarjan_get(ts->index, child) < tarjan_get(ts->lowlink, node))
+      g_hash_table_insert(ts->lowlink, node, GUINT_TO_POINTER(tarjan_get(ts->index, child)));
+  }
+  if (tarjan_get(ts->lowlink, node) == tarjan_get(ts->index, node)){
+    ts->next_component++;
+    do {
+      member=ts->stack->data;
+      ts->stack=g_list_delete_link(ts->stack, ts->stack);
+      g_hash_table_insert(ts->component, member, GUINT_TO_POINTER(ts->next_component));
+    } while (member != node);
+  }
+}
+
+// The edges between views of the same strongly connected component are
+// removed, as they would never be ready otherwise. The rest of the edges
+// are kept, so the views that depend on a cycle still wait for it.
+static void break_cycles(){
+  struct tarjan_state ts;
+  GList *l=NULL, *c=NULL, *next=NULL;
+  struct dag_node *node=NULL, *child=NULL;
+  gboolean in_cycle;
+  ts.index=g_hash_table_new(g_direct_hash, g_direct_equal);
+  ts.lowlink=g_hash_table_new(g_direct_hash, g_direct_equal);
+  ts.component=g_hash_table_new(g_direct_hash, g_direct_equal);
+  ts.stack=NULL;
+  ts.next_index=0;
+  ts.next_component=0;
+  for (l=post_nodes; l != NULL; l=l->next)
+    if (tarjan_get(ts.index, l->data) == 0)
+      tarjan_visit(&ts, l->data);
+  for (l=post_nodes; l != NULL; l=l->next){
+    node=l->data;
+    in_cycle=FALSE;
+    for (c=node->children; c != NULL; c=next){
+      next=c->next;
+      child=c->data;
+      if (tarjan_get(ts.component, child) == tarjan_get(ts.component, node)){
+        node->children=g_list_delete_link(node->children, c);
+        child->pending--;
+        in_cycle=TRUE;
+      }
+    }
+    if (in_cycle)
+      g_warning("Circular dependency found restoring %s, the views of the cycle will not wait for each other", node->rj->filename);
+  }
+  g_hash_table_destroy(ts.index);
+  g_hash_table_destroy(ts.lowlink);
+  g_hash_table_destroy(ts.component);
+}
+
+// It must be called once all the post objects have been added and before
+// the threads get to run_post_objects
+void prepare_post_objects(){
+  GList *l=NULL;
+  struct dag_node *node=NULL;
+  g_mutex_lock(post_mutex);
+  for (l=routine_nodes; l != NULL; l=l->next)
+    add_function_names(l->data);
+  for (l=post_nodes; l != NULL; l=l->next){
+    node=l->data;
+    if (g_strcmp0(node->rj->data.srj->object,"view") == 0)
+      add_view_dependencies(node);
+  }
+  break_cycles();
+  for (l=post_nodes; l != NULL; l=l->next){
+    node=l->data;
+    post_pending++;
+    if (node->pending == 0)
+      g_async_queue_push(post_ready, node);
+  }
+  g_mutex_unlock(post_mutex);
+}
+
+static void post_node_done(struct dag_node *node){
+  GList *c=NULL;
+  struct dag_node *child=NULL;
+  for (c=node->children; c != NULL; c=c->next){
+    child=c->data;
+    if (child->pending > 0){
+      child->pending--;
+      if (child->pending == 0)
+        g_async_queue_push(post_ready, child);
+    }
+  }
+  node->finished=TRUE;
+  post_pending--;
+  g_cond_broadcast(post_cond);
+}
+
+void run_post_objects(struct thread_data *td){
+  struct dag_node *node=NULL;
+  g_mutex_lock(post_mutex);
+  while (post_pending > 0){
+    node=g_async_queue_try_pop(post_ready);
+    if (node == NULL){
+      g_cond_wait(post_cond, post_mutex);
+      continue;
+    }
+    g_mutex_unlock(post_mutex);
+    execute_use_if_needs_to(td, node->use_database, "Restoring post tasks");
+    process_restore_job(td, node->rj);
+    g_mutex_lock(post_mutex);
+    post_node_done(node);
+  }
+  g_mutex_unlock(post_mutex);
+}
@@ -0,0 +1,27 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_myloader_post_h
+#define _src_myloader_post_h
+#include "myloader.h"
+#include "myloader_restore_job.h"
+
+void initialize_post_objects();
+void add_post_object(struct restore_job *rj, const gchar *table);
+void prepare_post_objects();
+void run_post_objects(struct thread_data *td);
+#endif
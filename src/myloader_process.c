@@ -33,6 +33,12 @@
 #include "myloader_jobs_manager.h"
 #include "myloader_control_job.h"
 #include "myloader_restore_job.h"
+#include "myloader_manifest.h"
+#include "myloader_scheduler.h"
+#include "myloader_constraints.h"
+#include "myloader_post.h"
+#include "myloader_journal.h"
+#include "myloader_transcode.h"
 
 extern gchar *compress_extension;
 extern gchar *db;
@@ -47,9 +53,14 @@ extern gboolean append_if_not_exist;
 
 struct configuration *conf;
 GMutex *table_hash_mutex=NULL;
+// Schema nodes that the CREATE TABLE nodes depend on. They are only used by
+// the thread that processes the schema files.
+GHashTable *database_nodes=NULL;
+GList *tablespace_nodes=NULL;
 void initialize_process(struct configuration *c){
   conf=c;
   table_hash_mutex=g_mutex_new();
+  database_nodes=g_hash_table_new(g_str_hash, g_str_equal);
 }
 
 struct db_table* append_new_db_table(char * filename, gchar * database, gchar *table, guint64 number_rows, GHashTable *table_hash, GString *alter_table_statement){
@@ -77,16 +88,25 @@ struct db_table* append_new_db_table(char * filename, gchar * database, gchar *t
       dbt->table=table;
       dbt->real_table=dbt->table;
       dbt->rows=number_rows;
+      dbt->bytes=0;
       dbt->restore_job_list = NULL;
       dbt->queue=g_async_queue_new();
       dbt->current_threads=0;
       dbt->max_threads=max_threads_per_table;
+      dbt->queued_jobs=0;
+      dbt->queued_bytes=0;
+      dbt->restored_bytes=0;
+      dbt->loaded_rows=0;
+      dbt->heap_index=-1;
+      dbt->data_finished=FALSE;
       dbt->mutex=g_mutex_new();
       dbt->indexes=alter_table_statement;
       dbt->start_time=NULL;
       dbt->start_index_time=NULL;
       dbt->finish_time=NULL;
       dbt->schema_created=FALSE;
+      dbt->schema_pending=FALSE;
+      dbt->transcode=FALSE;
       dbt->constraints=NULL;
       dbt->count=0;
       g_hash_table_insert(table_hash, lkey, dbt);
@@ -162,6 +182,7 @@ void load_schema(struct db_table *dbt, gchar *filename){
         if (g_strstr_len(data->str,13,"CREATE TABLE ")){
           gchar** create_table= g_strsplit(data->str, "`", 3);
           dbt->real_table=g_strdup(create_table[1]);
+          dbt->transcode=table_can_be_transcoded(data->str);
           if ( g_str_has_prefix(dbt->table,"mydumper_")){
             g_hash_table_insert(tbl_hash, dbt->table, dbt->real_table);
           }else{
@@ -199,13 +220,9 @@ void load_schema(struct db_table *dbt, gchar *filename){
               }
               g_string_append(create_table_statement,g_strjoinv("\n)",g_strsplit(new_create_table_statement->str,",\n)",-1)));
               dbt->indexes=alter_table_statement;
-              if (stream){
-                struct restore_job *rj = new_schema_restore_job(filename,JOB_RESTORE_STRING, dbt, dbt->real_database,dbt->indexes,"indexes");
-                g_async_queue_push(conf->post_table_queue, new_job(JOB_RESTORE,rj,dbt->real_database));
-              }
               if (flag & INCLUDE_CONSTRAINT){
                 struct restore_job *rj = new_schema_restore_job(strdup(filename),JOB_RESTORE_STRING,dbt, dbt->real_database, alter_table_constraint_statement, "constraint");
-                g_async_queue_push(conf->post_table_queue, new_job(JOB_RESTORE,rj,dbt->real_database));
+                add_constraint_job(rj);
                 dbt->constraints=alter_table_constraint_statement;
               }else{
                  g_string_free(alter_table_constraint_statement,TRUE);
@@ -226,7 +243,12 @@ void load_schema(struct db_table *dbt, gchar *filename){
   }
   
   struct restore_job * rj = new_schema_restore_job(filename,JOB_RESTORE_SCHEMA_STRING, dbt, dbt->real_database, create_table_statement, "");
-  g_async_queue_push(conf->table_queue, new_job(JOB_RESTORE,rj,dbt->real_database));
+  struct dag_node *node=scheduler_new_node(rj, dbt->real_database, dbt);
+  GList *t;
+  for (t=tablespace_nodes; t != NULL; t=t->next)
+    scheduler_add_dependency(t->data, node);
+  scheduler_add_dependency(g_hash_table_lookup(database_nodes, dbt->real_database), node);
+  scheduler_release_node(node);
   if (!is_compressed) {
     fclose(infile);
   } else {
@@ -331,7 +353,9 @@ gchar * get_database_name_from_content(const gchar *filename){
 
 void process_tablespace_filename(char * filename) {
   struct restore_job *rj = new_schema_restore_job(filename, JOB_RESTORE_SCHEMA_FILENAME, NULL, NULL, NULL, "tablespace");
-  g_async_queue_push(conf->database_queue, new_job(JOB_RESTORE,rj,NULL));
+  struct dag_node *node=scheduler_new_node(rj, NULL, NULL);
+  tablespace_nodes=g_list_prepend(tablespace_nodes, node);
+  scheduler_release_node(node);
 }
 
 
@@ -355,7 +379,9 @@ void process_database_filename(char * filename, const char *object) {
 
   if (!db){
     struct restore_job *rj = new_schema_restore_job(filename, JOB_RESTORE_SCHEMA_FILENAME, NULL, db_vname, NULL, object);
-    g_async_queue_push(conf->database_queue, new_job(JOB_RESTORE,rj,NULL));
+    struct dag_node *node=scheduler_new_node(rj, NULL, NULL);
+    g_hash_table_insert(database_nodes, db_vname, node);
+    scheduler_release_node(node);
   }
 }
 
@@ -384,7 +410,12 @@ gboolean process_table_filename(char * filename){
 
 gboolean process_metadata_filename(char * filename){
   gchar *db_name, *table_name;
-  get_database_table_name_from_filename(filename,"-metadata",&db_name,&table_name);
+  struct manifest_entry *e=get_manifest_entry(filename);
+  if (e != NULL){
+    db_name=g_strdup(e->database);
+    table_name=g_strdup(e->table);
+  }else
+    get_database_table_name_from_filename(filename,"-metadata",&db_name,&table_name);
   if (db_name == NULL || table_name == NULL){
       g_critical("It was not possible to process file: %s (1)",filename);
       exit(EXIT_FAILURE);
@@ -394,6 +425,10 @@ gboolean process_metadata_filename(char * filename){
     g_warning("It was not possible to process file: %s (2) because real_db_name isn't found. We might renqueue it, take into account that restores without schema-create files are not supported",filename);
     return FALSE;
   }
+  if (e != NULL){
+    append_new_db_table(NULL, db_name, table_name, e->rows, conf->table_hash, NULL);
+    return TRUE;
+  }
   void *infile;
   gboolean is_compressed = FALSE;
   gchar *path = g_build_filename(directory, filename, NULL);
@@ -434,7 +469,7 @@ void process_schema_filename(gchar *filename, const char * object) {
       return;
     }
     struct restore_job *rj = new_schema_restore_job(filename, JOB_RESTORE_SCHEMA_FILENAME, NULL, real_db_name, NULL, object);
-    g_async_queue_push(conf->post_queue, new_job(JOB_RESTORE,rj,real_db_name));
+    add_post_object(rj, table_name);
 }
 
 gboolean process_data_filename(char * filename){
@@ -442,7 +477,14 @@ gboolean process_data_filename(char * filename){
   // TODO: check if it is a data file
   // TODO: we need to count sections of the data file to determine if it is ok.
   guint part=0,sub_part=0;
-  get_database_table_part_name_from_filename(filename,&db_name,&table_name,&part,&sub_part);
+  struct manifest_entry *e=get_manifest_entry(filename);
+  if (e != NULL){
+    db_name=g_strdup(e->database);
+    table_name=g_strdup(e->table);
+    part=e->part;
+    sub_part=e->sub_part;
+  }else
+    get_database_table_part_name_from_filename(filename,&db_name,&table_name,&part,&sub_part);
   if (db_name == NULL || table_name == NULL){
     g_critical("It was not possible to process file: %s (3)",filename);
     exit(EXIT_FAILURE);
@@ -456,13 +498,31 @@ gboolean process_data_filename(char * filename){
     g_warning("Skiping table: `%s`.`%s`",real_db_name, table_name);
     return TRUE;
   }
+  if (journal_is_done(filename)){
+    g_message("Skipping %s as it was already restored", filename);
+    return TRUE;
+  }
   struct db_table *dbt=append_new_db_table(filename, db_name, table_name,0,conf->table_hash,NULL);
   struct restore_job *rj = new_data_restore_job( g_strdup(filename), JOB_RESTORE_FILENAME, dbt, part, sub_part);
+  if (e != NULL)
+    rj->data.drj->bytes=e->bytes;
+  else{
+    GStatBuf st;
+    gchar *path=g_build_filename(directory,filename,NULL);
+    if (g_stat(path,&st) == 0)
+      rj->data.drj->bytes=st.st_size;
+    g_free(path);
+  }
   g_mutex_lock(dbt->mutex);
   dbt->count++; 
+  dbt->bytes+=rj->data.drj->bytes;
 //  dbt->restore_job_list=g_list_insert_sorted(dbt->restore_job_list,rj,&compare_filename_part);
-  dbt->restore_job_list=g_list_append(dbt->restore_job_list,rj);
+  if (!stream)
+    dbt->restore_job_list=g_list_append(dbt->restore_job_list,rj);
   g_mutex_unlock(dbt->mutex);
+  // In stream mode the order of the files is not known, jobs are scheduled as they arrive
+  if (stream)
+    scheduler_add_job(rj);
   return TRUE;
 }
 
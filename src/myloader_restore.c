@@ -29,11 +29,24 @@
 #include "myloader.h"
 #include "myloader_jobs_manager.h"
 #include "myloader_common.h"
+#include "myloader_journal.h"
+#include "myloader_restore_job.h"
+#include "myloader_async.h"
+#include "myloader_transcode.h"
+#include "myloader_metrics.h"
+#include "myloader_restore.h"
+#include "stages.h"
+#include "trace.h"
+#include "query_profile.h"
 extern guint errors;
+extern gboolean shutdown_triggered;
+extern GAsyncQueue *file_list_to_do;
 extern guint commit_count;
 extern gchar *directory;
 extern gchar *compress_extension;
 extern guint rows;
+extern guint target_commit_latency;
+extern guint64 target_transaction_size;
 
 gboolean skip_definer = FALSE;
 
@@ -46,26 +59,96 @@ void load_restore_entries(GOptionGroup *main_group){
   g_option_group_add_entries(main_group, restore_entries);
 }
 
+// The statements per transaction of the thread are reduced to keep the
+// transactions under target_transaction_size, then they grow by 25% while
+// the COMMIT takes less than 80% of target_commit_latency, and they shrink
+// in proportion when it takes more than 120%
+static void adjust_commit_size(struct thread_data *td, guint statements, gdouble latency){
+  guint size=td->commit_size;
+  gdouble ms=latency*1000;
+  if (target_transaction_size > 0 && td->transaction_bytes > target_transaction_size){
+    size=statements*target_transaction_size/td->transaction_bytes;
+  }else if (target_commit_latency > 0){
+    if (ms > target_commit_latency*1.2)
+      size=statements*target_commit_latency/ms;
+    else if (ms < target_commit_latency*0.8 && statements >= td->commit_size){
+      size=statements+statements/4+1;
+      if (target_transaction_size > 0 && td->transaction_bytes/statements*size > target_transaction_size)
+        size=statements*target_transaction_size/td->transaction_bytes;
+    }
+  }
+  if (size < 1)
+    size=1;
+  if (size != td->commit_size){
+    g_message("Thread %d changed queries per transaction from %u to %u, last COMMIT of %u queries and %" G_GUINT64_FORMAT " bytes took %.1f ms",
+              td->thread_id, td->commit_size, size, statements, td->transaction_bytes, ms);
+    td->commit_size=size;
+  }
+}
+
 int restore_data_in_gstring_by_statement(struct thread_data *td, GString *data, gboolean is_schema, guint *query_counter)
 {
-  if (mysql_real_query(td->thrconn, data->str, data->len)) {
+  // On resume, the statements committed by the previous run are skipped
+  if (!is_schema && td->statements_to_skip > 0){
+    td->statements_to_skip--;
+    td->statements++;
+    g_string_set_size(data, 0);
+    return 0;
+  }
+  if (td->async_file != NULL){
+    wait_if_paused(td);
+    trace_bytes(data->len);
+    async_submit(td, data);
+    td->statements++;
+    g_string_set_size(data, 0);
+    return 0;
+  }
+  my_ulonglong affected_rows;
+  guint64 stage_start=stage_clock();
+  int q=is_schema ? -1 : restore_insert_as_load_data(td, data);
+  if (q < 0)
+    q=profiled_real_query(td->thrconn, data->str, data->len);
+  stage_end(LOAD_STAGE_QUERY, stage_start);
+  if (q) {
     if (is_schema)
       g_critical("Error restoring: %s %s", data->str, mysql_error(td->thrconn));
     errors++;
     return 1;
   }
   *query_counter=*query_counter+1;
+  td->statements++;
+  td->transaction_bytes+=data->len;
+  trace_bytes(data->len);
+  affected_rows=mysql_affected_rows(td->thrconn);
+  metrics_statement(td->current_dbt, data->len, affected_rows == (my_ulonglong)~0 ? 0 : affected_rows);
   if (is_schema==FALSE) {
 	if (commit_count > 1) {
-if (*query_counter == commit_count) {
+if (*query_counter >= td->commit_size || (target_transaction_size > 0 && td->transaction_bytes >= target_transaction_size)) {
+    guint statements=*query_counter;
+    GTimer *timer=g_timer_new();
     *query_counter= 0;
-    if (mysql_query(td->thrconn, "COMMIT")) {
+    stage_start=stage_clock();
+    if (profiled_query(td->thrconn, "COMMIT")) {
+      g_timer_destroy(timer);
       errors++;
       return 2;
     }
-    mysql_query(td->thrconn, "START TRANSACTION");
+    stage_end(LOAD_STAGE_COMMIT, stage_start);
+    metrics_commit(g_timer_elapsed(timer, NULL));
+    if (target_commit_latency > 0 || target_transaction_size > 0)
+      adjust_commit_size(td, statements, g_timer_elapsed(timer, NULL));
+    g_timer_destroy(timer);
+    td->transaction_bytes=0;
+    journal_commit(td);
+    // Between transactions, so a paused thread does not hold row locks
+    wait_if_paused(td);
+    profiled_query(td->thrconn, "START TRANSACTION");
   }
-}}
+}else{
+    journal_commit(td);
+    wait_if_paused(td);
+}
+}
   g_string_set_size(data, 0);
   return 0;
 }
@@ -101,7 +184,9 @@ int split_and_restore_data_in_gstring_by_statement(struct thread_data *td,
   next_line=g_strstr_len(current_line, -1, "\n");
   GString * new_insert=g_string_sized_new(strlen(insert_statement_prefix));
   guint current_rows=0;
+  guint64 stage_start;
   do {
+    stage_start=stage_clock();
     current_rows=0;
     g_string_set_size(new_insert, 0);
     new_insert=g_string_append(new_insert,insert_statement_prefix);
@@ -114,6 +199,7 @@ int split_and_restore_data_in_gstring_by_statement(struct thread_data *td,
       next_line=g_strstr_len(current_line, -1, "\n");
       current_offset_line++;
     } while (current_rows < rows && next_line != NULL);
+    stage_end(LOAD_STAGE_PARSE, stage_start);
     if (new_insert->len > insert_statement_prefix_len)
       tr=restore_data_in_gstring_by_statement(td, new_insert, is_schema, query_counter);
     else
@@ -157,12 +243,29 @@ int restore_data_from_file(struct thread_data *td, char *database, char *table,
     errors++;
     return 1;
   }
-  if (!is_schema && (commit_count > 1) )
-    mysql_query(td->thrconn, "START TRANSACTION");
+  if (!is_schema){
+    td->current_filename=filename;
+    td->statements=0;
+    td->statements_to_skip=journal_committed_statements(filename);
+    if (td->statements_to_skip > 0)
+      g_message("Thread %d skipping the %" G_GUINT64_FORMAT " statements already committed from %s", td->thread_id, td->statements_to_skip, filename);
+  }
+  if (!is_schema && is_async_enabled())
+    td->async_file=async_file_new(filename, td->statements_to_skip);
+  else if (!is_schema && (commit_count > 1) ){
+    profiled_query(td->thrconn, "START TRANSACTION");
+    td->transaction_bytes=0;
+  }
   guint tr=0;
+  gboolean interrupted=FALSE;
+  guint64 read_calls=0, stage_start;
   while (eof == FALSE) {
+    // read_data returns one line, so only one of every STAGE_SAMPLE is timed
+    stage_start=stage_sample(&read_calls);
     if (read_data(infile, is_compressed, data, &eof, &line)) {
+      stage_end_sampled(LOAD_STAGE_READ, stage_start);
       if (g_strrstr(&data->str[data->len >= 5 ? data->len - 5 : 0], ";\n")) {
+        metrics_read(data->len, is_compressed);
         if ( skip_definer && g_str_has_prefix(data->str,"CREATE")){
           remove_definer(data);
         }
@@ -177,18 +280,56 @@ int restore_data_from_file(struct thread_data *td, char *database, char *table,
         }
         g_string_set_size(data, 0);
         preline=line+1;
+        // Stop at a commit boundary, the rest of the file is restored on resume
+        if (!is_schema && shutdown_triggered && (commit_count <= 1 || query_counter == 0)){
+          interrupted=TRUE;
+          break;
+        }
       }
     } else {
       g_critical("error reading file %s (%d)", filename, errno);
       errors++;
+      td->statements_to_skip=0;
+      if (td->async_file != NULL){
+        async_file_wait(td->async_file);
+        td->async_file=NULL;
+      }
+      td->current_filename=NULL;
       return r;
     }
   }
-  if (!is_schema && (commit_count > 1) && mysql_query(td->thrconn, "COMMIT")) {
+  if (td->async_file != NULL){
+    r+=async_file_wait(td->async_file);
+    td->async_file=NULL;
+  }
+  // The journal counted more statements than the file has, which happens
+  // when the file is split in a different way than in the previous run
+  if (!is_schema && !interrupted && td->statements_to_skip > 0){
+    g_critical("File %s has %" G_GUINT64_FORMAT " statements less than the ones committed according to the restore journal, it was not restored completely",
+               filename, td->statements_to_skip);
+    errors++;
+    r++;
+  }
+  td->statements_to_skip=0;
+  GTimer *timer=g_timer_new();
+  stage_start=stage_clock();
+  if (!is_schema && !is_async_enabled() && (commit_count > 1) && profiled_query(td->thrconn, "COMMIT")) {
     g_critical("Error committing data for %s.%s from file %s: %s",
                database, table, filename, mysql_error(td->thrconn));
     errors++;
+  }else if (!is_schema){
+    if (interrupted){
+      g_message("Thread %d stopped %s after %" G_GUINT64_FORMAT " statements", td->thread_id, filename, td->statements);
+      g_async_queue_push(file_list_to_do, g_strdup(filename));
+    }else if (r == 0)
+      journal_file_done(filename);
+    if (!is_async_enabled() && commit_count > 1){
+      stage_end(LOAD_STAGE_COMMIT, stage_start);
+      metrics_commit(g_timer_elapsed(timer, NULL));
+    }
   }
+  g_timer_destroy(timer);
+  td->current_filename=NULL;
   g_string_free(data, TRUE);
   if (!is_compressed) {
     fclose(infile);
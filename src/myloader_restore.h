@@ -14,6 +14,8 @@
 
         Authors:    David Ducos, Percona (david dot ducos at percona dot com)
 */
+enum load_stage { LOAD_STAGE_READ, LOAD_STAGE_PARSE, LOAD_STAGE_QUERY, LOAD_STAGE_COMMIT };
+
 void load_restore_entries(GOptionGroup *main_group);
 int restore_data_from_file(struct thread_data *td, char *database, char *table,
                   const char *filename, gboolean is_schema);
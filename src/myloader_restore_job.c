@@ -25,11 +25,14 @@
 #include <glib-unix.h>
 
 #include "myloader_common.h"
+#include "myloader_journal.h"
+#include "myloader_monitor.h"
+#include "trace.h"
+#include "query_profile.h"
 
 extern gboolean serial_tbl_creation;
 extern gboolean overwrite_tables;
 extern gchar *db;
-extern gboolean stream;
 extern guint num_threads;
 
 gboolean shutdown_triggered=FALSE;
@@ -67,6 +70,7 @@ struct data_restore_job * new_data_restore_job_internal( guint index, guint part
   drj->index    = index;
   drj->part     = part;
   drj->sub_part = sub_part;
+  drj->bytes    = 0;
   return drj;
 }
 
@@ -120,21 +124,21 @@ int overwrite_table(MYSQL *conn,gchar * database, gchar * table){
               database, table);
     query = g_strdup_printf("DROP TABLE IF EXISTS `%s`.`%s`",
                             database, table);
-    mysql_query(conn, query);
+    profiled_query(conn, query);
     g_free(query);
     query = g_strdup_printf("DROP VIEW IF EXISTS `%s`.`%s`", database,
                             table);
-    mysql_query(conn, query);
+    profiled_query(conn, query);
   } else if (purge_mode == TRUNCATE) {
     g_message("Truncating table `%s`.`%s`", database, table);
     query= g_strdup_printf("TRUNCATE TABLE `%s`.`%s`", database, table);
-    truncate_or_delete_failed= mysql_query(conn, query);
+    truncate_or_delete_failed= profiled_query(conn, query);
     if (truncate_or_delete_failed)
       g_warning("Truncate failed, we are going to try to create table or view");
   } else if (purge_mode == DELETE) {
     g_message("Deleting content of table `%s`.`%s`", database, table);
     query= g_strdup_printf("DELETE FROM `%s`.`%s`", database, table);
-    truncate_or_delete_failed= mysql_query(conn, query);
+    truncate_or_delete_failed= profiled_query(conn, query);
     if (truncate_or_delete_failed)
       g_warning("Delete failed, we are going to try to create table or view");
   }
@@ -142,7 +146,10 @@ int overwrite_table(MYSQL *conn,gchar * database, gchar * table){
   return truncate_or_delete_failed;
 }
 
-void process_restore_job(struct thread_data *td, struct restore_job *rj){
+// The thread blocks while the mutex it pops is locked, which is how Ctrl+c
+// pauses the threads, and while the throttle needs it paused
+void wait_if_paused(struct thread_data *td){
+  throttle_wait();
   if (td->conf->pause_resume != NULL){
     GMutex *resume_mutex = (GMutex *)g_async_queue_try_pop(td->conf->pause_resume);
     if (resume_mutex != NULL){
@@ -151,6 +158,12 @@ void process_restore_job(struct thread_data *td, struct restore_job *rj){
       resume_mutex=NULL;
     }
   }
+}
+
+static const gchar *restore_job_type_names[]={"JOB_RESTORE_SCHEMA_FILENAME", "JOB_RESTORE_FILENAME", "JOB_RESTORE_SCHEMA_STRING", "JOB_RESTORE_STRING"};
+
+void process_restore_job(struct thread_data *td, struct restore_job *rj){
+  wait_if_paused(td);
   if (shutdown_triggered){
 //    g_message("file enqueued to allow resume: %s", rj->filename);
     g_async_queue_push(file_list_to_do,rj->filename);
@@ -158,14 +171,30 @@ void process_restore_job(struct thread_data *td, struct restore_job *rj){
   }
   struct db_table *dbt=rj->dbt;
   guint query_counter=0;
+  gchar *journal_key=NULL;
+  guint64 trace_start=trace_clock();
   switch (rj->type) {
     case JOB_RESTORE_STRING:
-      g_message("Thread %d restoring %s `%s`.`%s` from %s", td->thread_id, rj->data.srj->object,
-                dbt->real_database, dbt->real_table, rj->filename);
-      restore_data_in_gstring(td, rj->data.srj->statement, FALSE, &query_counter);
+      journal_key=g_strdup_printf("%s:%s", rj->filename, rj->data.srj->object);
+      if (journal_is_done(journal_key)){
+        g_message("Thread %d skipping %s `%s`.`%s` from %s as it was already restored", td->thread_id, rj->data.srj->object,
+                  dbt->real_database, dbt->real_table, rj->filename);
+      }else{
+        g_message("Thread %d restoring %s `%s`.`%s` from %s", td->thread_id, rj->data.srj->object,
+                  dbt->real_database, dbt->real_table, rj->filename);
+        if (restore_data_in_gstring(td, rj->data.srj->statement, FALSE, &query_counter) == 0)
+          journal_file_done(journal_key);
+      }
+      g_free(journal_key);
       free_schema_restore_job(rj->data.srj);
       break;
     case JOB_RESTORE_SCHEMA_STRING:
+      if (journal_is_done(rj->filename)){
+        g_message("Thread %d skipping table `%s`.`%s` from %s as it was already restored", td->thread_id,
+                  dbt->real_database, dbt->real_table, rj->filename);
+        free_schema_restore_job(rj->data.srj);
+        break;
+      }
       if (serial_tbl_creation) g_mutex_lock(single_threaded_create_table);
       g_message("Thread %d restoring table `%s`.`%s` from %s", td->thread_id,
                 dbt->real_database, dbt->real_table, rj->filename);
@@ -178,9 +207,9 @@ void process_restore_job(struct thread_data *td, struct restore_job *rj){
         g_message("Creating table `%s`.`%s` from content in %s", dbt->real_database, dbt->real_table, rj->filename);
         if (restore_data_in_gstring(td, rj->data.srj->statement, FALSE, &query_counter)){
           g_critical("Thread %d issue restoring %s: %s",td->thread_id,rj->filename, mysql_error(td->thrconn));
-        }
+        }else
+          journal_file_done(rj->filename);
       }
-      dbt->schema_created=TRUE;
       if (serial_tbl_creation) g_mutex_unlock(single_threaded_create_table);
       free_schema_restore_job(rj->data.srj);
       break;
@@ -190,35 +219,30 @@ void process_restore_job(struct thread_data *td, struct restore_job *rj){
       g_message("Thread %d restoring `%s`.`%s` part %d of %d from %s. Progress %llu of %llu.", td->thread_id,
                 dbt->real_database, dbt->real_table, rj->data.drj->index, dbt->count, rj->filename, progress,total_data_sql_files);
       g_mutex_unlock(progress_mutex);
-      if (stream && !dbt->schema_created){
-        // In a stream scenario we might need to wait until table is created to start executing inserts.
-        int i=0;
-        while (!dbt->schema_created && i<10000){
-          usleep(1000);
-          i++;
-          if (i % 1000 == 0)
-            g_message("Waiting table to be created %s", rj->filename);
-        }
-        if (!dbt->schema_created){
-          g_critical("Table has not been created in more than 10 seconds");
-          exit(EXIT_FAILURE);
-        }
-      }
+      td->current_dbt=dbt;
       if (restore_data_from_file(td, dbt->real_database, dbt->real_table, rj->filename, FALSE) > 0){
         g_critical("Thread %d issue restoring %s: %s",td->thread_id,rj->filename, mysql_error(td->thrconn));
       }
+      td->current_dbt=NULL;
       g_free(rj->data.drj);
       break;
     case JOB_RESTORE_SCHEMA_FILENAME:
-      g_message("Thread %d restoring %s on `%s` from %s", td->thread_id, rj->data.srj->object,
-                rj->data.srj->database, rj->filename);
-      restore_data_from_file(td, rj->data.srj->database, NULL, rj->filename, TRUE );
+      if (journal_is_done(rj->filename)){
+        g_message("Thread %d skipping %s on `%s` from %s as it was already restored", td->thread_id, rj->data.srj->object,
+                  rj->data.srj->database, rj->filename);
+      }else{
+        g_message("Thread %d restoring %s on `%s` from %s", td->thread_id, rj->data.srj->object,
+                  rj->data.srj->database, rj->filename);
+        if (restore_data_from_file(td, rj->data.srj->database, NULL, rj->filename, TRUE ) == 0)
+          journal_file_done(rj->filename);
+      }
       free_schema_restore_job(rj->data.srj);
       break;
     default:
       g_critical("Something very bad happened!");
       exit(EXIT_FAILURE);
     }
+  trace_span(td->thread_id, "restore", restore_job_type_names[rj->type], rj->filename, trace_start);
 cleanup:
   if (rj != NULL ) free_restore_job(rj);
 }
@@ -27,6 +27,7 @@ struct data_restore_job{
   guint index;
   guint part;
   guint sub_part;
+  guint64 bytes;
 };
 
 struct schema_restore_job{
@@ -52,6 +53,7 @@ void initialize_restore_job();
 //struct restore_job * new_restore_job( char * filename, /*char * database,*/ struct db_table * dbt, GString * statement, guint part, guint sub_part, enum restore_job_type type, const char *object);
 struct restore_job * new_data_restore_job( char * filename, enum restore_job_type type, struct db_table * dbt, guint part, guint sub_part);
 struct restore_job * new_schema_restore_job( char * filename, enum restore_job_type type, struct db_table * dbt, char * database, GString * statement, const char *object);
+void wait_if_paused(struct thread_data *td);
 void process_restore_job(struct thread_data *td, struct restore_job *rj);
 void restore_job_finish();
 void stop_signal_thread();
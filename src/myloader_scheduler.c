@@ -0,0 +1,445 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <mysql.h>
+#include <glib.h>
+#include <string.h>
+#include "myloader.h"
+#include "myloader_common.h"
+#include "myloader_restore.h"
+#include "myloader_restore_job.h"
+#include "myloader_scheduler.h"
+#include "myloader_journal.h"
+#include "myloader_metrics.h"
+#include "trace.h"
+#include "query_profile.h"
+
+extern gboolean innodb_optimize_keys;
+extern gboolean innodb_optimize_keys_per_table;
+extern gboolean innodb_optimize_keys_all_tables;
+extern guint num_threads;
+extern guint max_threads_for_index_creation;
+
+/*
+  The restore is a dependency graph: database -> table -> data parts ->
+  indexes. Schema objects are dag_nodes that become ready when all their
+  parents finished. The data jobs of a table are kept in its ready queue
+  (dbt->queue) and the table is only schedulable once it has been created.
+  The schedulable tables are kept in a max-heap keyed on the bytes that are
+  still queued, so an idle thread always takes work from the heaviest table
+  that is under its max_threads limit. When the last data job of a table
+  finishes, its indexes are built.
+
+  Index builds have their own limits: at most max_threads_for_index_creation
+  run at the same time, and the sort buffers they need must fit in
+  index_memory_budget. The pending builds are taken largest table first. With
+  AFTER_IMPORT_ALL_TABLES they only start once all the data is loaded.
+
+  scheduler_pending counts the work that has not finished yet: nodes, data
+  jobs and index builds. Once the graph is sealed and it gets to 0, the
+  threads leave run_scheduler.
+*/
+
+GMutex *scheduler_mutex=NULL;
+GCond *scheduler_cond=NULL;
+GPtrArray *scheduler_heap=NULL;
+GAsyncQueue *ready_nodes=NULL;
+GSequence *index_queue=NULL;
+guint scheduler_pending=0;
+guint scheduler_data_jobs=0;
+gboolean scheduler_sealed=FALSE;
+guint index_running=0;
+guint64 index_memory_running=0;
+guint64 index_memory_budget=0;
+guint64 index_memory_per_index=0;
+
+void initialize_scheduler(){
+  scheduler_mutex=g_mutex_new();
+  scheduler_cond=g_cond_new();
+  scheduler_heap=g_ptr_array_new();
+  ready_nodes=g_async_queue_new();
+  index_queue=g_sequence_new(NULL);
+}
+
+// Each index added by an ALTER TABLE needs a sort buffer and, while merging,
+// a read and a write buffer of innodb_sort_buffer_size. The budget is a
+// quarter of the buffer pool.
+void initialize_index_creation(MYSQL *conn){
+  guint64 buffer_pool_size=128*1024*1024, sort_buffer_size=1024*1024;
+  if (!innodb_optimize_keys)
+    return;
+  if (profiled_query(conn, "SELECT @@innodb_buffer_pool_size, @@innodb_sort_buffer_size")){
+    g_warning("Failed to get innodb_sort_buffer_size, using the defaults: %s", mysql_error(conn));
+  }else{
+    MYSQL_RES *result=profiled_store_result(conn);
+    MYSQL_ROW row=mysql_fetch_row(result);
+    if (row != NULL && row[0] != NULL && row[1] != NULL){
+      buffer_pool_size=g_ascii_strtoull(row[0], NULL, 10);
+      sort_buffer_size=g_ascii_strtoull(row[1], NULL, 10);
+    }
+    mysql_free_result(result);
+  }
+  index_memory_per_index=3*sort_buffer_size;
+  index_memory_budget=buffer_pool_size/4;
+  if (max_threads_for_index_creation == 0){
+    max_threads_for_index_creation=index_memory_budget/index_memory_per_index;
+    if (max_threads_for_index_creation > num_threads)
+      max_threads_for_index_creation=num_threads;
+    if (max_threads_for_index_creation == 0)
+      max_threads_for_index_creation=1;
+  }
+  g_message("Up to %u index builds will run at the same time, using up to %" G_GUINT64_FORMAT " MB of sort buffers",
+            max_threads_for_index_creation, index_memory_budget/1024/1024);
+}
+
+static guint64 index_build_memory(struct db_table *dbt){
+  guint64 n=0;
+  const gchar *p=dbt->indexes->str;
+  while ((p=strstr(p,"\n ADD")) != NULL){
+    n++;
+    p++;
+  }
+  return n*index_memory_per_index;
+}
+
+static gint compare_index_build(gconstpointer a, gconstpointer b, gpointer user_data){
+  const struct db_table *x=a, *y=b;
+  (void) user_data;
+  if (x->bytes != y->bytes)
+    return x->bytes > y->bytes ? -1 : 1;
+  if (x->rows != y->rows)
+    return x->rows > y->rows ? -1 : 1;
+  return 0;
+}
+
+static gboolean heap_greater(guint a, guint b){
+  struct db_table *x=g_ptr_array_index(scheduler_heap,a), *y=g_ptr_array_index(scheduler_heap,b);
+  return x->queued_bytes > y->queued_bytes;
+}
+
+static void heap_swap(guint a, guint b){
+  gpointer t=scheduler_heap->pdata[a];
+  scheduler_heap->pdata[a]=scheduler_heap->pdata[b];
+  scheduler_heap->pdata[b]=t;
+  ((struct db_table *)scheduler_heap->pdata[a])->heap_index=a;
+  ((struct db_table *)scheduler_heap->pdata[b])->heap_index=b;
+}
+
+static void heap_up(guint i){
+  while (i > 0 && heap_greater(i,(i-1)/2)){
+    heap_swap(i,(i-1)/2);
+    i=(i-1)/2;
+  }
+}
+
+static void heap_down(guint i){
+  guint largest;
+  for(;;){
+    largest=i;
+    if (2*i+1 < scheduler_heap->len && heap_greater(2*i+1,largest)) largest=2*i+1;
+    if (2*i+2 < scheduler_heap->len && heap_greater(2*i+2,largest)) largest=2*i+2;
+    if (largest == i)
+      break;
+    heap_swap(i,largest);
+    i=largest;
+  }
+}
+
+static void heap_insert(struct db_table *dbt){
+  g_ptr_array_add(scheduler_heap,dbt);
+  dbt->heap_index=scheduler_heap->len-1;
+  heap_up(dbt->heap_index);
+}
+
+static void heap_remove(struct db_table *dbt){
+  guint i=dbt->heap_index, last=scheduler_heap->len-1;
+  if (i != last)
+    heap_swap(i,last);
+  g_ptr_array_remove_index(scheduler_heap,last);
+  dbt->heap_index=-1;
+  if (i < scheduler_heap->len){
+    heap_up(i);
+    heap_down(i);
+  }
+}
+
+static gboolean is_eligible(struct db_table *dbt){
+  return dbt->schema_created && dbt->queued_jobs > 0 && dbt->current_threads < dbt->max_threads;
+}
+
+static void update_table(struct db_table *dbt){
+  if (dbt->heap_index < 0){
+    if (is_eligible(dbt)){
+      heap_insert(dbt);
+      g_cond_signal(scheduler_cond);
+    }
+  }else if (!is_eligible(dbt))
+    heap_remove(dbt);
+}
+
+static void work_done(){
+  scheduler_pending--;
+  if (scheduler_sealed && scheduler_pending == 0)
+    g_cond_broadcast(scheduler_cond);
+}
+
+// Tables without deferred indexes are done as soon as their data is loaded
+static void push_if_finished(struct db_table *dbt){
+  if (scheduler_sealed && dbt->schema_created && !dbt->data_finished && dbt->queued_jobs == 0 && dbt->current_threads == 0){
+    dbt->data_finished=TRUE;
+    if (dbt->start_time==NULL)
+      dbt->start_time=g_date_time_new_now_local();
+    if (dbt->indexes == NULL){
+      dbt->start_index_time=g_date_time_new_now_local();
+      dbt->finish_time=g_date_time_new_now_local();
+      metrics_table_phase(dbt, TABLE_PHASE_DONE);
+      return;
+    }
+    metrics_table_phase(dbt, TABLE_PHASE_INDEXES);
+    scheduler_pending++;
+    g_sequence_insert_sorted(index_queue,dbt,&compare_index_build,NULL);
+    g_cond_signal(scheduler_cond);
+  }
+}
+
+static struct db_table *next_index_build(){
+  struct db_table *dbt=NULL;
+  GSequenceIter *first=g_sequence_get_begin_iter(index_queue);
+  if (g_sequence_iter_is_end(first))
+    return NULL;
+  if (innodb_optimize_keys_all_tables && (!scheduler_sealed || scheduler_data_jobs > 0))
+    return NULL;
+  if (index_running >= max_threads_for_index_creation)
+    return NULL;
+  dbt=g_sequence_get(first);
+  // A build that is bigger than the budget runs alone
+  if (index_running > 0 && index_memory_running + index_build_memory(dbt) > index_memory_budget)
+    return NULL;
+  g_sequence_remove(first);
+  index_running++;
+  index_memory_running+=index_build_memory(dbt);
+  return dbt;
+}
+
+static void index_build_done(struct db_table *dbt){
+  index_running--;
+  index_memory_running-=index_build_memory(dbt);
+  g_cond_broadcast(scheduler_cond);
+  work_done();
+}
+
+// The node is created on hold, so the dependencies can be added before it
+// becomes runnable with scheduler_release_node
+struct dag_node *scheduler_new_node(struct restore_job *rj, gchar *use_database, struct db_table *dbt){
+  struct dag_node *node=g_new0(struct dag_node,1);
+  node->rj=rj;
+  node->use_database=use_database;
+  node->dbt=dbt;
+  node->pending=1;
+  g_mutex_lock(scheduler_mutex);
+  scheduler_pending++;
+  if (dbt != NULL)
+    dbt->schema_pending=TRUE;
+  g_mutex_unlock(scheduler_mutex);
+  return node;
+}
+
+void scheduler_add_dependency(struct dag_node *parent, struct dag_node *child){
+  if (parent == NULL)
+    return;
+  g_mutex_lock(scheduler_mutex);
+  if (!parent->finished){
+    child->pending++;
+    parent->children=g_list_prepend(parent->children,child);
+  }
+  g_mutex_unlock(scheduler_mutex);
+}
+
+static void release_node(struct dag_node *node){
+  node->pending--;
+  if (node->pending == 0){
+    g_async_queue_push(ready_nodes,node);
+    g_cond_signal(scheduler_cond);
+  }
+}
+
+void scheduler_release_node(struct dag_node *node){
+  g_mutex_lock(scheduler_mutex);
+  release_node(node);
+  g_mutex_unlock(scheduler_mutex);
+}
+
+static void node_done(struct dag_node *node){
+  GList *l;
+  node->finished=TRUE;
+  for (l=node->children; l != NULL; l=l->next)
+    release_node(l->data);
+  g_list_free(node->children);
+  node->children=NULL;
+  if (node->dbt != NULL){
+    node->dbt->schema_created=TRUE;
+    node->dbt->schema_pending=FALSE;
+    update_table(node->dbt);
+    push_if_finished(node->dbt);
+  }
+  work_done();
+}
+
+void scheduler_add_job(struct restore_job *rj){
+  struct db_table *dbt=rj->dbt;
+  g_mutex_lock(scheduler_mutex);
+  g_async_queue_push(dbt->queue,rj);
+  dbt->queued_jobs++;
+  dbt->queued_bytes+=rj->data.drj->bytes;
+  scheduler_pending++;
+  scheduler_data_jobs++;
+  if (dbt->heap_index >= 0)
+    heap_up(dbt->heap_index);
+  else
+    update_table(dbt);
+  g_mutex_unlock(scheduler_mutex);
+}
+
+// Lowering the limit does not stop the threads that are already loading the
+// table, it only prevents new ones from taking its jobs
+void scheduler_set_max_threads(struct db_table *dbt, guint max_threads){
+  g_mutex_lock(scheduler_mutex);
+  dbt->max_threads=max_threads;
+  update_table(dbt);
+  g_mutex_unlock(scheduler_mutex);
+}
+
+// The fields change under scheduler_mutex while the workers take and finish
+// the jobs of the table, so they are copied together
+void scheduler_get_table_load(struct db_table *dbt, struct table_load *load){
+  g_mutex_lock(scheduler_mutex);
+  load->schema_created=dbt->schema_created;
+  load->data_finished=dbt->data_finished;
+  load->queued_jobs=dbt->queued_jobs;
+  load->current_threads=dbt->current_threads;
+  load->max_threads=dbt->max_threads;
+  g_mutex_unlock(scheduler_mutex);
+}
+
+// No more nodes or data jobs are going to be added. Tables without a
+// schema file are expected to exist already, and a table without queued or
+// running jobs is pushed once to build its indexes.
+void scheduler_seal(GHashTable *table_hash){
+  GHashTableIter iter;
+  gchar *lkey;
+  struct db_table *dbt=NULL;
+  g_mutex_lock(scheduler_mutex);
+  scheduler_sealed=TRUE;
+  g_hash_table_iter_init(&iter,table_hash);
+  while (g_hash_table_iter_next(&iter,(gpointer *) &lkey,(gpointer *) &dbt)){
+    if (!dbt->schema_created && !dbt->schema_pending){
+      dbt->schema_created=TRUE;
+      update_table(dbt);
+    }
+    push_if_finished(dbt);
+  }
+  g_cond_broadcast(scheduler_cond);
+  g_mutex_unlock(scheduler_mutex);
+}
+
+static struct restore_job *next_data_job(){
+  struct db_table *dbt=g_ptr_array_index(scheduler_heap,0);
+  struct restore_job *rj=g_async_queue_try_pop(dbt->queue);
+  dbt->queued_jobs--;
+  dbt->queued_bytes-=rj->data.drj->bytes;
+  dbt->current_threads++;
+  if (dbt->start_time==NULL){
+    dbt->start_time=g_date_time_new_now_local();
+    metrics_table_phase(dbt, TABLE_PHASE_DATA);
+  }
+  if (is_eligible(dbt))
+    heap_down(0);
+  else
+    heap_remove(dbt);
+  return rj;
+}
+
+static void data_job_done(struct db_table *dbt){
+  dbt->current_threads--;
+  scheduler_data_jobs--;
+  update_table(dbt);
+  push_if_finished(dbt);
+  if (scheduler_data_jobs == 0)
+    g_cond_broadcast(scheduler_cond);
+  work_done();
+}
+
+static void build_indexes(struct thread_data *td, struct db_table *dbt){
+  guint query_counter=0;
+  gchar *journal_key=g_strdup_printf("`%s`.`%s`:indexes", dbt->real_database, dbt->real_table);
+  guint64 trace_start=trace_clock();
+  dbt->start_index_time=g_date_time_new_now_local();
+  if (journal_is_done(journal_key)){
+    g_message("Thread %d skipping indexes `%s`.`%s` as they were already restored", td->thread_id,
+        dbt->real_database, dbt->real_table);
+  }else{
+    g_message("Thread %d restoring indexes `%s`.`%s`", td->thread_id,
+        dbt->real_database, dbt->real_table);
+    if (restore_data_in_gstring(td, dbt->indexes, FALSE, &query_counter)){
+      g_critical("Thread %d issue restoring indexes `%s`.`%s`: %s", td->thread_id,
+          dbt->real_database, dbt->real_table, mysql_error(td->thrconn));
+    }else
+      journal_file_done(journal_key);
+  }
+  trace_span(td->thread_id, "restore", "indexes", journal_key, trace_start);
+  g_free(journal_key);
+  dbt->finish_time=g_date_time_new_now_local();
+  metrics_table_phase(dbt, TABLE_PHASE_DONE);
+  g_message("Thread %d restored indexes `%s`.`%s` in %.1f seconds", td->thread_id,
+      dbt->real_database, dbt->real_table,
+      (double)g_date_time_difference(dbt->finish_time,dbt->start_index_time)/G_TIME_SPAN_SECOND);
+}
+
+// Schema nodes go first as they unblock other work, then the index builds
+// and then the data jobs
+void run_scheduler(struct thread_data *td){
+  struct dag_node *node=NULL;
+  struct db_table *dbt=NULL;
+  struct restore_job *rj=NULL;
+  g_mutex_lock(scheduler_mutex);
+  for(;;){
+    if ((node=g_async_queue_try_pop(ready_nodes)) != NULL){
+      g_mutex_unlock(scheduler_mutex);
+      execute_use_if_needs_to(td, node->use_database, "Restoring schema");
+      process_restore_job(td, node->rj);
+      g_mutex_lock(scheduler_mutex);
+      node_done(node);
+    }else if ((dbt=next_index_build()) != NULL){
+      g_mutex_unlock(scheduler_mutex);
+      build_indexes(td, dbt);
+      g_mutex_lock(scheduler_mutex);
+      index_build_done(dbt);
+    }else if (scheduler_heap->len > 0){
+      rj=next_data_job();
+      dbt=rj->dbt;
+      g_mutex_unlock(scheduler_mutex);
+      execute_use_if_needs_to(td, dbt->real_database, "Restoring data");
+      process_restore_job(td, rj);
+      g_mutex_lock(scheduler_mutex);
+      data_job_done(dbt);
+    }else if (scheduler_sealed && scheduler_pending == 0){
+      break;
+    }else
+      g_cond_wait(scheduler_cond,scheduler_mutex);
+  }
+  g_mutex_unlock(scheduler_mutex);
+}
@@ -0,0 +1,50 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_myloader_scheduler_h
+#define _src_myloader_scheduler_h
+#include "myloader.h"
+#include "myloader_restore_job.h"
+
+struct dag_node {
+  struct restore_job *rj;
+  gchar *use_database;
+  struct db_table *dbt;
+  guint pending;
+  GList *children;
+  gboolean finished;
+};
+
+struct table_load {
+  gboolean schema_created;
+  gboolean data_finished;
+  guint queued_jobs;
+  guint current_threads;
+  guint max_threads;
+};
+
+void initialize_scheduler();
+void initialize_index_creation(MYSQL *conn);
+struct dag_node *scheduler_new_node(struct restore_job *rj, gchar *use_database, struct db_table *dbt);
+void scheduler_add_dependency(struct dag_node *parent, struct dag_node *child);
+void scheduler_release_node(struct dag_node *node);
+void scheduler_add_job(struct restore_job *rj);
+void scheduler_set_max_threads(struct db_table *dbt, guint max_threads);
+void scheduler_get_table_load(struct db_table *dbt, struct table_load *load);
+void scheduler_seal(GHashTable *table_hash);
+void run_scheduler(struct thread_data *td);
+#endif
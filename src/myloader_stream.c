@@ -32,6 +32,8 @@
 #include "myloader_stream.h"
 #include "myloader_restore_job.h"
 #include "myloader_control_job.h"
+#include "myloader_scheduler.h"
+#include "myloader_post.h"
 
 extern gchar *compress_extension;
 extern gchar *db;
@@ -40,8 +42,6 @@ extern gchar *source_db;
 extern gboolean no_data;
 extern gboolean skip_triggers;
 extern gboolean skip_post;
-extern guint num_threads;
-extern GAsyncQueue *stream_queue;
 extern int (*m_close)(void *file);
 extern int (*m_write)(FILE * file, const char * buff, int len);
 extern guint total_data_sql_files;
@@ -58,7 +58,6 @@ void *intermidiate_thread();
 
 void initialize_stream (struct configuration *c){
   stream_conf = c;
-  stream_queue = g_async_queue_new();
   intermidiate_queue = g_async_queue_new();
   table_list_mutex = g_mutex_new();
   stream_intermidiate_thread = g_thread_create((GThreadFunc)intermidiate_thread, NULL, TRUE, NULL);
@@ -110,6 +109,8 @@ enum file_type process_filename(char *filename){
         break;
       case METADATA_GLOBAL:
         break;
+      case MANIFEST:
+        break;
       case METADATA_TABLE:
         stream_conf->metadata_list=g_list_insert(stream_conf->metadata_list,filename,-1);
         if (!process_metadata_filename(filename))
@@ -166,106 +167,10 @@ void process_stream_filename(gchar * filename){
     g_async_queue_push(intermidiate_queue, filename);
     return;
   }
-  if (current_ft != SCHEMA_VIEW &&
-      current_ft != SCHEMA_TRIGGER &&
-      current_ft != SCHEMA_POST &&
-      current_ft != CHECKSUM &&
-      current_ft != METADATA_TABLE )
-    g_async_queue_push(stream_queue, GINT_TO_POINTER(current_ft));
-}
-
-struct control_job * give_any_data_job(){
-  g_mutex_lock(table_list_mutex);
-  GList * iter=stream_conf->table_list;
-  GList * next = NULL;
-  struct control_job *job = NULL;
-
-  while (iter != NULL){
-    struct db_table * dbt = iter->data;
-    g_mutex_lock(dbt->mutex);
-    if (g_list_length(dbt->restore_job_list) > 0){
-      job = dbt->restore_job_list->data;
-      next = dbt->restore_job_list->next;
-      g_list_free_1(dbt->restore_job_list);
-      dbt->restore_job_list = next;
-      g_mutex_unlock(dbt->mutex);
-      break;
-    }
-    g_mutex_unlock(dbt->mutex);
-    iter=iter->next;
-  }
-  g_mutex_unlock(table_list_mutex);
-
-  return job;
-}
-
-struct restore_job * give_me_next_data_job(){
-  g_mutex_lock(table_list_mutex);
-  GList * iter=stream_conf->table_list;
-  GList * next = NULL;
-  struct restore_job *job = NULL;
-//  g_message("Elemetns in table_list: %d",g_list_length(stream_conf->table_list));
-  while (iter != NULL){
-    struct db_table * dbt = iter->data;
-//    g_message("DB: %s Table: %s len: %d", dbt->real_database,dbt->real_table,g_list_length(dbt->restore_job_list));
-    if (dbt->current_threads < dbt->max_threads){
-      // I could do some job in here, do we have some for me?
-      g_mutex_lock(dbt->mutex);
-      if (g_list_length(dbt->restore_job_list) > 0){
-        job = dbt->restore_job_list->data;
-        next = dbt->restore_job_list->next;
-        g_list_free_1(dbt->restore_job_list);
-        dbt->restore_job_list = next;
-        g_mutex_unlock(dbt->mutex);
-        break;
-      }
-      g_mutex_unlock(dbt->mutex);
-    }
-    iter=iter->next;
-  }
-  g_mutex_unlock(table_list_mutex);
-  return job;
 }
 
 void *process_stream_queue(struct thread_data * td) {
-  struct control_job *job = NULL;
-  gboolean cont=TRUE;
-  enum file_type ft=0;
-//  enum file_type ft;
-  while (cont){
-    ft=(enum file_type)GPOINTER_TO_INT(g_async_queue_pop(stream_queue));
-    job=g_async_queue_try_pop(stream_conf->database_queue);
-    if (job != NULL){
-      g_debug("Restoring database");
-      cont=process_job(td, job);
-      continue;
-    }
-    job=g_async_queue_try_pop(stream_conf->table_queue);
-    if (job != NULL){
-      execute_use_if_needs_to(td, job->use_database, "Restoring table structure");
-      cont=process_job(td, job);
-      continue;
-    }
-    struct restore_job *rj = give_me_next_data_job();
-    if (rj != NULL){
-      job=new_job(JOB_RESTORE,rj,rj->dbt->database);
-      execute_use_if_needs_to(td, job->use_database, "Restoring tables (1)");
-      cont=process_job(td, job);
-      continue;
-    }
-    job=give_any_data_job();
-    if (job != NULL){
-      execute_use_if_needs_to(td, job->use_database, "Restoring tables (2)");
-      cont=process_job(td, job);
-      continue;
-    }else{
-      if (ft==SHUTDOWN)
-        cont=FALSE;
-      else
-        g_async_queue_push(stream_queue,GINT_TO_POINTER(ft));
-    }
-    
-  }
+  run_scheduler(td);
   g_message("Shutting down stream thread %d", td->thread_id);
   return NULL;
 }
@@ -386,13 +291,8 @@ read_more:    buffer_len=read_stream_line(&(buffer[diff]),&eof,file,STREAM_BUFFE
   gchar *e=g_strdup("END");
   g_async_queue_push(intermidiate_queue, e);
   g_thread_join(stream_intermidiate_thread);
-  guint n=0;
-  for (n = 0; n < num_threads ; n++) {
-//    g_async_queue_push(stream_conf->data_queue, new_job(JOB_SHUTDOWN,NULL,NULL));
-    g_async_queue_push(stream_conf->post_table_queue, new_job(JOB_SHUTDOWN,NULL,NULL));
-    g_async_queue_push(stream_conf->post_queue, new_job(JOB_SHUTDOWN,NULL,NULL));
-    g_async_queue_push(stream_queue, GINT_TO_POINTER(SHUTDOWN));
-  }
+  prepare_post_objects();
+  scheduler_seal(stream_conf->table_hash);
   return NULL;
 }
 
@@ -0,0 +1,290 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <mysql.h>
+#include <glib.h>
+#include <string.h>
+#include "myloader.h"
+#include "myloader_transcode.h"
+#include "query_profile.h"
+
+extern gboolean inserts_as_load_data;
+extern gchar *set_names_str;
+extern guint errors;
+
+/*
+  With --inserts-as-load-data, the INSERT statements of the data files are
+  sent as a LOAD DATA LOCAL INFILE whose content is produced in memory by a
+  local infile handler. The values are written by mydumper as NULL, numbers
+  or strings escaped by mysql_real_escape_string. The escape sequences of
+  mysql_real_escape_string (\0 \n \r \Z \\ \' \") mean the same in a LOAD
+  DATA with ESCAPED BY '\\', so the content of a string is copied as it is,
+  and only the tabs, which are not escaped by it, become \t. Any statement
+  that does not follow that format, like the ones with CONVERT() of the JSON
+  columns, is executed as an INSERT.
+
+  It is not used with the character sets that have multi-byte characters
+  with a 0x5C trail byte, as LOAD DATA would take it as an escape, nor on
+  tables with BIT columns, as their values would be loaded as text.
+*/
+
+#define ER_NOT_ALLOWED_COMMAND 1148
+#define CR_LOAD_DATA_LOCAL_INFILE_REJECTED 2068
+#define ER_CLIENT_LOCAL_FILES_DISABLED 3948
+
+struct transcoded_insert {
+  GString *tsv;
+  gsize offset;
+};
+
+static gchar *load_data_charset=NULL;
+// Set when LOAD DATA can not be used, the restore threads read it
+static gint transcode_disabled=0;
+
+static const gchar *unsafe_charsets[]={"big5", "cp932", "gb18030", "gbk", "sjis", NULL};
+
+// The character set of the LOAD DATA is the one of SET NAMES, which is
+// the one that mysql_real_escape_string used to write the statement
+void initialize_transcode(){
+  const gchar *p=NULL;
+  gsize len=0;
+  if (!inserts_as_load_data)
+    return;
+  p=strstr(set_names_str, "SET NAMES ");
+  if (p != NULL){
+    p+=10;
+    while (p[len] != '\0' && p[len] != ' ' && p[len] != '*')
+      len++;
+  }
+  load_data_charset=len > 0 ? g_strndup(p, len) : g_strdup("binary");
+  for (len=0; unsafe_charsets[len] != NULL; len++)
+    if (g_ascii_strcasecmp(load_data_charset, unsafe_charsets[len]) == 0){
+      g_warning("--inserts-as-load-data is disabled, the character set %s can not be loaded exactly by LOAD DATA", load_data_charset);
+      g_atomic_int_set(&transcode_disabled, 1);
+      return;
+    }
+}
+
+// BIT values are written as binary strings, which LOAD DATA converts as text
+gboolean table_can_be_transcoded(const gchar *create_table){
+  return g_strstr_len(create_table, -1, "` bit(") == NULL;
+}
+
+static const gchar *skip_spaces(const gchar *p, const gchar *end){
+  while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+    p++;
+  return p;
+}
+
+// Returns the end of a `quoted` identifier, or NULL
+static const gchar *skip_identifier(const gchar *p, const gchar *end){
+  if (p >= end || *p != '`')
+    return NULL;
+  for (p++; p < end; p++)
+    if (*p == '`'){
+      if (p + 1 < end && p[1] == '`')
+        p++;
+      else
+        return p + 1;
+    }
+  return NULL;
+}
+
+static const gchar *transcode_string(const gchar *p, const gchar *end, GString *tsv){
+  gchar quote=*p;
+  for (p++; p < end; p++){
+    if (*p == '\\'){
+      if (p + 1 >= end)
+        return NULL;
+      g_string_append_len(tsv, p, 2);
+      p++;
+    }else if (*p == quote){
+      if (p + 1 < end && p[1] == quote){
+        g_string_append_c(tsv, quote);
+        p++;
+      }else
+        return p + 1;
+    }else if (*p == '\t')
+      g_string_append(tsv, "\\t");
+    else
+      g_string_append_c(tsv, *p);
+  }
+  return NULL;
+}
+
+static const gchar *transcode_number(const gchar *p, const gchar *end, GString *tsv){
+  const gchar *start=p;
+  while (p < end && (g_ascii_isdigit(*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+    p++;
+  if (p == start)
+    return NULL;
+  g_string_append_len(tsv, start, p - start);
+  return p;
+}
+
+// Fills the LOAD DATA statement and its content, it returns FALSE when the
+// statement is not an INSERT as mydumper writes them
+static gboolean transcode_insert(GString *data, GString *load_data, GString *tsv, const gchar **modifier_out){
+  const gchar *p=data->str, *end=data->str + data->len, *table=NULL, *columns=NULL;
+  const gchar *modifier="";
+  if (g_str_has_prefix(p, "INSERT INTO ")){
+    p+=12;
+  }else if (g_str_has_prefix(p, "INSERT IGNORE INTO ")){
+    modifier="IGNORE ";
+    p+=19;
+  }else if (g_str_has_prefix(p, "REPLACE INTO ")){
+    modifier="REPLACE ";
+    p+=13;
+  }else
+    return FALSE;
+  *modifier_out=modifier;
+  table=p;
+  if ((p=skip_identifier(p, end)) == NULL)
+    return FALSE;
+  g_string_printf(load_data, "LOAD DATA LOCAL INFILE 'myloader-transcoded' %sINTO TABLE %.*s CHARACTER SET %s",
+                  modifier, (int)(p - table), table, load_data_charset);
+  p=skip_spaces(p, end);
+  if (p < end && *p == '('){
+    columns=p;
+    for (p++; p < end && *p != ')';){
+      if ((p=skip_identifier(skip_spaces(p, end), end)) == NULL)
+        return FALSE;
+      p=skip_spaces(p, end);
+      if (p < end && *p == ',')
+        p++;
+    }
+    if (p >= end)
+      return FALSE;
+    p++;
+  }
+  g_string_append(load_data, " FIELDS TERMINATED BY '\\t' ESCAPED BY '\\\\' LINES TERMINATED BY '\\n'");
+  if (columns != NULL)
+    g_string_append_printf(load_data, " %.*s", (int)(p - columns), columns);
+  p=skip_spaces(p, end);
+  if (!g_str_has_prefix(p, "VALUES"))
+    return FALSE;
+  p+=6;
+  for (;;){
+    p=skip_spaces(p, end);
+    if (p >= end || *p != '(')
+      return FALSE;
+    for (p++;;){
+      p=skip_spaces(p, end);
+      if (p >= end)
+        return FALSE;
+      if (*p == '"' || *p == '\'')
+        p=transcode_string(p, end, tsv);
+      else if (end - p >= 4 && strncmp(p, "NULL", 4) == 0){
+        g_string_append(tsv, "\\N");
+        p+=4;
+      }else
+        p=transcode_number(p, end, tsv);
+      if (p == NULL)
+        return FALSE;
+      p=skip_spaces(p, end);
+      if (p >= end)
+        return FALSE;
+      if (*p == ','){
+        g_string_append_c(tsv, '\t');
+        p++;
+      }else if (*p == ')'){
+        g_string_append_c(tsv, '\n');
+        p++;
+        break;
+      }else
+        return FALSE;
+    }
+    p=skip_spaces(p, end);
+    if (p < end && *p == ',')
+      p++;
+    else if (p < end && *p == ';')
+      return skip_spaces(p + 1, end) == end;
+    else
+      return FALSE;
+  }
+}
+
+static int transcode_infile_init(void **ptr, const char *filename, void *userdata){
+  struct transcoded_insert *ti=userdata;
+  (void)filename;
+  ti->offset=0;
+  *ptr=ti;
+  return 0;
+}
+
+static int transcode_infile_read(void *ptr, char *buf, unsigned int buf_len){
+  struct transcoded_insert *ti=ptr;
+  gsize len=MIN(buf_len, ti->tsv->len - ti->offset);
+  memcpy(buf, ti->tsv->str + ti->offset, len);
+  ti->offset+=len;
+  return len;
+}
+
+static void transcode_infile_end(void *ptr){
+  (void)ptr;
+}
+
+static int transcode_infile_error(void *ptr, char *error_msg, unsigned int error_msg_len){
+  (void)ptr;
+  g_strlcpy(error_msg, "Transcoded INSERT could not be read", error_msg_len);
+  return 0;
+}
+
+// Returns -1 when the statement has to be executed as it is, otherwise the
+// result of mysql_real_query
+int restore_insert_as_load_data(struct thread_data *td, GString *data){
+  struct transcoded_insert ti;
+  GString *load_data=NULL;
+  const gchar *modifier="";
+  int r=-1;
+  guint warnings;
+  if (!inserts_as_load_data || g_atomic_int_get(&transcode_disabled) || td->current_dbt == NULL || !td->current_dbt->transcode)
+    return -1;
+  load_data=g_string_sized_new(256);
+  ti.tsv=g_string_sized_new(data->len);
+  ti.offset=0;
+  if (transcode_insert(data, load_data, ti.tsv, &modifier)){
+    mysql_set_local_infile_handler(td->thrconn, transcode_infile_init, transcode_infile_read,
+                                   transcode_infile_end, transcode_infile_error, &ti);
+    r=profiled_real_query(td->thrconn, load_data->str, load_data->len);
+    mysql_set_local_infile_default(td->thrconn);
+    if (r != 0){
+      switch (mysql_errno(td->thrconn)){
+        case ER_NOT_ALLOWED_COMMAND:
+        case CR_LOAD_DATA_LOCAL_INFILE_REJECTED:
+        case ER_CLIENT_LOCAL_FILES_DISABLED:
+          if (g_atomic_int_compare_and_exchange(&transcode_disabled, 0, 1))
+            g_warning("LOAD DATA LOCAL INFILE is not allowed, INSERT statements will be executed as they are: %s", mysql_error(td->thrconn));
+          r=-1;
+          break;
+      }
+    }else if ((warnings=mysql_warning_count(td->thrconn)) > 0){
+      // LOCAL turns into warnings the errors that would have failed the
+      // INSERT, the rows are already loaded so they can only be reported
+      if (*modifier == '\0'){
+        g_critical("Thread %d: LOAD DATA of an INSERT of %s got %u warnings, rows could have been skipped or changed", td->thread_id,
+                   td->current_filename != NULL ? td->current_filename : "a file", warnings);
+        errors++;
+      }else
+        g_warning("Thread %d: LOAD DATA of an INSERT of %s got %u warnings", td->thread_id,
+                  td->current_filename != NULL ? td->current_filename : "a file", warnings);
+    }
+  }
+  g_string_free(ti.tsv, TRUE);
+  g_string_free(load_data, TRUE);
+  return r;
+}
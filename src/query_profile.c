@@ -0,0 +1,255 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <glib.h>
+#include <string.h>
+#include "query_profile.h"
+#include "stages.h"
+
+/*
+  The statements are grouped by fingerprint: the literals and the quoted
+  identifiers become ?, the spaces are collapsed and only the first
+  PROFILE_FINGERPRINT_LENGTH characters are kept, so a SHOW CREATE TABLE or
+  the INSERTs of every table end up in the same entry. The latency goes to
+  a histogram of powers of 2 microseconds. The rows and bytes of a result
+  are added to the last statement of the thread when it is stored, the
+  results read with mysql_use_result are not counted. Each thread counts in
+  its own table, so the statements do not wait on each other, and the
+  tables are merged when the profile is printed, once the threads are done.
+*/
+
+#define PROFILE_FINGERPRINT_LENGTH 120
+#define PROFILE_SCAN_LENGTH 4096
+#define PROFILE_BUCKETS 32
+
+struct query_profile {
+  gchar *fingerprint;
+  guint64 count;
+  guint64 errors;
+  guint64 total_us;
+  guint64 max_us;
+  guint64 rows;
+  guint64 bytes;
+  guint64 buckets[PROFILE_BUCKETS];
+};
+
+struct thread_profile {
+  GHashTable *profiles;
+  struct query_profile *last;
+};
+
+static guint profile_top=0;
+static GMutex *profile_mutex=NULL;
+static GPtrArray *thread_profiles=NULL;
+static GPrivate *thread_profile=NULL;
+
+void initialize_query_profile(guint top){
+  if (top == 0)
+    return;
+  profile_top=top;
+  profile_mutex=g_mutex_new();
+  thread_profiles=g_ptr_array_new();
+  thread_profile=g_private_new(NULL);
+}
+
+static struct thread_profile *get_thread_profile(){
+  struct thread_profile *tp=g_private_get(thread_profile);
+  if (tp == NULL){
+    tp=g_new0(struct thread_profile, 1);
+    tp->profiles=g_hash_table_new(g_str_hash, g_str_equal);
+    g_private_set(thread_profile, tp);
+    g_mutex_lock(profile_mutex);
+    g_ptr_array_add(thread_profiles, tp);
+    g_mutex_unlock(profile_mutex);
+  }
+  return tp;
+}
+
+static gchar *fingerprint(const char *query, unsigned long length){
+  GString *fp=g_string_sized_new(PROFILE_FINGERPRINT_LENGTH + 8);
+  const char *p=query, *end=query + MIN(length, PROFILE_SCAN_LENGTH);
+  gchar quote;
+  while (p < end && fp->len < PROFILE_FINGERPRINT_LENGTH){
+    if (*p == '\'' || *p == '"' || *p == '`'){
+      quote=*p;
+      for (p++; p < end; p++){
+        if (*p == '\\' && quote != '`')
+          p++;
+        else if (*p == quote)
+          break;
+      }
+      g_string_append(fp, quote == '`' ? "`?`" : "?");
+      p++;
+    }else if (g_ascii_isdigit(*p) && (fp->len == 0 || !g_ascii_isalnum(fp->str[fp->len - 1]))){
+      while (p < end && (g_ascii_isalnum(*p) || *p == '.'))
+        p++;
+      g_string_append_c(fp, '?');
+    }else if (g_ascii_isspace(*p)){
+      while (p < end && g_ascii_isspace(*p))
+        p++;
+      if (fp->len > 0)
+        g_string_append_c(fp, ' ');
+    }else{
+      g_string_append_c(fp, *p);
+      p++;
+    }
+  }
+  if (p < query + length)
+    g_string_append(fp, "...");
+  return g_string_free(fp, FALSE);
+}
+
+static struct query_profile *lookup_profile(GHashTable *profiles, gchar *fp){
+  struct query_profile *qp=g_hash_table_lookup(profiles, fp);
+  if (qp == NULL){
+    qp=g_new0(struct query_profile, 1);
+    qp->fingerprint=fp;
+    g_hash_table_insert(profiles, fp, qp);
+  }else
+    g_free(fp);
+  return qp;
+}
+
+static void add_profile(const char *query, unsigned long length, guint64 us, int r){
+  struct thread_profile *tp=get_thread_profile();
+  struct query_profile *qp=NULL;
+  guint b=0;
+  while (b < PROFILE_BUCKETS - 1 && ((guint64)1 << b) < us)
+    b++;
+  qp=lookup_profile(tp->profiles, fingerprint(query, length));
+  qp->count++;
+  if (r != 0)
+    qp->errors++;
+  qp->total_us+=us;
+  qp->max_us=MAX(qp->max_us, us);
+  qp->buckets[b]++;
+  tp->last=qp;
+}
+
+int profiled_real_query(MYSQL *conn, const char *query, unsigned long length){
+  guint64 start;
+  int r;
+  if (thread_profiles == NULL)
+    return mysql_real_query(conn, query, length);
+  start=stage_clock();
+  r=mysql_real_query(conn, query, length);
+  add_profile(query, length, (stage_clock() - start) / 1000, r);
+  return r;
+}
+
+int profiled_query(MYSQL *conn, const char *query){
+  if (thread_profiles == NULL)
+    return mysql_query(conn, query);
+  return profiled_real_query(conn, query, strlen(query));
+}
+
+MYSQL_RES *profiled_store_result(MYSQL *conn){
+  struct thread_profile *tp=NULL;
+  struct query_profile *qp=NULL;
+  MYSQL_RES *result=mysql_store_result(conn);
+  MYSQL_ROW row;
+  unsigned long *lengths=NULL;
+  guint64 bytes=0;
+  guint i, num_fields;
+  if (thread_profiles == NULL || result == NULL || (tp=g_private_get(thread_profile)) == NULL || (qp=tp->last) == NULL)
+    return result;
+  num_fields=mysql_num_fields(result);
+  while ((row=mysql_fetch_row(result)) != NULL){
+    lengths=mysql_fetch_lengths(result);
+    for (i=0; i < num_fields; i++)
+      bytes+=lengths[i];
+  }
+  mysql_data_seek(result, 0);
+  qp->rows+=mysql_num_rows(result);
+  qp->bytes+=bytes;
+  return result;
+}
+
+static gint compare_by_total(gconstpointer a, gconstpointer b){
+  const struct query_profile *qa=*(struct query_profile **)a, *qb=*(struct query_profile **)b;
+  return qa->total_us < qb->total_us ? 1 : qa->total_us > qb->total_us ? -1 : 0;
+}
+
+// Upper bound, in milliseconds, of the bucket of the percentile
+static gdouble percentile(struct query_profile *qp, gdouble p){
+  guint64 seen=0, target=(guint64)(qp->count * p + 0.5);
+  guint b;
+  for (b=0; b < PROFILE_BUCKETS; b++){
+    seen+=qp->buckets[b];
+    if (seen >= target && seen > 0)
+      return MIN((gdouble)((guint64)1 << b), (gdouble)qp->max_us) / 1000;
+  }
+  return (gdouble)qp->max_us / 1000;
+}
+
+static void merge_profile(struct query_profile *into, struct query_profile *qp){
+  guint b;
+  into->count+=qp->count;
+  into->errors+=qp->errors;
+  into->total_us+=qp->total_us;
+  into->max_us=MAX(into->max_us, qp->max_us);
+  into->rows+=qp->rows;
+  into->bytes+=qp->bytes;
+  for (b=0; b < PROFILE_BUCKETS; b++)
+    into->buckets[b]+=qp->buckets[b];
+}
+
+void print_query_profile(){
+  GHashTable *profiles=NULL;
+  GPtrArray *sorted=NULL;
+  GHashTableIter iter;
+  struct thread_profile *tp=NULL;
+  struct query_profile *qp=NULL;
+  guint64 total_us=0, count=0;
+  guint i;
+  if (thread_profiles == NULL)
+    return;
+  profiles=g_hash_table_new(g_str_hash, g_str_equal);
+  g_mutex_lock(profile_mutex);
+  for (i=0; i < thread_profiles->len; i++){
+    tp=g_ptr_array_index(thread_profiles, i);
+    g_hash_table_iter_init(&iter, tp->profiles);
+    while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &qp))
+      merge_profile(lookup_profile(profiles, g_strdup(qp->fingerprint)), qp);
+  }
+  sorted=g_ptr_array_sized_new(g_hash_table_size(profiles));
+  g_hash_table_iter_init(&iter, profiles);
+  while (g_hash_table_iter_next(&iter, NULL, (gpointer *) &qp)){
+    g_ptr_array_add(sorted, qp);
+    total_us+=qp->total_us;
+    count+=qp->count;
+  }
+  g_ptr_array_sort(sorted, compare_by_total);
+  g_message("Query profile: %" G_GUINT64_FORMAT " statements in %u fingerprints took %.3f seconds, top %u:",
+            count, sorted->len, (gdouble)total_us / G_USEC_PER_SEC, MIN(profile_top, sorted->len));
+  g_message("Total s\t| %%\t| Count\t| Errors\t| Avg ms\t| p50 ms\t| p99 ms\t| Max ms\t| Rows\t| Bytes\t| Statement");
+  for (i=0; i < MIN(profile_top, sorted->len); i++){
+    qp=g_ptr_array_index(sorted, i);
+    g_message("%.3f\t| %.1f\t| %" G_GUINT64_FORMAT "\t| %" G_GUINT64_FORMAT "\t| %.2f\t| %.2f\t| %.2f\t| %.2f\t| %" G_GUINT64_FORMAT "\t| %" G_GUINT64_FORMAT "\t| %s",
+              (gdouble)qp->total_us / G_USEC_PER_SEC, total_us > 0 ? 100.0 * qp->total_us / total_us : 0,
+              qp->count, qp->errors, (gdouble)qp->total_us / qp->count / 1000,
+              percentile(qp, 0.5), percentile(qp, 0.99), (gdouble)qp->max_us / 1000,
+              qp->rows, qp->bytes, qp->fingerprint);
+  }
+  g_mutex_unlock(profile_mutex);
+  for (i=0; i < sorted->len; i++){
+    qp=g_ptr_array_index(sorted, i);
+    g_free(qp->fingerprint);
+    g_free(qp);
+  }
+  g_ptr_array_free(sorted, TRUE);
+  g_hash_table_destroy(profiles);
+}
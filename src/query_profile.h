@@ -0,0 +1,26 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#ifndef _query_profile_h
+#define _query_profile_h
+#include <mysql.h>
+
+void initialize_query_profile(guint top);
+int profiled_query(MYSQL *conn, const char *query);
+int profiled_real_query(MYSQL *conn, const char *query, unsigned long length);
+MYSQL_RES *profiled_store_result(MYSQL *conn);
+void print_query_profile();
+#endif
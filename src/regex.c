@@ -20,10 +20,12 @@
 #include <pcre.h>
 #include <glib.h>
 #include "regex.h"
+#include "tables_skiplist.h"
 
 const char * filename_regex="^[\\w\\-_ ]+$";
 
 static pcre *re = NULL;
+static pcre_extra *re_extra = NULL;
 static pcre *filename_re = NULL;
 
 char *regex = NULL;
@@ -59,21 +61,37 @@ void init_regex(pcre **r, const char *str){
   }
 }
 
+/* The 'db.table' expression is evaluated once per table, so it is studied,
+ * and JIT compiled when libpcre supports it */
+static void study_regex(pcre *r, pcre_extra **extra){
+  const char *error = NULL;
+  int options = 0;
+#ifdef PCRE_STUDY_JIT_COMPILE
+  options |= PCRE_STUDY_JIT_COMPILE;
+#endif
+  *extra = pcre_study(r, options, &error);
+  if (error)
+    g_warning("Regular expression could not be studied: %s", error);
+}
+
 void initialize_regex(){
-  if (regex)
+  if (regex){
     init_regex(&re,regex);
+    study_regex(re,&re_extra);
+  }
   init_regex(&filename_re,filename_regex);
 }
 
 /* Check database.table string against regular expression */
-gboolean check_regex(pcre *tre, char *database, char *table) {
-  /* This is not going to be used in threads */
+static gboolean check_regex(pcre *tre, pcre_extra *extra, char *database, char *table) {
   int rc;
   int ovector[9] = {0};
+  gchar buffer[DBT_KEY_SIZE];
 
-  char * p = g_strdup_printf("%s.%s", database, table);
-  rc = pcre_exec(tre, NULL, p, strlen(p), 0, 0, ovector, 9);
-  g_free(p);
+  char * p = build_dbt_key(buffer, sizeof(buffer), database, table);
+  rc = pcre_exec(tre, extra, p, strlen(p), 0, 0, ovector, 9);
+  if (p != buffer)
+    g_free(p);
 
   return (rc > 0) ? TRUE : FALSE;
 }
@@ -81,7 +99,7 @@ gboolean check_regex(pcre *tre, char *database, char *table) {
 gboolean eval_regex(char * a,char * b){
 
   if (re){
-    return check_regex(re, a, b);
+    return check_regex(re, re_extra, a, b);
   }
   return TRUE;
 }
@@ -19,6 +19,7 @@
 #include <glib.h>
 #include <string.h>
 #include "server_detect.h"
+#include "query_profile.h"
 
 int detect_server(MYSQL *conn) {
   pcre *re = NULL;
@@ -92,8 +93,8 @@ int secondary=0;
 int revision=0;
 
 void detect_server_version(MYSQL * conn) {
-  mysql_query(conn, "SELECT @@version_comment, @@version");
-  MYSQL_RES *res = mysql_store_result(conn);
+  profiled_query(conn, "SELECT @@version_comment, @@version");
+  MYSQL_RES *res = profiled_store_result(conn);
   MYSQL_ROW ver;
   ver = mysql_fetch_row(res);
   
@@ -0,0 +1,136 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <glib.h>
+#include <time.h>
+#include "metrics.h"
+#include "stages.h"
+
+/*
+  Each thread adds the nanoseconds it spends in each stage to its own slot,
+  with relaxed atomics as the PMM thread reads them. The stages that run per
+  row, or per line, are only timed once every STAGE_SAMPLE calls and that
+  time is counted STAGE_SAMPLE times, so clock_gettime is not called for
+  every row. The stages that run per statement or per file are always
+  timed.
+*/
+
+struct stage_slot {
+  guint thread_id;
+  guint64 ns[STAGES_MAX];
+};
+
+static const gchar **stage_names=NULL;
+static guint stage_count=0;
+static GPrivate *stage_private=NULL;
+static GMutex *stage_mutex=NULL;
+static GPtrArray *stage_slots=NULL;
+
+void initialize_stages(const gchar **names, guint count){
+  stage_names=names;
+  stage_count=MIN(count, STAGES_MAX);
+  stage_private=g_private_new(NULL);
+  stage_mutex=g_mutex_new();
+  stage_slots=g_ptr_array_new();
+}
+
+void stage_register_thread(guint thread_id){
+  struct stage_slot *slot=NULL;
+  if (stage_slots == NULL)
+    return;
+  slot=g_new0(struct stage_slot, 1);
+  slot->thread_id=thread_id;
+  g_mutex_lock(stage_mutex);
+  g_ptr_array_add(stage_slots, slot);
+  g_mutex_unlock(stage_mutex);
+  g_private_set(stage_private, slot);
+}
+
+guint64 stage_clock(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (guint64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Returns the start of the call to time, or 0 when it is not sampled
+guint64 stage_sample(guint64 *calls){
+  return (++(*calls) % STAGE_SAMPLE) == 0 ? stage_clock() : 0;
+}
+
+static void stage_add(guint stage, guint64 ns){
+  struct stage_slot *slot=NULL;
+  if (stage_slots == NULL || stage >= stage_count || (slot=g_private_get(stage_private)) == NULL)
+    return;
+  METRIC_ADD(slot->ns[stage], ns);
+}
+
+void stage_end(guint stage, guint64 start){
+  stage_add(stage, stage_clock() - start);
+}
+
+void stage_end_sampled(guint stage, guint64 start){
+  if (start > 0)
+    stage_add(stage, (stage_clock() - start) * STAGE_SAMPLE);
+}
+
+static void sum_stages(guint64 *total){
+  struct stage_slot *slot=NULL;
+  guint i, s;
+  for (s=0; s < stage_count; s++)
+    total[s]=0;
+  for (i=0; i < stage_slots->len; i++){
+    slot=g_ptr_array_index(stage_slots, i);
+    for (s=0; s < stage_count; s++)
+      total[s]+=METRIC_GET(slot->ns[s]);
+  }
+}
+
+void print_stages(){
+  guint64 total[STAGES_MAX], all=0;
+  GString *line=NULL;
+  guint s;
+  if (stage_slots == NULL)
+    return;
+  g_mutex_lock(stage_mutex);
+  sum_stages(total);
+  g_mutex_unlock(stage_mutex);
+  for (s=0; s < stage_count; s++)
+    all+=total[s];
+  if (all == 0)
+    return;
+  line=g_string_new("Time of the threads by stage:");
+  for (s=0; s < stage_count; s++)
+    g_string_append_printf(line, " %s %.1fs (%.0f%%)", stage_names[s], (gdouble)total[s] / 1000000000, 100.0 * total[s] / all);
+  g_message("%s", line->str);
+  g_string_free(line, TRUE);
+}
+
+void write_stages(GString *content, const gchar *prefix){
+  struct stage_slot *slot=NULL;
+  guint i, s;
+  if (stage_slots == NULL)
+    return;
+  g_mutex_lock(stage_mutex);
+  for (i=0; i < stage_slots->len; i++){
+    slot=g_ptr_array_index(stage_slots, i);
+    for (s=0; s < stage_count; s++){
+      g_string_append_printf(content, "%s_stage_seconds_total{thread=\"%u\",", prefix, slot->thread_id);
+      append_label(content, "stage", stage_names[s]);
+      g_string_append_printf(content, "} %.3f\n", (gdouble)METRIC_GET(slot->ns[s]) / 1000000000);
+    }
+  }
+  g_mutex_unlock(stage_mutex);
+}
@@ -0,0 +1,27 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#define STAGE_SAMPLE 64
+#define STAGES_MAX 8
+
+void initialize_stages(const gchar **names, guint count);
+void stage_register_thread(guint thread_id);
+guint64 stage_clock();
+guint64 stage_sample(guint64 *calls);
+void stage_end(guint stage, guint64 start);
+void stage_end_sampled(guint stage, guint64 start);
+void print_stages();
+void write_stages(GString *content, const gchar *prefix);
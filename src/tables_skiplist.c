@@ -14,22 +14,13 @@
 
 #include <glib.h>
 #include <string.h>
+#include "tables_skiplist.h"
 
-GSequence *tables_skiplist = NULL;
-
-/* Comparison function for skiplist sort and lookup */
-
-int tables_skiplist_cmp(gconstpointer a, gconstpointer b, gpointer user_data) {
-  /* Not using user_data, but needed for function prototype, shutting up
-   * compiler warnings about unused variable */
-  (void)user_data;
-  /* Any sorting function would work, as long as its usage is consistent
-   * between sort and lookup.  strcmp should be one of the fastest. */
-  return strcmp(a, b);
-}
+GHashTable *tables_skiplist = NULL;
 
 /* Read the list of tables to skip from the given filename, and prepares them
- * for future lookups. */
+ * for future lookups. The lines are kept in a hash table, so checking a table
+ * costs the same with a handful of entries than with a million of them. */
 
 void read_tables_skiplist(const gchar *filename, guint *errors) {
 
@@ -38,7 +29,7 @@ void read_tables_skiplist(const gchar *filename, guint *errors) {
   GError *error = NULL;
   /* Create skiplist if it does not exist */
   if (!tables_skiplist) {
-    tables_skiplist = g_sequence_new(NULL);
+    tables_skiplist = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
   };
   tables_skiplist_channel = g_io_channel_new_file(filename, "r", &error);
 
@@ -49,29 +40,36 @@ void read_tables_skiplist(const gchar *filename, guint *errors) {
     return;
   };
 
-  /* Read lines, push them to the list */
+  /* Read lines, push them to the set */
   do {
     g_io_channel_read_line(tables_skiplist_channel, &buf, NULL, NULL, NULL);
     if (buf) {
       g_strchomp(buf);
-      g_sequence_append(tables_skiplist, buf);
+      g_hash_table_replace(tables_skiplist, buf, GINT_TO_POINTER(1));
     };
   } while (buf);
   g_io_channel_shutdown(tables_skiplist_channel, FALSE, NULL);
-  /* Sort the list, so that lookups work */
-  g_sequence_sort(tables_skiplist, tables_skiplist_cmp, NULL);
   g_message("Omit list file contains %d tables to skip\n",
-            g_sequence_get_length(tables_skiplist));
+            g_hash_table_size(tables_skiplist));
   return;
 }
 
+/* Builds the 'database.table' string into buffer when it fits, otherwise it
+ * returns a new string that the caller must free */
+
+gchar *build_dbt_key(gchar *buffer, gsize size, const char *database, const char *table) {
+  if ((gsize)g_snprintf(buffer, size, "%s.%s", database, table) < size)
+    return buffer;
+  return g_strdup_printf("%s.%s", database, table);
+}
+
 /* Check database.table string against skip list; returns TRUE if found */
 
 gboolean check_skiplist(char *database, char *table) {
-  gchar * k=g_strdup_printf("%s.%s", database, table);
-  gboolean b = g_sequence_lookup(tables_skiplist,
-                        k,
-                        tables_skiplist_cmp, NULL) != NULL;
-  g_free(k);
+  gchar buffer[DBT_KEY_SIZE];
+  gchar *k = build_dbt_key(buffer, sizeof(buffer), database, table);
+  gboolean b = g_hash_table_lookup(tables_skiplist, k) != NULL;
+  if (k != buffer)
+    g_free(k);
   return b;
 }
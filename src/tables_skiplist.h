@@ -14,3 +14,5 @@
 
 void read_tables_skiplist(const gchar *filename, guint *errors);
 gboolean check_skiplist(char *database, char *table);
+#define DBT_KEY_SIZE 512
+gchar *build_dbt_key(gchar *buffer, gsize size, const char *database, const char *table);
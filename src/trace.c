@@ -0,0 +1,189 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+/*
+  With --trace-file, every job is written as a complete event ("ph":"X") of
+  the Chrome trace event format, with the thread that executed it and the
+  bytes that it wrote or sent, so the file can be opened in Perfetto or in
+  chrome://tracing. The global phases are async events on the main thread,
+  as they can overlap. The array is closed by finish_trace(), the viewers
+  also load the file of a run that did not finish.
+*/
+
+static FILE *trace_file=NULL;
+static GMutex *trace_mutex=NULL;
+static GTimer *trace_timer=NULL;
+static GPrivate *trace_thread_bytes=NULL;
+static GHashTable *open_phases=NULL;
+static gboolean first_event=TRUE;
+
+static void append_json_string(GString *event, const gchar *str){
+  const gchar *p;
+  g_string_append_c(event, '"');
+  for (p=str; *p != '\0'; p++){
+    if (*p == '"' || *p == '\\')
+      g_string_append_printf(event, "\\%c", *p);
+    else if ((guchar)*p < 0x20)
+      g_string_append_printf(event, "\\u%04x", (guchar)*p);
+    else
+      g_string_append_c(event, *p);
+  }
+  g_string_append_c(event, '"');
+}
+
+static void write_event(GString *event){
+  g_mutex_lock(trace_mutex);
+  if (trace_file != NULL){
+    fprintf(trace_file, "%s%s", first_event ? "\n" : ",\n", event->str);
+    first_event=FALSE;
+  }
+  g_mutex_unlock(trace_mutex);
+}
+
+void initialize_trace(const gchar *filename, const gchar *program){
+  GString *event=NULL;
+  if (filename == NULL)
+    return;
+  trace_file=g_fopen(filename, "w");
+  if (trace_file == NULL){
+    g_critical("Could not open trace file %s", filename);
+    exit(EXIT_FAILURE);
+  }
+  trace_mutex=g_mutex_new();
+  trace_timer=g_timer_new();
+  trace_thread_bytes=g_private_new(g_free);
+  open_phases=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  fprintf(trace_file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  event=g_string_new("{\"ph\":\"M\",\"pid\":1,\"tid\":0,\"name\":\"process_name\",\"args\":{\"name\":");
+  append_json_string(event, program);
+  g_string_append(event, "}}");
+  write_event(event);
+  g_string_free(event, TRUE);
+  trace_thread_name(0, "main");
+}
+
+gboolean is_tracing(){
+  return trace_file != NULL;
+}
+
+// Microseconds since the trace started
+guint64 trace_clock(){
+  return trace_file != NULL ? (guint64)(g_timer_elapsed(trace_timer, NULL) * G_USEC_PER_SEC) : 0;
+}
+
+// The bytes are added to the thread and reported by its next span
+void trace_bytes(gsize bytes){
+  guint64 *thread_bytes=NULL;
+  if (trace_file == NULL)
+    return;
+  thread_bytes=g_private_get(trace_thread_bytes);
+  if (thread_bytes == NULL){
+    thread_bytes=g_new0(guint64, 1);
+    g_private_set(trace_thread_bytes, thread_bytes);
+  }
+  *thread_bytes+=bytes;
+}
+
+void trace_thread_name(guint thread_id, const gchar *name){
+  GString *event=NULL;
+  if (trace_file == NULL)
+    return;
+  event=g_string_new(NULL);
+  g_string_printf(event, "{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":", thread_id);
+  append_json_string(event, name);
+  g_string_append(event, "}}");
+  write_event(event);
+  g_string_free(event, TRUE);
+}
+
+void trace_span(guint thread_id, const gchar *category, const gchar *name, const gchar *object, guint64 start){
+  GString *event=NULL;
+  guint64 *thread_bytes=NULL, bytes=0, end;
+  if (trace_file == NULL)
+    return;
+  end=trace_clock();
+  thread_bytes=g_private_get(trace_thread_bytes);
+  if (thread_bytes != NULL){
+    bytes=*thread_bytes;
+    *thread_bytes=0;
+  }
+  event=g_string_new(NULL);
+  g_string_printf(event, "{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%" G_GUINT64_FORMAT ",\"dur\":%" G_GUINT64_FORMAT ",\"cat\":",
+                  thread_id, start, end - start);
+  append_json_string(event, category);
+  g_string_append(event, ",\"name\":");
+  append_json_string(event, name);
+  g_string_append_printf(event, ",\"args\":{\"bytes\":%" G_GUINT64_FORMAT, bytes);
+  if (object != NULL){
+    g_string_append(event, ",\"object\":");
+    append_json_string(event, object);
+  }
+  g_string_append(event, "}}");
+  write_event(event);
+  g_string_free(event, TRUE);
+}
+
+// A phase that is ended twice, or never begun, is written once
+void trace_phase(const gchar *name, gboolean begin){
+  GString *event=NULL;
+  gboolean is_open;
+  if (trace_file == NULL)
+    return;
+  g_mutex_lock(trace_mutex);
+  is_open=g_hash_table_lookup(open_phases, name) != NULL;
+  if (begin && !is_open)
+    g_hash_table_insert(open_phases, g_strdup(name), GINT_TO_POINTER(1));
+  else if (!begin && is_open)
+    g_hash_table_remove(open_phases, name);
+  g_mutex_unlock(trace_mutex);
+  if (begin == is_open)
+    return;
+  event=g_string_new(NULL);
+  g_string_printf(event, "{\"ph\":\"%s\",\"pid\":1,\"tid\":0,\"ts\":%" G_GUINT64_FORMAT ",\"cat\":\"phase\",\"id\":%u,\"name\":",
+                  begin ? "b" : "e", trace_clock(), g_str_hash(name));
+  append_json_string(event, name);
+  g_string_append(event, "}");
+  write_event(event);
+  g_string_free(event, TRUE);
+}
+
+void finish_trace(){
+  GHashTableIter iter;
+  gchar *name=NULL;
+  GList *names=NULL, *l=NULL;
+  if (trace_file == NULL)
+    return;
+  g_mutex_lock(trace_mutex);
+  g_hash_table_iter_init(&iter, open_phases);
+  while (g_hash_table_iter_next(&iter, (gpointer *) &name, NULL))
+    names=g_list_prepend(names, g_strdup(name));
+  g_mutex_unlock(trace_mutex);
+  for (l=names; l != NULL; l=l->next)
+    trace_phase(l->data, FALSE);
+  g_list_free_full(names, g_free);
+  g_mutex_lock(trace_mutex);
+  fprintf(trace_file, "\n]}\n");
+  fclose(trace_file);
+  trace_file=NULL;
+  g_mutex_unlock(trace_mutex);
+}
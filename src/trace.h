@@ -0,0 +1,24 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+void initialize_trace(const gchar *filename, const gchar *program);
+gboolean is_tracing();
+guint64 trace_clock();
+void trace_bytes(gsize bytes);
+void trace_thread_name(guint thread_id, const gchar *name);
+void trace_span(guint thread_id, const gchar *category, const gchar *name, const gchar *object, guint64 start);
+void trace_phase(const gchar *name, gboolean begin);
+void finish_trace();
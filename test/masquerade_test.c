@@ -0,0 +1,226 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+// The masking functions are static, so the file is compiled here
+#include "../src/mydumper_masquerade.c"
+
+#define TEST_KEY "masquerade-test"
+
+// Runs a masking function as mask_value does, on a buffer with room for
+// MASKING_EXTRA_BYTES more than the value
+static gchar *apply(masking_function f, const gchar *value){
+  gsize length=strlen(value);
+  gchar *out=g_malloc0(length + MASKING_EXTRA_BYTES + 1);
+  length=f(value, length, out);
+  g_assert_cmpuint(length, <, strlen(value) + MASKING_EXTRA_BYTES);
+  out[length]='\0';
+  return out;
+}
+
+static void assert_same_classes(const gchar *value, const gchar *masked){
+  gsize i;
+  g_assert_cmpuint(strlen(masked), ==, strlen(value));
+  for (i=0; value[i] != '\0'; i++){
+    if (g_ascii_isdigit(value[i]))
+      g_assert(g_ascii_isdigit(masked[i]));
+    else if (g_ascii_islower(value[i]))
+      g_assert(g_ascii_islower(masked[i]));
+    else if (g_ascii_isupper(value[i]))
+      g_assert(g_ascii_isupper(masked[i]));
+    else
+      g_assert_cmpint(masked[i], ==, value[i]);
+  }
+}
+
+static void test_number(){
+  const gchar *values[]={"12345", "-42.50", "0", "+7", "0.001", "1000000", "-0.5", NULL};
+  gchar *masked=NULL, *again=NULL;
+  guint i, j;
+  for (i=0; values[i] != NULL; i++){
+    masked=apply(&number_function, values[i]);
+    assert_same_classes(values[i], masked);
+    for (j=0; values[i][j] != '\0'; j++)
+      if ((j == 0 || values[i][j - 1] == '-' || values[i][j - 1] == '+') &&
+          g_ascii_isdigit(values[i][j]) && g_ascii_isdigit(values[i][j + 1]))
+        g_assert_cmpint(masked[j], !=, '0');
+    again=apply(&number_function, values[i]);
+    g_assert_cmpstr(masked, ==, again);
+    g_free(masked);
+    g_free(again);
+  }
+}
+
+static void test_email(){
+  gchar *masked=NULL;
+  masked=apply(&email_function, "john.doe@example.com");
+  assert_same_classes("john.doe@example.com", masked);
+  g_assert(g_str_has_suffix(masked, ".com"));
+  g_assert_cmpstr(masked, !=, "john.doe@example.com");
+  g_free(masked);
+  // Without a top level domain all the letters are masked
+  masked=apply(&email_function, "root@localhost");
+  assert_same_classes("root@localhost", masked);
+  g_assert(!g_str_has_suffix(masked, "localhost"));
+  g_free(masked);
+  masked=apply(&email_function, "not an email");
+  assert_same_classes("not an email", masked);
+  g_free(masked);
+  masked=apply(&email_function, "");
+  g_assert_cmpstr(masked, ==, "");
+  g_free(masked);
+}
+
+static void test_phone(){
+  gchar *masked=NULL;
+  masked=apply(&phone_function, "+34 912-345-678");
+  assert_same_classes("+34 912-345-678", masked);
+  g_assert(g_str_has_prefix(masked, "+34 "));
+  g_free(masked);
+  // Only a code of up to 3 digits followed by a separator is kept
+  masked=apply(&phone_function, "+12345 678");
+  assert_same_classes("+12345 678", masked);
+  g_assert(!g_str_has_prefix(masked, "+12345"));
+  g_free(masked);
+  masked=apply(&phone_function, "+");
+  g_assert_cmpstr(masked, ==, "+");
+  g_free(masked);
+  masked=apply(&phone_function, "(555) 123-4567");
+  assert_same_classes("(555) 123-4567", masked);
+  g_free(masked);
+}
+
+static void assert_date_moved(const gchar *value, const gchar *masked){
+  GDate a, b;
+  guint year, month, day;
+  g_assert(parse_digits(masked, 4, &year) && parse_digits(masked + 5, 2, &month) && parse_digits(masked + 8, 2, &day));
+  g_assert(g_date_valid_dmy(day, month, year));
+  g_assert_cmpuint(year, <=, 9999);
+  g_date_clear(&b, 1);
+  g_date_set_dmy(&b, day, month, year);
+  g_assert(parse_digits(value, 4, &year) && parse_digits(value + 5, 2, &month) && parse_digits(value + 8, 2, &day));
+  g_date_clear(&a, 1);
+  g_date_set_dmy(&a, day, month, year);
+  g_assert_cmpint(ABS(g_date_days_between(&a, &b)), <=, 365);
+}
+
+static void test_date(){
+  const gchar *invalid[]={"0000-00-00", "2021-02-29", "2021-13-01", "2021-01-32", "2021-01", "20210101", "abcd-ef-gh", NULL};
+  gchar *masked=NULL, value[20];
+  guint i;
+  for (i=0; invalid[i] != NULL; i++){
+    masked=apply(&date_function, invalid[i]);
+    g_assert_cmpstr(masked, ==, invalid[i]);
+    g_free(masked);
+  }
+  masked=apply(&date_function, "2020-02-29");
+  g_assert_cmpuint(strlen(masked), ==, 10);
+  assert_date_moved("2020-02-29", masked);
+  g_free(masked);
+  // The time of a datetime is kept
+  masked=apply(&date_function, "2020-06-15 12:34:56");
+  g_assert(g_str_has_suffix(masked, " 12:34:56"));
+  assert_date_moved("2020-06-15", masked);
+  g_free(masked);
+  // The dates that would be moved after 9999 are kept
+  for (i=1; i <= 31; i++){
+    g_snprintf(value, sizeof(value), "9999-12-%02u", i);
+    masked=apply(&date_function, value);
+    if (g_strcmp0(masked, value) != 0)
+      assert_date_moved(value, masked);
+    g_free(masked);
+  }
+}
+
+// The functions that do not keep the length write at most
+// MASKING_EXTRA_BYTES, including the trailing zero of g_snprintf
+static void test_extra_bytes(){
+  const gchar *values[]={"", "a", "a value that is longer than the extra bytes of the masking buffers", NULL};
+  masking_function functions[]={&hash_function, &random_int_function};
+  gchar out[MASKING_EXTRA_BYTES + 8];
+  gsize length, i, j, k;
+  for (i=0; i < G_N_ELEMENTS(functions); i++)
+    for (j=0; values[j] != NULL; j++){
+      memset(out, 0x7f, sizeof(out));
+      length=functions[i](values[j], strlen(values[j]), out);
+      g_assert_cmpuint(length, <, MASKING_EXTRA_BYTES);
+      for (k=0; k < length; k++)
+        g_assert(g_ascii_isxdigit(out[k]));
+      for (k=MASKING_EXTRA_BYTES; k < sizeof(out); k++)
+        g_assert_cmpint(out[k], ==, 0x7f);
+    }
+  length=hash_function("", 0, out);
+  g_assert_cmpuint(length, ==, 16);
+}
+
+static struct masking_pipeline *pipeline(const gchar *functions){
+  gchar *f=g_strdup(functions);
+  struct masking_pipeline *mp=get_masking_pipeline_for(f);
+  g_free(f);
+  return mp;
+}
+
+static void test_pipeline(){
+  struct masking_pipeline *mp=NULL;
+  gchar *masked=NULL;
+  gulong length;
+  g_assert(pipeline("identity") == NULL);
+  g_assert(pipeline("") == NULL);
+  mp=pipeline("trim, lower, email");
+  g_assert(!masking_pipeline_is_numeric(mp));
+  length=strlen("  John@Example.COM ");
+  masked=mask_value(mp, "  John@Example.COM ", &length);
+  g_assert_cmpuint(length, ==, strlen("john@example.com"));
+  assert_same_classes("john@example.com", masked);
+  g_assert(g_str_has_suffix(masked, ".com"));
+  g_free(mp);
+  mp=pipeline("number");
+  g_assert(masking_pipeline_is_numeric(mp));
+  g_free(mp);
+  mp=pipeline("trim,hash");
+  g_assert(!masking_pipeline_is_numeric(mp));
+  g_free(mp);
+}
+
+// The masks only depend on the key and the value
+static void test_key(){
+  gchar *a=NULL, *b=NULL;
+  initialize_masquerade("another key");
+  a=apply(&string_function, "Consistent Value 123");
+  initialize_masquerade(TEST_KEY);
+  b=apply(&string_function, "Consistent Value 123");
+  g_assert_cmpstr(a, !=, b);
+  g_free(a);
+  a=apply(&string_function, "Consistent Value 123");
+  g_assert_cmpstr(a, ==, b);
+  assert_same_classes("Consistent Value 123", a);
+  g_free(a);
+  g_free(b);
+}
+
+int main(int argc, char *argv[]){
+  g_thread_init(NULL);
+  g_test_init(&argc, &argv, NULL);
+  initialize_masquerade(TEST_KEY);
+  g_test_add_func("/masquerade/number", test_number);
+  g_test_add_func("/masquerade/email", test_email);
+  g_test_add_func("/masquerade/phone", test_phone);
+  g_test_add_func("/masquerade/date", test_date);
+  g_test_add_func("/masquerade/extra_bytes", test_extra_bytes);
+  g_test_add_func("/masquerade/pipeline", test_pipeline);
+  g_test_add_func("/masquerade/key", test_key);
+  return g_test_run();
+}
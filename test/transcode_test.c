@@ -0,0 +1,163 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+// The parser is static, so the file is compiled here with the globals of
+// myloader that it uses
+#include "../src/myloader_transcode.c"
+
+gboolean inserts_as_load_data=TRUE;
+gchar *set_names_str=NULL;
+guint errors=0;
+
+// Only the statements that can not be transcoded are tested, they never
+// reach the server
+int profiled_real_query(MYSQL *conn, const char *query, unsigned long length){
+  (void)conn;
+  (void)query;
+  (void)length;
+  g_assert_not_reached();
+  return 1;
+}
+
+#define LOAD_DATA_FORMAT " CHARACTER SET utf8mb4 FIELDS TERMINATED BY '\\t' ESCAPED BY '\\\\' LINES TERMINATED BY '\\n'"
+
+static gboolean transcode(const gchar *insert, GString *load_data, GString *tsv, const gchar **modifier){
+  GString *data=g_string_new(insert);
+  gboolean r;
+  g_string_truncate(load_data, 0);
+  g_string_truncate(tsv, 0);
+  r=transcode_insert(data, load_data, tsv, modifier);
+  g_string_free(data, TRUE);
+  return r;
+}
+
+static void test_values(){
+  GString *load_data=g_string_new(""), *tsv=g_string_new("");
+  const gchar *modifier=NULL;
+  g_assert(transcode("INSERT INTO `t` VALUES (1,'a',NULL,-2.5e3),\n(2,'b',\"q\",+7);\n", load_data, tsv, &modifier));
+  g_assert_cmpstr(modifier, ==, "");
+  g_assert_cmpstr(load_data->str, ==, "LOAD DATA LOCAL INFILE 'myloader-transcoded' INTO TABLE `t`" LOAD_DATA_FORMAT);
+  g_assert_cmpstr(tsv->str, ==, "1\ta\t\\N\t-2.5e3\n2\tb\tq\t+7\n");
+  // The columns are kept, with the identifiers as they are
+  g_assert(transcode("INSERT INTO `we``ird` (`a`, `b``c`) VALUES (1,2);", load_data, tsv, &modifier));
+  g_assert_cmpstr(load_data->str, ==, "LOAD DATA LOCAL INFILE 'myloader-transcoded' INTO TABLE `we``ird`" LOAD_DATA_FORMAT " (`a`, `b``c`)");
+  g_assert_cmpstr(tsv->str, ==, "1\t2\n");
+  g_string_free(load_data, TRUE);
+  g_string_free(tsv, TRUE);
+}
+
+// The escapes of mysql_real_escape_string are copied as they are, a
+// doubled quote is one quote and a tab has to be escaped
+static void test_escapes(){
+  GString *load_data=g_string_new(""), *tsv=g_string_new("");
+  const gchar *modifier=NULL;
+  g_assert(transcode("INSERT INTO `t` VALUES ('a\\'b\\\\c\\nd\\0e\\Z','it''s',\"say \"\"hi\"\"\",'tab\there','NULL','');", load_data, tsv, &modifier));
+  g_assert_cmpstr(tsv->str, ==, "a\\'b\\\\c\\nd\\0e\\Z\tit's\tsay \"hi\"\ttab\\there\tNULL\t\n");
+  g_string_free(load_data, TRUE);
+  g_string_free(tsv, TRUE);
+}
+
+static void test_modifiers(){
+  GString *load_data=g_string_new(""), *tsv=g_string_new("");
+  const gchar *modifier=NULL;
+  g_assert(transcode("INSERT IGNORE INTO `t` VALUES (1);", load_data, tsv, &modifier));
+  g_assert_cmpstr(modifier, ==, "IGNORE ");
+  g_assert_cmpstr(load_data->str, ==, "LOAD DATA LOCAL INFILE 'myloader-transcoded' IGNORE INTO TABLE `t`" LOAD_DATA_FORMAT);
+  g_assert(transcode("REPLACE INTO `t` VALUES (1);", load_data, tsv, &modifier));
+  g_assert_cmpstr(modifier, ==, "REPLACE ");
+  g_assert_cmpstr(load_data->str, ==, "LOAD DATA LOCAL INFILE 'myloader-transcoded' REPLACE INTO TABLE `t`" LOAD_DATA_FORMAT);
+  g_string_free(load_data, TRUE);
+  g_string_free(tsv, TRUE);
+}
+
+// Everything that is not an INSERT as mydumper writes them is executed
+// as it is
+static void test_fallback(){
+  const gchar *inserts[]={
+    "INSERT INTO `t` VALUES (0x1F);",
+    "INSERT INTO `t` VALUES (X'1F');",
+    "INSERT INTO `t` VALUES (_binary 'a');",
+    "INSERT INTO `t` VALUES (CONVERT('a' USING utf8mb4));",
+    "INSERT INTO `t` VALUES ('unterminated);",
+    "INSERT INTO `t` VALUES ('a\\');",
+    "INSERT INTO `t` VALUES (1)",
+    "INSERT INTO `t` VALUES (1); INSERT INTO `t` VALUES (2);",
+    "INSERT INTO `t` VALUES (1,);",
+    "INSERT INTO `t` (`a` VALUES (1);",
+    "INSERT INTO t VALUES (1);",
+    "INSERT INTO `t` SET `a`=1;",
+    "UPDATE `t` SET `a`=1;",
+    "",
+    NULL};
+  GString *load_data=g_string_new(""), *tsv=g_string_new("");
+  const gchar *modifier=NULL;
+  guint i;
+  for (i=0; inserts[i] != NULL; i++)
+    if (transcode(inserts[i], load_data, tsv, &modifier))
+      g_error("%s was transcoded as: %s", inserts[i], tsv->str);
+  g_string_free(load_data, TRUE);
+  g_string_free(tsv, TRUE);
+}
+
+static void test_restore_fallback(){
+  struct thread_data *td=g_new0(struct thread_data, 1);
+  struct db_table *dbt=g_new0(struct db_table, 1);
+  GString *data=g_string_new("INSERT INTO `t` VALUES (0x1F);");
+  td->current_dbt=dbt;
+  dbt->transcode=TRUE;
+  g_assert_cmpint(restore_insert_as_load_data(td, data), ==, -1);
+  g_string_assign(data, "INSERT INTO `t` VALUES (1);");
+  dbt->transcode=FALSE;
+  g_assert_cmpint(restore_insert_as_load_data(td, data), ==, -1);
+  dbt->transcode=TRUE;
+  g_atomic_int_set(&transcode_disabled, 1);
+  g_assert_cmpint(restore_insert_as_load_data(td, data), ==, -1);
+  g_atomic_int_set(&transcode_disabled, 0);
+  td->current_dbt=NULL;
+  g_assert_cmpint(restore_insert_as_load_data(td, data), ==, -1);
+  g_string_free(data, TRUE);
+  g_free(dbt);
+  g_free(td);
+}
+
+static void test_tables_and_charsets(){
+  gchar *charset=load_data_charset, *names=set_names_str;
+  g_assert(table_can_be_transcoded("CREATE TABLE `t` (\n  `a` int NOT NULL,\n  `bit` varchar(10)\n)"));
+  g_assert(!table_can_be_transcoded("CREATE TABLE `t` (\n  `a` int NOT NULL,\n  `b` bit(1)\n)"));
+  set_names_str=g_strdup("/*!40101 SET NAMES sjis*/");
+  initialize_transcode();
+  g_assert(g_atomic_int_get(&transcode_disabled));
+  g_atomic_int_set(&transcode_disabled, 0);
+  g_free(load_data_charset);
+  load_data_charset=charset;
+  g_free(set_names_str);
+  set_names_str=names;
+}
+
+int main(int argc, char *argv[]){
+  g_test_init(&argc, &argv, NULL);
+  set_names_str=g_strdup("/*!40101 SET NAMES utf8mb4*/");
+  initialize_transcode();
+  g_assert_cmpstr(load_data_charset, ==, "utf8mb4");
+  g_test_add_func("/transcode/values", test_values);
+  g_test_add_func("/transcode/escapes", test_escapes);
+  g_test_add_func("/transcode/modifiers", test_modifiers);
+  g_test_add_func("/transcode/fallback", test_fallback);
+  g_test_add_func("/transcode/restore_fallback", test_restore_fallback);
+  g_test_add_func("/transcode/tables_and_charsets", test_tables_and_charsets);
+  return g_test_run();
+}